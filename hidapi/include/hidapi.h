@@ -78,6 +78,29 @@ extern "C" {
 			struct hid_device_info *next;
 		};
 
+		/** Report types, index into hid_report_info::size */
+		enum {
+			HID_REPORT_INPUT = 0,
+			HID_REPORT_OUTPUT = 1,
+			HID_REPORT_FEATURE = 2
+		};
+
+		/** One report ID as declared by the report descriptor */
+		struct hid_report_info {
+			/** Size in bytes of the input, output and feature report
+			    with this ID, 0 when the report isn't declared. Output
+			    and feature sizes count the leading report ID byte as
+			    hid_send_feature_report() does, the input size is what
+			    hid_read() returns for the report. */
+			unsigned short size[3];
+			/** Usage Page of the application collection the report
+			    was first declared in */
+			unsigned short usage_page;
+			/** Usage of the application collection the report
+			    was first declared in */
+			unsigned short usage;
+		};
+
 
 		/** @brief Initialize the HIDAPI library.
 
@@ -323,6 +346,27 @@ extern "C" {
 		*/
 		void HID_API_EXPORT HID_API_CALL hid_close(hid_device *device);
 
+		/** @brief Get the declared sizes of a report.
+
+			The report descriptor is parsed when the device is opened.
+			Once it is known hid_send_feature_report() and
+			hid_get_feature_report() refuse report IDs the descriptor
+			doesn't declare a feature report for without talking to the
+			device, and size the transfer to the declared report.
+			Currently only implemented on the Linux hidraw backend.
+
+			@ingroup API
+			@param device A device handle returned from hid_open().
+			@param report_id The report ID, 0 for devices which do not
+				use numbered reports.
+			@param info Filled in with the sizes and usage of the report.
+
+			@returns
+				This function returns 0 on success and -1 if the report
+				ID isn't declared or the descriptor isn't known.
+		*/
+		int HID_API_EXPORT HID_API_CALL hid_get_report_info(hid_device *device, unsigned char report_id, struct hid_report_info *info);
+
 		/** @brief Get The Manufacturer String from a HID device.
 
 			@ingroup API
@@ -54,6 +54,11 @@
 #define HIDIOCGFEATURE(len)    _IOC(_IOC_WRITE|_IOC_READ, 'H', 0x07, len)
 #endif
 
+/* Largest report the kernel passes through hidraw, from linux/hid.h. */
+#ifndef HID_MAX_BUFFER_SIZE
+#define HID_MAX_BUFFER_SIZE 4096
+#endif
+
 
 /* USB HID device property names */
 const char *device_string_names[] = {
@@ -75,6 +80,11 @@ struct hid_device_ {
 	int device_handle;
 	int blocking;
 	int uses_numbered_reports;
+	/* Reports declared by the report descriptor, NULL when it couldn't
+	   be read or parsed. report_index[id] is the entry for a report ID
+	   plus one, 0 for IDs the device doesn't declare. */
+	struct hid_report_info *reports;
+	unsigned char report_index[256];
 };
 
 
@@ -199,6 +209,189 @@ static int uses_numbered_reports(__u8 *report_descriptor, __u32 size) {
 	return 0;
 }
 
+/* Global items saved by Push and restored by Pop. */
+struct report_globals {
+	unsigned int usage_page;
+	unsigned int report_size;
+	unsigned int report_count;
+	unsigned int report_id;
+};
+
+#define REPORT_GLOBALS_STACK 8
+#define REPORT_COLLECTION_STACK 16
+
+/* parse_report_descriptor() walks the main, global and local items of
+   report_descriptor, adds up the bits of every Input, Output and Feature
+   item per report ID and keeps the result on dev. Returns 0 on success
+   and -1 on a malformed descriptor, in which case dev keeps no table. */
+static int parse_report_descriptor(hid_device *dev, __u8 *report_descriptor, __u32 size)
+{
+	struct report_globals globals, stack[REPORT_GLOBALS_STACK];
+	int depth = 0, collections = 0;
+	unsigned int usage = 0, has_usage = 0;
+	unsigned int app_usage_page = 0, app_usage = 0;
+	unsigned int *bits;
+	unsigned short *usage_pages, *usages;
+	unsigned char *declared;
+	int numbered = 0, count = 0, res = -1;
+	unsigned int i = 0;
+	int id, type;
+
+	bits = calloc(256 * 3, sizeof(unsigned int));
+	usage_pages = calloc(256, sizeof(unsigned short));
+	usages = calloc(256, sizeof(unsigned short));
+	declared = calloc(256, 1);
+	if (!bits || !usage_pages || !usages || !declared)
+		goto out;
+
+	memset(&globals, 0, sizeof(globals));
+
+	while (i < size) {
+		int key = report_descriptor[i];
+		unsigned int data_len, value = 0, k;
+
+		if (key == 0xfe) {
+			/* Long Item, carries no report layout. See the HID
+			   specification, version 1.11, section 6.2.2.3. */
+			if (i+1 >= size)
+				goto out;
+			i += 3 + report_descriptor[i+1];
+			continue;
+		}
+
+		data_len = (key & 0x3) == 3? 4: (key & 0x3);
+		if (i + 1 + data_len > size)
+			goto out;
+		for (k = 0; k < data_len; k++)
+			value |= (unsigned int)report_descriptor[i+1+k] << (8*k);
+		i += 1 + data_len;
+
+		switch (key & 0xfc) {
+		/* Main items */
+		case 0x80: /* Input */
+		case 0x90: /* Output */
+		case 0xb0: /* Feature */
+			type = (key & 0xfc) == 0x80? HID_REPORT_INPUT:
+			       (key & 0xfc) == 0x90? HID_REPORT_OUTPUT: HID_REPORT_FEATURE;
+			id = globals.report_id;
+			bits[id*3 + type] += globals.report_size * globals.report_count;
+			if (!declared[id]) {
+				declared[id] = 1;
+				usage_pages[id] = app_usage_page;
+				usages[id] = app_usage;
+				count++;
+			}
+			usage = has_usage = 0;
+			break;
+		case 0xa0: /* Collection */
+			if (value == 0x01/*Application*/ && collections == 0) {
+				app_usage_page = has_usage? usage >> 16: globals.usage_page;
+				app_usage = usage & 0xffff;
+			}
+			if (++collections > REPORT_COLLECTION_STACK)
+				goto out;
+			usage = has_usage = 0;
+			break;
+		case 0xc0: /* End Collection */
+			if (--collections < 0)
+				goto out;
+			usage = has_usage = 0;
+			break;
+
+		/* Global items */
+		case 0x04: /* Usage Page */
+			globals.usage_page = value;
+			break;
+		case 0x74: /* Report Size */
+			globals.report_size = value;
+			break;
+		case 0x84: /* Report ID */
+			if (value == 0 || value > 255)
+				goto out;
+			globals.report_id = value;
+			numbered = 1;
+			break;
+		case 0x94: /* Report Count */
+			globals.report_count = value;
+			break;
+		case 0xa4: /* Push */
+			if (depth == REPORT_GLOBALS_STACK)
+				goto out;
+			stack[depth++] = globals;
+			break;
+		case 0xb4: /* Pop */
+			if (depth == 0)
+				goto out;
+			globals = stack[--depth];
+			break;
+
+		/* Local items, only the first usage names a collection */
+		case 0x08: /* Usage */
+			if (!has_usage) {
+				usage = data_len == 4? value: (globals.usage_page << 16) | value;
+				has_usage = 1;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	/* An unnumbered device declares everything under ID 0, a
+	   numbered one may not use ID 0 at all. */
+	if (numbered && declared[0])
+		goto out;
+
+	dev->reports = calloc(count? count: 1, sizeof(struct hid_report_info));
+	if (!dev->reports)
+		goto out;
+	memset(dev->report_index, 0, sizeof(dev->report_index));
+	count = 0;
+	for (id = 0; id < 256; id++) {
+		struct hid_report_info *info;
+
+		if (!declared[id])
+			continue;
+		info = &dev->reports[count++];
+		dev->report_index[id] = count;
+		for (type = 0; type < 3; type++) {
+			unsigned int bytes = (bits[id*3 + type] + 7) / 8;
+			if (bytes == 0)
+				continue;
+			/* hidraw hands out input reports with the ID in front
+			   only when reports are numbered, output and feature
+			   buffers always start with it. */
+			if (type != HID_REPORT_INPUT || numbered)
+				bytes++;
+			info->size[type] = bytes > 0xffff? 0xffff: bytes;
+		}
+		info->usage_page = usage_pages[id];
+		info->usage = usages[id];
+	}
+	res = 0;
+
+out:
+	free(bits);
+	free(usage_pages);
+	free(usages);
+	free(declared);
+	return res;
+}
+
+/* Declared size of the feature report data[0] refers to, 0 when the
+   descriptor doesn't declare it and -1 when there is no table. */
+static int feature_report_size(hid_device *dev, const unsigned char *data)
+{
+	int index;
+
+	if (!dev->reports)
+		return -1;
+	index = dev->report_index[data[0]];
+	if (!index)
+		return 0;
+	return dev->reports[index-1].size[HID_REPORT_FEATURE];
+}
+
 /*
  * The caller is responsible for free()ing the (newly-allocated) character
  * strings pointed to by serial_number_utf8 and product_name_utf8 after use.
@@ -653,6 +846,10 @@ hid_device * HID_API_EXPORT hid_open_path(const char *path)
 			dev->uses_numbered_reports =
 				uses_numbered_reports(rpt_desc.value,
 				                      rpt_desc.size);
+
+			/* Keep the report sizes, hid_send_feature_report() and
+			   hid_get_feature_report() check against them. */
+			parse_report_descriptor(dev, rpt_desc.value, rpt_desc.size);
 		}
 
 		return dev;
@@ -740,6 +937,28 @@ int HID_API_EXPORT hid_set_nonblocking(hid_device *dev, int nonblock)
 int HID_API_EXPORT hid_send_feature_report(hid_device *dev, const unsigned char *data, size_t length)
 {
 	int res;
+	int declared = feature_report_size(dev, data);
+	unsigned char padded[HID_MAX_BUFFER_SIZE];
+
+	if (declared == 0) {
+		/* Not a feature report of this device, the kernel would
+		   only turn it down after a round trip. */
+		errno = EINVAL;
+		return -1;
+	}
+	if (declared > 0) {
+		/* Send the report exactly as long as declared, zero
+		   padded when the caller passed less. */
+		if (length > (size_t)declared) {
+			length = declared;
+		}
+		else if (length < (size_t)declared && declared <= HID_MAX_BUFFER_SIZE) {
+			memcpy(padded, data, length);
+			memset(padded + length, 0, declared - length);
+			data = padded;
+			length = declared;
+		}
+	}
 
 	res = ioctl(dev->device_handle, HIDIOCSFEATURE(length), data);
 	if (res < 0)
@@ -751,6 +970,14 @@ int HID_API_EXPORT hid_send_feature_report(hid_device *dev, const unsigned char
 int HID_API_EXPORT hid_get_feature_report(hid_device *dev, unsigned char *data, size_t length)
 {
 	int res;
+	int declared = feature_report_size(dev, data);
+
+	if (declared == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (declared > 0 && length > (size_t)declared)
+		length = declared;
 
 	res = ioctl(dev->device_handle, HIDIOCGFEATURE(length), data);
 	if (res < 0)
@@ -766,9 +993,23 @@ void HID_API_EXPORT hid_close(hid_device *dev)
 	if (!dev)
 		return;
 	close(dev->device_handle);
+	free(dev->reports);
 	free(dev);
 }
 
+int HID_API_EXPORT hid_get_report_info(hid_device *dev, unsigned char report_id, struct hid_report_info *info)
+{
+	int index;
+
+	if (!dev->reports)
+		return -1;
+	index = dev->report_index[report_id];
+	if (!index)
+		return -1;
+	*info = dev->reports[index-1];
+	return 0;
+}
+
 
 int HID_API_EXPORT_CALL hid_get_manufacturer_string(hid_device *dev, wchar_t *string, size_t maxlen)
 {
@@ -814,6 +814,12 @@ void HID_API_EXPORT HID_API_CALL hid_close(hid_device *dev)
 	free_hid_device(dev);
 }
 
+int HID_API_EXPORT HID_API_CALL hid_get_report_info(hid_device *dev, unsigned char report_id, struct hid_report_info *info)
+{
+	/* The report descriptor isn't kept on this backend. */
+	return -1;
+}
+
 int HID_API_EXPORT_CALL HID_API_CALL hid_get_manufacturer_string(hid_device *dev, wchar_t *string, size_t maxlen)
 {
 	BOOL res;
@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "htt_util.h"
+#include "htt_fanout.h"
+#include "htt_input.h"
+#include "htt_timerwheel.h"
+#include "htt_autodim.h"
+
+#define AUTODIM_TICK_NS 50000000ull /* 50 ms */
+#define NS_PER_SEC 1000000000ull
+
+typedef struct
+{
+	uint64_t idle_ns;
+	int level;
+} autodim_stage;
+
+typedef struct
+{
+	int start_minute;  /* minute of the day the daypart starts */
+	int active;
+	uint64_t ramp_ns;
+	int stage_count;
+	autodim_stage stages[AUTODIM_MAX_STAGES];
+} autodim_policy;
+
+typedef struct
+{
+	timer_node timer;
+	uint64_t last_touch;
+	int level;          /* level last sent, -1 when unknown */
+	int original;       /* level to restore when leaving */
+	int watched;
+	unsigned long reports;
+	unsigned long changes;
+} autodim_unit;
+
+typedef struct
+{
+	std::vector<autodim_unit> units;
+	autodim_policy policies[AUTODIM_MAX_DAYPARTS];
+	int policy_count;
+	const autodim_policy* policy;
+	timer_wheel wheel;
+	timer_node daypart_timer;
+} autodim_state;
+
+static autodim_state* s_state;
+
+static char* trim(char* s)
+{
+	while (isspace((unsigned char)*s))
+		s++;
+	size_t len = strlen(s);
+	while (len && isspace((unsigned char)s[len - 1]))
+		s[--len] = 0;
+	return s;
+}
+
+static int parse_stages(char* value, autodim_policy* policy)
+{
+	policy->stage_count = 0;
+	char* save = NULL;
+	for (char* token = strtok_r(value, " \t,", &save); token; token = strtok_r(NULL, " \t,", &save))
+	{
+		char* end;
+		double seconds = strtod(token, &end);
+		if (*end != ':' || seconds < 0 || policy->stage_count >= AUTODIM_MAX_STAGES)
+			return 0;
+		long level = strtol(end + 1, &end, 10);
+		if (*end || level < 0 || level > 255)
+			return 0;
+		autodim_stage* stage = &policy->stages[policy->stage_count];
+		stage->idle_ns = (uint64_t)(seconds * NS_PER_SEC);
+		stage->level = (int)level;
+		if (policy->stage_count && stage->idle_ns <= policy->stages[policy->stage_count - 1].idle_ns)
+			return 0;
+		policy->stage_count++;
+	}
+	return 1;
+}
+
+static int compare_policies(const void* a, const void* b)
+{
+	return ((const autodim_policy*)a)->start_minute - ((const autodim_policy*)b)->start_minute;
+}
+
+static int load_policy(const char* path, autodim_state* state, std::string& units)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+	{
+		htt_printf("error opening %s\n", path);
+		return 0;
+	}
+	char buffer[512];
+	int line = 0;
+	int ok = 1;
+	autodim_policy* policy = NULL;
+	while (ok && fgets(buffer, sizeof(buffer), f))
+	{
+		line++;
+		char* s = trim(buffer);
+		if (!*s || *s == '#')
+			continue;
+		if (*s == '[')
+		{
+			int hour, minute;
+			char tail;
+			if (sscanf(s, "[%d:%d%c", &hour, &minute, &tail) != 3 || tail != ']' ||
+				hour < 0 || hour > 23 || minute < 0 || minute > 59 || state->policy_count >= AUTODIM_MAX_DAYPARTS)
+			{
+				htt_printf("%s:%d : expected [HH:MM]\n", path, line);
+				ok = 0;
+				break;
+			}
+			policy = &state->policies[state->policy_count++];
+			memset(policy, 0, sizeof(*policy));
+			policy->start_minute = hour * 60 + minute;
+			policy->active = 255;
+			continue;
+		}
+		char* eq = strchr(s, '=');
+		if (!eq)
+		{
+			htt_printf("%s:%d : expected [HH:MM] or name=value\n", path, line);
+			ok = 0;
+			break;
+		}
+		*eq = 0;
+		char* name = trim(s);
+		char* value = trim(eq + 1);
+		char* end;
+		if (!policy && strcmp(name, "units") == 0)
+			units = value;
+		else if (policy && strcmp(name, "active") == 0)
+		{
+			policy->active = (int)strtol(value, &end, 10);
+			ok = !*end && policy->active >= 0 && policy->active <= 255;
+		}
+		else if (policy && strcmp(name, "stages") == 0)
+			ok = parse_stages(value, policy);
+		else if (policy && strcmp(name, "ramp") == 0)
+		{
+			double seconds = strtod(value, &end);
+			ok = !*end && seconds >= 0;
+			policy->ramp_ns = (uint64_t)(seconds * NS_PER_SEC);
+		}
+		else
+		{
+			htt_printf("%s:%d : unknown setting %s\n", path, line, name);
+			ok = 0;
+			break;
+		}
+		if (!ok)
+			htt_printf("%s:%d : invalid value for %s : %s\n", path, line, name, value);
+	}
+	fclose(f);
+	if (ok && !state->policy_count)
+	{
+		htt_printf("%s : no [HH:MM] policy\n", path);
+		ok = 0;
+	}
+	if (ok)
+		qsort(state->policies, state->policy_count, sizeof(autodim_policy), compare_policies);
+	return ok;
+}
+
+static int minute_of_day(time_t t, int* second)
+{
+	struct tm tm;
+	localtime_r(&t, &tm);
+	if (second)
+		*second = tm.tm_sec;
+	return tm.tm_hour * 60 + tm.tm_min;
+}
+
+/* The policy in effect at a minute of the day, the last one of the day
+ * carries over past midnight. */
+static const autodim_policy* policy_at(const autodim_state* state, int minute)
+{
+	const autodim_policy* policy = &state->policies[state->policy_count - 1];
+	for (int i = 0; i < state->policy_count; i++)
+	{
+		if (state->policies[i].start_minute <= minute)
+			policy = &state->policies[i];
+	}
+	return policy;
+}
+
+static uint64_t ns_to_next_daypart(const autodim_state* state)
+{
+	int second;
+	int minute = minute_of_day(time(NULL), &second);
+	int next = -1;
+	for (int i = 0; i < state->policy_count; i++)
+	{
+		if (state->policies[i].start_minute > minute)
+		{
+			next = state->policies[i].start_minute;
+			break;
+		}
+	}
+	if (next < 0)
+		next = state->policies[0].start_minute + 24 * 60;
+	return ((uint64_t)(next - minute) * 60 - second) * NS_PER_SEC;
+}
+
+/* Level after idle_ns without a touch, and when it changes next
+ * (UINT64_MAX when it doesn't). */
+static int level_for_idle(const autodim_policy* policy, uint64_t idle_ns, uint64_t* next_change_ns)
+{
+	int stage = 0;
+	while (stage < policy->stage_count && policy->stages[stage].idle_ns <= idle_ns)
+		stage++;
+	*next_change_ns = stage < policy->stage_count ? policy->stages[stage].idle_ns : UINT64_MAX;
+	int level = stage ? policy->stages[stage - 1].level : policy->active;
+	if (!policy->ramp_ns || !stage || stage == policy->stage_count)
+		return level;
+
+	/* fading between two stages, step by ramp_ns until the next stage */
+	const autodim_stage* from = &policy->stages[stage - 1];
+	const autodim_stage* to = &policy->stages[stage];
+	uint64_t into = idle_ns - from->idle_ns;
+	uint64_t span = to->idle_ns - from->idle_ns;
+	uint64_t step = (into / policy->ramp_ns + 1) * policy->ramp_ns + from->idle_ns;
+	if (step < *next_change_ns)
+		*next_change_ns = step;
+	return from->level + (int)((int64_t)(to->level - from->level) * (int64_t)into / (int64_t)span);
+}
+
+static void apply_level(size_t index, autodim_unit* unit, int level)
+{
+	if (level == unit->level)
+		return;
+	if (!set_backlight(g_handles[index], (uint8_t)level, 0))
+	{
+		htt_printf("Device %zu : setting backlight %d failed\n", index, level);
+		g_failures++;
+		unit->level = -1;
+		return;
+	}
+	if (g_verbose)
+		htt_printf("Device %zu : backlight %d -> %d\n", index, unit->level, level);
+	unit->level = level;
+	unit->changes++;
+}
+
+static void evaluate(autodim_state* state, size_t index, uint64_t now_ns)
+{
+	autodim_unit* unit = &state->units[index];
+	uint64_t idle = now_ns > unit->last_touch ? now_ns - unit->last_touch : 0;
+	uint64_t next;
+	apply_level(index, unit, level_for_idle(state->policy, idle, &next));
+	if (next != UINT64_MAX)
+		timerwheel_add(&state->wheel, &unit->timer, unit->last_touch + next);
+	else
+		timerwheel_remove(&state->wheel, &unit->timer);
+}
+
+static void on_unit_timer(timer_node* timer, uint64_t now_ns)
+{
+	evaluate(s_state, (size_t)(uintptr_t)timer->context, now_ns);
+}
+
+static void on_daypart_timer(timer_node* timer, uint64_t now_ns)
+{
+	autodim_state* state = s_state;
+	state->policy = policy_at(state, minute_of_day(time(NULL), NULL));
+	if (g_verbose)
+		htt_printf("Daypart %02d:%02d\n", state->policy->start_minute / 60, state->policy->start_minute % 60);
+	for (size_t i = 0; i < state->units.size(); i++)
+	{
+		if (state->units[i].watched)
+			evaluate(state, i, now_ns);
+	}
+	timerwheel_add(&state->wheel, timer, now_ns + ns_to_next_daypart(state));
+}
+
+static void on_report(size_t device, const unsigned char* data, int length, uint64_t timestamp_ns, void* context)
+{
+	(void)data;
+	(void)length;
+	autodim_state* state = (autodim_state*)context;
+	autodim_unit* unit = &state->units[device];
+	unit->last_touch = timestamp_ns;
+	unit->reports++;
+	/* while the unit is at the active level the pending timer just finds a
+	 * fresher last_touch when it fires and moves itself, a touch costs no
+	 * timer work at all */
+	if (unit->level != state->policy->active || !timer_pending(&unit->timer))
+		evaluate(state, device, timestamp_ns);
+}
+
+static void on_timer(uint64_t now_ns, void* context)
+{
+	autodim_state* state = (autodim_state*)context;
+	timerwheel_advance(&state->wheel, now_ns);
+}
+
+static void on_removed(size_t device, void* context)
+{
+	autodim_state* state = (autodim_state*)context;
+	htt_printf("Device %zu : input gone, no longer dimmed\n", device);
+	state->units[device].watched = 0;
+	timerwheel_remove(&state->wheel, &state->units[device].timer);
+}
+
+void autodim(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	const char* path = argv[start_index + 1];
+	if (fanout_in_worker())
+	{
+		htt_printf("--autodim watches all its units itself, it can't run per --device\n");
+		g_failures++;
+		return;
+	}
+
+	autodim_state state;
+	memset(state.policies, 0, sizeof(state.policies));
+	state.policy_count = 0;
+	std::string units = "all";
+	if (!load_policy(path, &state, units))
+	{
+		g_failures++;
+		return;
+	}
+	std::vector<size_t> indices(g_device_count ? g_device_count : 1);
+	int count = g_device_count ? fanout_parse_selection(units.c_str(), &indices[0], indices.size()) : 0;
+	if (count <= 0)
+	{
+		htt_printf("%s : no HTT matches units = %s\n", path, units.c_str());
+		g_failures++;
+		return;
+	}
+
+	htt_input* input = input_open(&indices[0], count);
+	if (!input)
+	{
+		g_failures++;
+		return;
+	}
+
+	s_state = &state;
+	uint64_t now = monotonic_ns();
+	timerwheel_init(&state.wheel, AUTODIM_TICK_NS, now);
+	state.policy = policy_at(&state, minute_of_day(time(NULL), NULL));
+	state.units.resize(g_device_count);
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		autodim_unit* unit = &state.units[i];
+		memset(unit, 0, sizeof(*unit));
+		timer_init(&unit->timer, on_unit_timer, (void*)(uintptr_t)i);
+		unit->watched = input_device_fd(input, i) >= 0;
+		unit->original = unit->watched ? get_backlight(g_handles[i]) : -1;
+		unit->level = unit->original;
+		unit->last_touch = now;
+		if (unit->watched)
+			evaluate(&state, i, now);
+	}
+	timer_init(&state.daypart_timer, on_daypart_timer, NULL);
+	timerwheel_add(&state.wheel, &state.daypart_timer, now + ns_to_next_daypart(&state));
+
+	htt_printf("Dimming %zu units, daypart %02d:%02d, Ctrl+C to stop\n", input_device_count(input),
+		state.policy->start_minute / 60, state.policy->start_minute % 60);
+	fflush(stdout);
+
+	input_callbacks callbacks = { on_report, on_timer, on_removed, NULL, &state };
+	input_catch_signals();
+	while (!g_input_stop && input_device_count(input))
+	{
+		input_set_timer(input, timerwheel_next_ns(&state.wheel));
+		if (input_dispatch(input, -1, &callbacks) < 0)
+		{
+			htt_printf("Input   : wait failed\n");
+			g_failures++;
+			break;
+		}
+	}
+
+	/* leave every unit at the level it had before */
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		autodim_unit* unit = &state.units[i];
+		if (unit->watched && unit->original >= 0)
+			apply_level(i, unit, unit->original);
+		if (g_verbose && unit->reports)
+			htt_printf("Device %zu : %lu reports, %lu level changes\n", i, unit->reports, unit->changes);
+	}
+	input_close(input);
+	s_state = NULL;
+}
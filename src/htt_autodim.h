@@ -0,0 +1,34 @@
+#ifndef HTT_AUTODIM_H
+#define HTT_AUTODIM_H
+
+#include "hidapi.h"
+
+/* Host side idle dimming (Linux only).
+ *
+ * Stays resident and watches the input reports of every unit, each unit
+ * dims in stages the longer it goes untouched and comes back to full
+ * brightness on the first touch. The levels are volatile backlight reports,
+ * one is sent only when a unit's level actually changes. All units share one
+ * thread and one timer wheel.
+ *
+ * Policy file, one section per daypart, starting at the given local time:
+ *
+ *   units = all              # optional, which units to watch
+ *
+ *   [07:00]
+ *   active = 255             # level while in use
+ *   stages = 30:150 120:60 600:10   # idle seconds:level
+ *   ramp = 0                 # > 0 fades linearly between stages in steps
+ *                            # of that many seconds
+ *   [19:00]
+ *   active = 120
+ *   stages = 10:40 60:0
+ */
+
+#define AUTODIM_MAX_STAGES   32
+#define AUTODIM_MAX_DAYPARTS 24
+
+/* --autodim policyfile, runs until SIGINT / SIGTERM */
+void autodim(hid_device* device, char* argv[], int start_index);
+
+#endif
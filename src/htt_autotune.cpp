@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "htt_util.h"
+#include "htt_fanout.h"
+#include "htt_touchreader.h"
+#include "htt_autotune.h"
+
+int autotune_next(const autotune_range* range)
+{
+	if (range->low < range->high)
+		return range->low + (range->high - range->low) / 2;
+	return range->high_clean ? -1 : range->high;
+}
+
+int autotune_result(autotune_range* range, uint16_t threshold, int clean)
+{
+	if (clean)
+	{
+		range->high = threshold;
+		range->high_clean = 1;
+		return 1;
+	}
+	if (threshold >= range->high)
+		return 0;
+	range->low = threshold + 1;
+	return 1;
+}
+
+typedef struct
+{
+	int active;
+	int finished;
+	int original;
+	int threshold;           /* being measured, -1 when done */
+	uint64_t down;           /* contact ids touching, by id modulo 64 */
+	uint64_t touches;        /* contacts down at the start of the window or touching down in it */
+	int writes;
+	autotune_range range;
+} autotune_unit;
+
+typedef struct
+{
+	std::vector<autotune_unit> units;
+	int counting;
+} autotune_state;
+
+static void on_frame(size_t device, const touch_frame* frame, uint64_t read_ns, void* context)
+{
+	(void)read_ns;
+	autotune_state* state = (autotune_state*)context;
+	autotune_unit* unit = &state->units[device];
+	if (!unit->active || unit->threshold < 0)
+		return;
+	for (int i = 0; i < frame->count; i++)
+	{
+		const touch_contact* contact = &frame->contacts[i];
+		uint64_t bit = 1ull << (contact->id & 63);
+		if (!contact->tip)
+			unit->down &= ~bit;
+		else if (!(unit->down & bit))
+		{
+			unit->down |= bit;
+			if (state->counting)
+				unit->touches++;
+		}
+	}
+}
+
+static void restore(autotune_unit* unit, size_t index)
+{
+	int success = set_touch_threshold(g_handles[index], (uint16_t)unit->original);
+	htt_printf("Device %zu : restoring touch threshold %d : %s\n", index, unit->original, result_string(success));
+	if (!success)
+		g_failures++;
+}
+
+void autotune_threshold(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	double seconds = 0;
+	unsigned int low = 0, high = 65535;
+	int used = 0;
+	const char* spec = argv[start_index + 1];
+	int fields = sscanf(spec, "%lf%n,%u-%u%n", &seconds, &used, &low, &high, &used);
+	if ((fields != 1 && fields != 3) || spec[used] || seconds <= 0 || low > high || high > 65535)
+	{
+		htt_printf("Invalid autotune : %s, expected seconds[,low-high] with thresholds up to 65535\n", spec);
+		g_failures++;
+		return;
+	}
+	if (fanout_in_worker())
+	{
+		htt_printf("--autotune-threshold reads all units itself, it can't run per --device\n");
+		g_failures++;
+		return;
+	}
+
+	std::vector<size_t> indices;
+	for (size_t i = 0; i < g_device_count; i++)
+		if (g_handles[i])
+			indices.push_back(i);
+	/* every contact counts, however short */
+	touchfilter_config filter = { 0, 0, 0 };
+	touch_reader* reader = indices.empty() ? NULL : touch_reader_open(&indices[0], indices.size(), &filter,
+		&g_touch_transform);
+	if (!reader)
+	{
+		htt_printf("No HTT touch input to tune\n");
+		g_failures++;
+		return;
+	}
+
+	autotune_state state;
+	state.units.resize(g_device_count);
+	memset(&state.units[0], 0, sizeof(autotune_unit) * g_device_count);
+	state.counting = 0;
+	int remaining = 0;
+	for (size_t k = 0; k < indices.size(); k++)
+	{
+		size_t i = indices[k];
+		autotune_unit* unit = &state.units[i];
+		if (!touch_reader_layout(reader, i))
+			continue;
+		/* without it there is nothing to put back on an abort */
+		unit->original = get_touch_threshold(g_handles[i]);
+		if (unit->original < 0)
+		{
+			htt_printf("Device %zu : Error reading touch threshold, not tuned\n", i);
+			g_failures++;
+			continue;
+		}
+		unit->range.low = (uint16_t)low;
+		unit->range.high = (uint16_t)high;
+		unit->active = 1;
+		htt_printf("Device %zu : touch threshold %d, searching %u-%u\n", i, unit->original, low, high);
+		remaining++;
+	}
+	htt_printf("Autotune : don't touch the panels, %.1f s per step, Ctrl+C aborts and restores the thresholds\n",
+		seconds);
+	fflush(stdout);
+
+	int aborted = 0;
+	while (remaining && !aborted)
+	{
+		for (size_t i = 0; i < g_device_count; i++)
+		{
+			autotune_unit* unit = &state.units[i];
+			if (!unit->active || unit->finished)
+				continue;
+			unit->threshold = autotune_next(&unit->range);
+			if (unit->threshold < 0)
+				continue;
+			unit->writes++;
+			if (!set_touch_threshold(g_handles[i], (uint16_t)unit->threshold))
+			{
+				htt_printf("Device %zu : Error setting touch threshold %d\n", i, unit->threshold);
+				restore(unit, i);
+				unit->finished = 1;
+				remaining--;
+				g_failures++;
+			}
+		}
+		if (!remaining)
+			break;
+
+		/* a new threshold can take a moment to apply, then count */
+		state.counting = 0;
+		if (touch_reader_run(reader, AUTOTUNE_SETTLE_MS * 1000000ull, on_frame, &state) < 0)
+			aborted = 1;
+		/* a contact that touched down while settling or at an earlier
+		 * threshold and is still down is a false touch of this one too */
+		for (size_t i = 0; i < g_device_count; i++)
+			state.units[i].touches = (uint64_t)__builtin_popcountll(state.units[i].down);
+		state.counting = 1;
+		if (!aborted && touch_reader_run(reader, (uint64_t)(seconds * 1e9), on_frame, &state) < 0)
+			aborted = 1;
+		if (g_input_stop)
+			aborted = 1;
+		if (aborted)
+			break;
+
+		for (size_t i = 0; i < g_device_count; i++)
+		{
+			autotune_unit* unit = &state.units[i];
+			if (!unit->active || unit->finished)
+				continue;
+			if (!touch_reader_layout(reader, i))
+			{
+				htt_printf("Device %zu : gone while tuning\n", i);
+				restore(unit, i);
+				unit->finished = 1;
+				remaining--;
+				g_failures++;
+				continue;
+			}
+			if (unit->threshold >= 0)
+			{
+				htt_printf("Device %zu : threshold %d, %llu false touches (%.2f/s)\n", i, unit->threshold,
+					(unsigned long long)unit->touches, unit->touches / seconds);
+				if (!autotune_result(&unit->range, (uint16_t)unit->threshold, unit->touches == 0))
+				{
+					htt_printf("Device %zu : false touches up to threshold %u\n", i, high);
+					restore(unit, i);
+					unit->finished = 1;
+					remaining--;
+					g_failures++;
+					continue;
+				}
+			}
+			if (autotune_next(&unit->range) < 0)
+			{
+				/* the last threshold measured may have been below the answer */
+				int success = 1;
+				if (unit->threshold != unit->range.high)
+				{
+					success = set_touch_threshold(g_handles[i], unit->range.high);
+					unit->writes++;
+				}
+				int readback = get_touch_threshold(g_handles[i]);
+				htt_printf("Device %zu : touch threshold %d after %d writes (was %d) : %s\n", i, readback,
+					unit->writes, unit->original, result_string(success && readback == unit->range.high));
+				if (!success || readback != unit->range.high)
+					g_failures++;
+				unit->finished = 1;
+				remaining--;
+			}
+		}
+		fflush(stdout);
+	}
+
+	if (aborted)
+	{
+		htt_printf("Autotune : aborted\n");
+		g_failures++;
+		for (size_t i = 0; i < g_device_count; i++)
+			if (state.units[i].active && !state.units[i].finished)
+				restore(&state.units[i], i);
+	}
+	touch_reader_close(reader);
+}
@@ -0,0 +1,41 @@
+#ifndef HTT_AUTOTUNE_H
+#define HTT_AUTOTUNE_H
+
+#include <stdint.h>
+#include "hidapi.h"
+
+/* Tuning the touch threshold of the units (Linux only).
+ *
+ * The panels must be left untouched: every contact seen is a false touch.
+ * Each unit binary searches its own threshold range, all of them in step:
+ * the threshold is written, the reports of a short settle time are ignored
+ * and then the contacts still down or touching down during an idle window
+ * are counted. A threshold with none moves the top of the range down,
+ * otherwise the bottom up, so a 16 bit range takes at most 17 writes
+ * instead of thousands. A higher threshold is assumed to never give more
+ * false touches.
+ *
+ * The lowest threshold with no false touches is left on the unit. Should
+ * the run be aborted, a unit go away or no threshold in the range be clean,
+ * the threshold the unit had before is written back. */
+
+#define AUTOTUNE_SETTLE_MS 250
+
+typedef struct
+{
+	uint16_t low;            /* range still to search, the answer is in it */
+	uint16_t high;
+	int high_clean;          /* high was measured with no false touches */
+} autotune_range;
+
+/* The next threshold to try, or -1 when the range is down to one value
+ * that was measured clean. */
+int autotune_next(const autotune_range* range);
+/* Narrows the range after measuring threshold. Returns 0 when no threshold
+ * in the range is left that could be clean. */
+int autotune_result(autotune_range* range, uint16_t threshold, int clean);
+
+/* --autotune-threshold seconds[,low-high] */
+void autotune_threshold(hid_device* device, char* argv[], int start_index);
+
+#endif
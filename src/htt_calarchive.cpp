@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include "htt_util.h"
+#include "htt_calarchive.h"
+
+#ifndef _WIN32
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+static const char s_magic[8] = { 'H', 'T', 'T', 'C', 'A', 'L', 0, 0 };
+
+/* entry layout */
+#define ENTRY_SERIAL    0
+#define ENTRY_MODULEID  64
+#define ENTRY_FWREV     68
+#define ENTRY_DRIVER    72
+#define ENTRY_RESERVED  76
+#define ENTRY_TIMESTAMP 80
+#define ENTRY_MATRIX    88
+#define ENTRY_CRC       144
+#define ENTRY_PADDING   148
+
+/* header layout */
+#define HEADER_VERSION    8
+#define HEADER_ENTRYSIZE  10
+#define HEADER_COUNT      12
+#define HEADER_TIMESTAMP  16
+#define HEADER_CRC        24
+#define HEADER_RESERVED   28
+
+struct calarchive
+{
+	const unsigned char* data;
+	size_t size;
+	size_t count;
+#ifdef _WIN32
+	unsigned char* buffer;
+#endif
+};
+
+uint32_t calarchive_crc32(const unsigned char* data, size_t length)
+{
+	static uint32_t table[256];
+	static int table_ready = 0;
+	if (!table_ready)
+	{
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[i] = c;
+		}
+		table_ready = 1;
+	}
+	uint32_t crc = 0xFFFFFFFFu;
+	for (size_t i = 0; i < length; i++)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return crc ^ 0xFFFFFFFFu;
+}
+
+static void put_u16(unsigned char* p, uint16_t v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static void put_u32(unsigned char* p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		p[i] = (v >> (8 * i)) & 0xff;
+}
+
+static void put_u64(unsigned char* p, uint64_t v)
+{
+	for (int i = 0; i < 8; i++)
+		p[i] = (v >> (8 * i)) & 0xff;
+}
+
+static uint16_t get_u16(const unsigned char* p)
+{
+	return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static uint32_t get_u32(const unsigned char* p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_u64(const unsigned char* p)
+{
+	return (uint64_t)get_u32(p) | (uint64_t)get_u32(p + 4) << 32;
+}
+
+int calarchive_is_archive(const char* path)
+{
+	size_t len = strlen(path);
+	return len > 5 && strcmp(path + len - 5, ".htca") == 0;
+}
+
+static void encode_entry(const calibration_record* r, unsigned char* e)
+{
+	memset(e, 0, CALARCHIVE_ENTRY_SIZE);
+	strncpy((char*)e + ENTRY_SERIAL, r->serial, CALARCHIVE_SERIAL_SIZE - 1);
+	put_u32(e + ENTRY_MODULEID, (uint32_t)r->module_id);
+	put_u32(e + ENTRY_FWREV, (uint32_t)r->fwrev);
+	put_u32(e + ENTRY_DRIVER, (uint32_t)r->driver);
+	put_u64(e + ENTRY_TIMESTAMP, r->timestamp);
+	memcpy(e + ENTRY_MATRIX, r->matrix, CALARCHIVE_MATRIX_SIZE);
+	put_u32(e + ENTRY_CRC, calarchive_crc32(e, ENTRY_CRC));
+}
+
+static int decode_entry(const unsigned char* e, calibration_record* r)
+{
+	if (get_u32(e + ENTRY_CRC) != calarchive_crc32(e, ENTRY_CRC))
+		return 0;
+	memcpy(r->serial, e + ENTRY_SERIAL, CALARCHIVE_SERIAL_SIZE);
+	r->serial[CALARCHIVE_SERIAL_SIZE - 1] = 0;
+	r->module_id = (int32_t)get_u32(e + ENTRY_MODULEID);
+	r->fwrev = (int32_t)get_u32(e + ENTRY_FWREV);
+	r->driver = (int32_t)get_u32(e + ENTRY_DRIVER);
+	r->timestamp = get_u64(e + ENTRY_TIMESTAMP);
+	memcpy(r->matrix, e + ENTRY_MATRIX, CALARCHIVE_MATRIX_SIZE);
+	return 1;
+}
+
+static bool record_less(const calibration_record& a, const calibration_record& b)
+{
+	return strncmp(a.serial, b.serial, CALARCHIVE_SERIAL_SIZE) < 0;
+}
+
+int calarchive_write(const char* path, std::vector<calibration_record>& records)
+{
+	std::sort(records.begin(), records.end(), record_less);
+	for (size_t i = 1; i < records.size(); i++)
+	{
+		if (!record_less(records[i - 1], records[i]))
+		{
+			htt_printf("Serial number %s is in the archive twice.\n", records[i].serial);
+			return 0;
+		}
+	}
+
+	std::vector<unsigned char> data(CALARCHIVE_HEADER_SIZE + records.size() * CALARCHIVE_ENTRY_SIZE, 0);
+	unsigned char* h = &data[0];
+	memcpy(h, s_magic, sizeof(s_magic));
+	put_u16(h + HEADER_VERSION, CALARCHIVE_VERSION);
+	put_u16(h + HEADER_ENTRYSIZE, CALARCHIVE_ENTRY_SIZE);
+	put_u32(h + HEADER_COUNT, (uint32_t)records.size());
+	put_u64(h + HEADER_TIMESTAMP, (uint64_t)time(NULL));
+	put_u32(h + HEADER_CRC, calarchive_crc32(h, HEADER_CRC));
+	for (size_t i = 0; i < records.size(); i++)
+		encode_entry(&records[i], &data[CALARCHIVE_HEADER_SIZE + i * CALARCHIVE_ENTRY_SIZE]);
+
+	/* write next to it and rename, a failed write leaves the old archive */
+	std::string tmp = std::string(path) + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "wb");
+	if (!f)
+	{
+		htt_printf("error opening %s\n", tmp.c_str());
+		return 0;
+	}
+	size_t written = fwrite(&data[0], 1, data.size(), f);
+	if (fclose(f) != 0 || written != data.size())
+	{
+		htt_printf("error writing %s\n", tmp.c_str());
+		remove(tmp.c_str());
+		return 0;
+	}
+#ifdef _WIN32
+	remove(path);
+#endif
+	if (rename(tmp.c_str(), path) != 0)
+	{
+		htt_printf("error replacing %s\n", path);
+		remove(tmp.c_str());
+		return 0;
+	}
+	return 1;
+}
+
+static int validate(calarchive* a, const char* path)
+{
+	const unsigned char* h = a->data;
+	if (a->size < CALARCHIVE_HEADER_SIZE || memcmp(h, s_magic, sizeof(s_magic)) != 0)
+	{
+		htt_printf("%s is not a calibration archive.\n", path);
+		return 0;
+	}
+	if (get_u32(h + HEADER_CRC) != calarchive_crc32(h, HEADER_CRC))
+	{
+		htt_printf("%s : header CRC mismatch.\n", path);
+		return 0;
+	}
+	if (get_u16(h + HEADER_VERSION) != CALARCHIVE_VERSION || get_u16(h + HEADER_ENTRYSIZE) != CALARCHIVE_ENTRY_SIZE)
+	{
+		htt_printf("%s : unsupported archive version %d.\n", path, get_u16(h + HEADER_VERSION));
+		return 0;
+	}
+	a->count = get_u32(h + HEADER_COUNT);
+	if (a->size != CALARCHIVE_HEADER_SIZE + a->count * CALARCHIVE_ENTRY_SIZE)
+	{
+		htt_printf("%s : size does not match %zu entries.\n", path, a->count);
+		return 0;
+	}
+	return 1;
+}
+
+calarchive* calarchive_open(const char* path)
+{
+	calarchive* a = (calarchive*)calloc(1, sizeof(calarchive));
+	if (!a)
+		return NULL;
+#ifndef _WIN32
+	int fd = open(path, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		htt_printf("error opening %s\n", path);
+		if (fd >= 0)
+			close(fd);
+		free(a);
+		return NULL;
+	}
+	a->size = st.st_size;
+	if (a->size)
+	{
+		void* map = mmap(NULL, a->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		a->data = map == MAP_FAILED ? NULL : (const unsigned char*)map;
+	}
+	close(fd);
+#else
+	FILE* f = fopen(path, "rb");
+	if (!f)
+	{
+		htt_printf("error opening %s\n", path);
+		free(a);
+		return NULL;
+	}
+	fseek(f, 0, SEEK_END);
+	a->size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	a->buffer = (unsigned char*)malloc(a->size ? a->size : 1);
+	if (a->buffer && fread(a->buffer, 1, a->size, f) == a->size)
+		a->data = a->buffer;
+	fclose(f);
+#endif
+	if (!a->data && a->size)
+		htt_printf("error reading %s\n", path);
+	if (!a->data || !validate(a, path))
+	{
+		calarchive_close(a);
+		return NULL;
+	}
+	return a;
+}
+
+void calarchive_close(calarchive* a)
+{
+	if (!a)
+		return;
+#ifndef _WIN32
+	if (a->data)
+		munmap((void*)a->data, a->size);
+#else
+	free(a->buffer);
+#endif
+	free(a);
+}
+
+size_t calarchive_count(const calarchive* a)
+{
+	return a->count;
+}
+
+int calarchive_get(const calarchive* a, size_t n, calibration_record* record)
+{
+	if (n >= a->count)
+		return 0;
+	return decode_entry(a->data + CALARCHIVE_HEADER_SIZE + n * CALARCHIVE_ENTRY_SIZE, record) ? 1 : -1;
+}
+
+int calarchive_find(const calarchive* a, const char* serial, calibration_record* record)
+{
+	size_t lo = 0;
+	size_t hi = a->count;
+	while (lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		const unsigned char* e = a->data + CALARCHIVE_HEADER_SIZE + mid * CALARCHIVE_ENTRY_SIZE;
+		int cmp = strncmp(serial, (const char*)e + ENTRY_SERIAL, CALARCHIVE_SERIAL_SIZE);
+		if (cmp == 0)
+			return decode_entry(e, record) ? 1 : -1;
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	return 0;
+}
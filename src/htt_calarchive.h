@@ -0,0 +1,56 @@
+#ifndef HTT_CALARCHIVE_H
+#define HTT_CALARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/* Calibration archive (.htca), the calibration matrices of many units in a
+ * single file.
+ *
+ *   header   32 bytes   "HTTCAL\0\0", version, entry size, entry count,
+ *                       creation time, CRC32 of the header
+ *   entries  152 bytes  each, sorted by serial number
+ *
+ * All integers are little endian. Entries have a fixed size and are sorted,
+ * so the entry table is its own index: a reader maps the file and binary
+ * searches a serial number without parsing the other entries. Every entry
+ * carries a CRC32 of its own bytes. */
+
+#define CALARCHIVE_VERSION     1
+#define CALARCHIVE_HEADER_SIZE 32
+#define CALARCHIVE_ENTRY_SIZE  152
+#define CALARCHIVE_SERIAL_SIZE 64
+#define CALARCHIVE_MATRIX_SIZE 56
+
+typedef struct
+{
+	char serial[CALARCHIVE_SERIAL_SIZE];  /* NUL terminated */
+	int32_t module_id;
+	int32_t fwrev;
+	int32_t driver;
+	uint64_t timestamp;                   /* seconds since 1970 */
+	unsigned char matrix[CALARCHIVE_MATRIX_SIZE];
+} calibration_record;
+
+typedef struct calarchive calarchive;
+
+/* 1 when the file name ends in .htca */
+int calarchive_is_archive(const char* path);
+
+/* Sorts the records and writes them, replacing the file. Returns 1 on success. */
+int calarchive_write(const char* path, std::vector<calibration_record>& records);
+
+/* Maps an archive. Returns NULL (and prints why) when it is not valid. */
+calarchive* calarchive_open(const char* path);
+void calarchive_close(calarchive* archive);
+size_t calarchive_count(const calarchive* archive);
+
+/* Binary search, returns 1 and fills record when serial is present and its
+ * CRC is good, 0 when not present, -1 when the entry is corrupt. */
+int calarchive_find(const calarchive* archive, const char* serial, calibration_record* record);
+int calarchive_get(const calarchive* archive, size_t n, calibration_record* record);
+
+uint32_t calarchive_crc32(const unsigned char* data, size_t length);
+
+#endif
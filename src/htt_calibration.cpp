@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "htt_util.h"
+#include "htt_fanout.h"
+#include "htt_calarchive.h"
+#include "htt_calibration.h"
+
+typedef struct
+{
+	const char* path;                          /* directory or archive */
+	calarchive* archive;                       /* restore from an archive */
+	std::vector<calibration_record>* records;  /* backup to an archive, one per job */
+	std::vector<char>* have_record;
+} calibration_job;
+
+/* serial numbers end up in file names, keep them to something portable */
+static void sanitize(const char* in, char* out, size_t size)
+{
+	size_t i = 0;
+	for (; in[i] && i + 1 < size; i++)
+	{
+		unsigned char c = in[i];
+		out[i] = (isalnum(c) || c == '-' || c == '.') ? c : '_';
+	}
+	out[i] = 0;
+}
+
+int calibration_key(size_t index, char* key, size_t size)
+{
+	const htt_identity* id = &g_identities[index];
+	if (id->serial[0])
+		snprintf(key, size, "%s", id->serial);
+	else if (id->port[0])
+		snprintf(key, size, "port-%s", id->port);
+	else
+		return 0;
+	return 1;
+}
+
+int calibration_file_name(size_t index, char* name, size_t size)
+{
+	char key[CALARCHIVE_SERIAL_SIZE];
+	char clean[CALARCHIVE_SERIAL_SIZE];
+	if (!calibration_key(index, key, sizeof(key)))
+		return 0;
+	sanitize(key, clean, sizeof(clean));
+	snprintf(name, size, "%s.bin", clean);
+	return 1;
+}
+
+void fill_record(size_t index, hid_device* handle, int driver, const unsigned char* matrix, calibration_record* record)
+{
+	memset(record, 0, sizeof(*record));
+	calibration_key(index, record->serial, sizeof(record->serial));
+	record->fwrev = get_fwrev(handle);
+	/* the module ID report arrived with the same firmware as in scan_internal() */
+	record->module_id = record->fwrev > 10656 ? get_moduleID(handle) : -1;
+	record->driver = driver;
+	record->timestamp = (uint64_t)time(NULL);
+	memcpy(record->matrix, matrix, CALARCHIVE_MATRIX_SIZE);
+}
+
+/* Adds or replaces records of an archive, matched by serial number. The
+ * entries of other units are kept, the archive is created when it does not
+ * exist yet. */
+int calibration_archive_update(const char* path, const calibration_record* updates, size_t count)
+{
+	std::vector<calibration_record> records;
+	FILE* f = fopen(path, "rb");
+	if (f)
+	{
+		fclose(f);
+		calarchive* archive = calarchive_open(path);
+		if (!archive)
+			return 0;
+		for (size_t i = 0; i < calarchive_count(archive); i++)
+		{
+			calibration_record r;
+			if (calarchive_get(archive, i, &r) <= 0)
+			{
+				htt_printf("%s : entry %zu is corrupt.\n", path, i);
+				calarchive_close(archive);
+				return 0;
+			}
+			size_t k = 0;
+			while (k < count && strcmp(r.serial, updates[k].serial) != 0)
+				k++;
+			if (k == count)
+				records.push_back(r);
+		}
+		calarchive_close(archive);
+	}
+	records.insert(records.end(), updates, updates + count);
+	return calarchive_write(path, records);
+}
+
+/* Reads the matrix for a unit from a .htca archive or a raw 56 byte .bin
+ * file. Returns 1 when matrix was filled. */
+int calibration_read(const char* path, size_t index, unsigned char* matrix)
+{
+	if (calarchive_is_archive(path))
+	{
+		char key[CALARCHIVE_SERIAL_SIZE];
+		if (!calibration_key(index, key, sizeof(key)))
+		{
+			htt_printf("Device %zu has no serial number to look up in %s\n", index, path);
+			return 0;
+		}
+		calarchive* archive = calarchive_open(path);
+		if (!archive)
+			return 0;
+		calibration_record record;
+		int res = calarchive_find(archive, key, &record);
+		calarchive_close(archive);
+		if (res <= 0)
+		{
+			htt_printf(res < 0 ? "%s : entry for %s is corrupt.\n" : "%s has no calibration for %s.\n", path, key);
+			return 0;
+		}
+		memcpy(matrix, record.matrix, CALARCHIVE_MATRIX_SIZE);
+		return 1;
+	}
+
+	FILE* f = fopen(path, "rb");
+	if (!f)
+	{
+		htt_printf("error opening %s\n", path);
+		return 0;
+	}
+	unsigned char buffer[CALMATRIX_SIZE + 1];
+	size_t size = fread(buffer, 1, sizeof(buffer), f);
+	fclose(f);
+	if (size != CALMATRIX_SIZE)
+	{
+		htt_printf("File size mismatch, %s expected 56 bytes.\n", path);
+		return 0;
+	}
+	memcpy(matrix, buffer, CALMATRIX_SIZE);
+	return 1;
+}
+
+/* Returns 1 when the job should go on with this unit. Units without a
+ * resistive touch panel are skipped, that is not an error. */
+static int check_resistive(size_t index, hid_device* handle, int* driver_out, char* path, size_t size, const char* dir)
+{
+	if (!handle)
+	{
+		htt_printf("Device %zu : not available.\n", index);
+		g_failures++;
+		return 0;
+	}
+	int driver = get_driver(handle);
+	if (driver < 0)
+	{
+		htt_printf("Device %zu : Error retrieving driver type.\n", index);
+		g_failures++;
+		return 0;
+	}
+	if (driver != TOUCH_RESISTIVE)
+	{
+		htt_printf("Device %zu : skipped, %s driver.\n", index, TouchTypes[driver]);
+		return 0;
+	}
+	*driver_out = driver;
+	if (calarchive_is_archive(dir))
+	{
+		snprintf(path, size, "%s", dir);
+		return 1;
+	}
+	char name[96];
+	if (!calibration_file_name(index, name, sizeof(name)))
+	{
+		htt_printf("Device %zu : no serial number or USB port to name the file after.\n", index);
+		g_failures++;
+		return 0;
+	}
+	snprintf(path, size, "%s/%s", dir, name);
+	return 1;
+}
+
+static void backup_job(size_t index, void* context)
+{
+	calibration_job* job = (calibration_job*)context;
+	hid_device* handle = g_handles[index];
+	char path[512];
+	int driver;
+	if (!check_resistive(index, handle, &driver, path, sizeof(path), job->path))
+		return;
+
+	unsigned char buffer[80];
+	if (get_calmatrix(handle, buffer, sizeof(buffer)) != CALMATRIX_SIZE)
+	{
+		htt_printf("Device %zu : Error retrieving calibration matrix.\n", index);
+		g_failures++;
+		return;
+	}
+	if (job->records)
+	{
+		/* the archive is written in one go once every unit is read */
+		fill_record(index, handle, driver, buffer, &(*job->records)[index]);
+		(*job->have_record)[index] = 1;
+		htt_printf("Device %zu : calibration matrix read.\n", index);
+		return;
+	}
+	FILE* f = fopen(path, "wb");
+	if (!f)
+	{
+		htt_printf("Device %zu : error opening %s\n", index, path);
+		g_failures++;
+		return;
+	}
+	size_t written = fwrite(buffer, 1, CALMATRIX_SIZE, f);
+	if (fclose(f) != 0 || written != CALMATRIX_SIZE)
+	{
+		htt_printf("Device %zu : error writing %s\n", index, path);
+		g_failures++;
+		return;
+	}
+	htt_printf("Device %zu : calibration matrix written to %s\n", index, path);
+}
+
+static void restore_job(size_t index, void* context)
+{
+	calibration_job* job = (calibration_job*)context;
+	hid_device* handle = g_handles[index];
+	char path[512];
+	int driver;
+	if (!check_resistive(index, handle, &driver, path, sizeof(path), job->path))
+		return;
+
+	unsigned char matrix[CALMATRIX_SIZE];
+	if (job->archive)
+	{
+		char key[CALARCHIVE_SERIAL_SIZE];
+		calibration_record record;
+		int res = calibration_key(index, key, sizeof(key)) ? calarchive_find(job->archive, key, &record) : 0;
+		if (res <= 0)
+		{
+			htt_printf(res < 0 ? "Device %zu : entry in %s is corrupt.\n" : "Device %zu : no calibration in %s\n", index, path);
+			g_failures++;
+			return;
+		}
+		if (record.driver != driver)
+			htt_printf("Device %zu : warning, calibration was saved from a %s unit.\n", index,
+				record.driver >= TOUCH_NONE && record.driver <= TOUCH_ILI25xx ? TouchTypes[record.driver] : "unknown");
+		memcpy(matrix, record.matrix, CALMATRIX_SIZE);
+	}
+	else if (!calibration_read(path, index, matrix))
+	{
+		g_failures++;
+		return;
+	}
+
+	/* every write needs a reconnect to take effect, don't write what's there */
+	unsigned char current[80];
+	if (get_calmatrix(handle, current, sizeof(current)) == CALMATRIX_SIZE &&
+		memcmp(current, matrix, CALMATRIX_SIZE) == 0)
+	{
+		htt_printf("Device %zu : calibration matrix already matches %s, skipped.\n", index, path);
+		return;
+	}
+	if (!set_calmatrix(handle, matrix, CALMATRIX_SIZE))
+	{
+		htt_printf("Device %zu : Error saving calibration matrix.\n", index);
+		g_failures++;
+		return;
+	}
+	htt_printf("Device %zu : calibration matrix from %s written, reconnect the USB cable to load it.\n", index, path);
+}
+
+static void calibration_all(calibration_job* job, fanout_job fn)
+{
+	if (!g_device_count)
+	{
+		htt_printf("No HTT detected\n");
+		g_failures++;
+		return;
+	}
+	std::vector<size_t> indices(g_device_count);
+	for (size_t i = 0; i < g_device_count; i++)
+		indices[i] = i;
+	fflush(stdout);
+	fanout_for_each(&indices[0], indices.size(), fn, job, NULL);
+}
+
+void backup_calibration(hid_device* device, char* argv[], int start_index)
+{
+	calibration_job job = { argv[start_index + 1], NULL, NULL, NULL };
+	if (!calarchive_is_archive(job.path))
+	{
+		calibration_all(&job, backup_job);
+		return;
+	}
+
+	std::vector<calibration_record> records(g_device_count);
+	std::vector<char> have_record(g_device_count, 0);
+	job.records = &records;
+	job.have_record = &have_record;
+	calibration_all(&job, backup_job);
+
+	std::vector<calibration_record> archive;
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		if (have_record[i])
+			archive.push_back(records[i]);
+	}
+	if (archive.empty())
+		return;
+	/* units not connected right now keep their entries */
+	if (calibration_archive_update(job.path, &archive[0], archive.size()))
+	{
+		htt_printf("%zu calibration matrices written to %s\n", archive.size(), job.path);
+	}
+	else
+	{
+		g_failures++;
+	}
+}
+
+void restore_calibration(hid_device* device, char* argv[], int start_index)
+{
+	calibration_job job = { argv[start_index + 1], NULL, NULL, NULL };
+	if (calarchive_is_archive(job.path))
+	{
+		job.archive = calarchive_open(job.path);
+		if (!job.archive)
+		{
+			g_failures++;
+			return;
+		}
+	}
+	calibration_all(&job, restore_job);
+	calarchive_close(job.archive);
+}
+
+void import_calibration(hid_device* device, char* argv[], int start_index)
+{
+	const char* archive = argv[start_index + 1];
+	const char* file = argv[start_index + 2];
+	if (!calarchive_is_archive(archive))
+	{
+		htt_printf("%s is not a .htca file.\n", archive);
+		g_failures++;
+		return;
+	}
+
+	/* [serial].bin as written by --backup-calibration */
+	const char* name = file;
+	for (const char* p = file; *p; p++)
+	{
+		if (*p == '/' || *p == '\\')
+			name = p + 1;
+	}
+	std::string serial(name);
+	if (serial.size() > 4 && serial.compare(serial.size() - 4, 4, ".bin") == 0)
+		serial.resize(serial.size() - 4);
+	if (serial.empty() || serial.size() >= CALARCHIVE_SERIAL_SIZE)
+	{
+		htt_printf("Can't take a serial number from the file name %s\n", file);
+		g_failures++;
+		return;
+	}
+
+	calibration_record record;
+	memset(&record, 0, sizeof(record));
+	snprintf(record.serial, sizeof(record.serial), "%s", serial.c_str());
+	record.module_id = -1;
+	record.fwrev = 0;
+	record.driver = TOUCH_RESISTIVE;
+	record.timestamp = (uint64_t)time(NULL);
+	FILE* f = fopen(file, "rb");
+	size_t size = 0;
+	if (f)
+	{
+		unsigned char buffer[CALMATRIX_SIZE + 1];
+		size = fread(buffer, 1, sizeof(buffer), f);
+		fclose(f);
+		memcpy(record.matrix, buffer, CALMATRIX_SIZE);
+	}
+	if (size != CALMATRIX_SIZE)
+	{
+		htt_printf(f ? "File size mismatch, %s expected 56 bytes.\n" : "error opening %s\n", file);
+		g_failures++;
+		return;
+	}
+	if (calibration_archive_update(archive, &record, 1))
+	{
+		htt_printf("Calibration matrix of %s added to %s\n", record.serial, archive);
+	}
+	else
+	{
+		g_failures++;
+	}
+}
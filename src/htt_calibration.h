@@ -0,0 +1,34 @@
+#ifndef HTT_CALIBRATION_H
+#define HTT_CALIBRATION_H
+
+#include "hidapi.h"
+#include "htt_calarchive.h"
+
+#define CALMATRIX_SIZE 56
+
+/* --backup-calibration [directory]
+ * --restore-calibration [directory]
+ * Save / load the calibration matrix of every resistive unit at once, the
+ * files are named after the serial number of the unit. A path ending in
+ * .htca is a calibration archive holding all units instead. */
+void backup_calibration(hid_device* device, char* argv[], int start_index);
+void restore_calibration(hid_device* device, char* argv[], int start_index);
+
+/* --import-calibration [archive.htca] [serial.bin]
+ * Adds a raw 56 byte calibration file to an archive. */
+void import_calibration(hid_device* device, char* argv[], int start_index);
+
+/* Key a unit is stored under, its serial number or port-[port] when the
+ * unit has no serial number. Returns 0 when the unit can't be identified. */
+int calibration_key(size_t index, char* key, size_t size);
+
+/* File name used for a unit in a backup directory, [key].bin */
+int calibration_file_name(size_t index, char* name, size_t size);
+
+void fill_record(size_t index, hid_device* handle, int driver, const unsigned char* matrix, calibration_record* record);
+int calibration_archive_update(const char* path, const calibration_record* records, size_t count);
+
+/* Matrix for a unit from an archive or a raw .bin file, 1 on success */
+int calibration_read(const char* path, size_t index, unsigned char* matrix);
+
+#endif
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "htt_util.h"
+#include "htt_coalesce.h"
+
+typedef struct
+{
+	unsigned char data[COALESCE_MAX_REPORT_SIZE];
+	uint8_t length;
+} coalesce_slot;
+
+typedef struct
+{
+	hid_device* handle;
+	uint32_t pending;  /* bit n set when slots[n] holds an unsent report */
+	coalesce_slot slots[COALESCE_MAX_REPORT_ID];
+	coalesce_stats stats;
+} coalesce_device;
+
+static coalesce_device* s_devices = NULL;
+static size_t s_device_count = 0;
+
+int coalesce_init(size_t device_count)
+{
+	coalesce_free();
+	if (!device_count)
+		return 1;
+	s_devices = (coalesce_device*)calloc(device_count, sizeof(coalesce_device));
+	if (!s_devices)
+		return 0;
+	s_device_count = device_count;
+	return 1;
+}
+
+void coalesce_free(void)
+{
+	free(s_devices);
+	s_devices = NULL;
+	s_device_count = 0;
+}
+
+int coalesce_submit(size_t device, hid_device* handle, const unsigned char* report, size_t length)
+{
+	if (device >= s_device_count || !handle || !length || length > COALESCE_MAX_REPORT_SIZE)
+		return 0;
+	uint8_t id = report[0];
+	if (id >= COALESCE_MAX_REPORT_ID)
+		return 0;
+
+	coalesce_device* dev = &s_devices[device];
+	/* A pending report on another handle belongs to a device that was
+	 * reopened since, send it where it was meant to go first. */
+	if (dev->pending && dev->handle != handle)
+		coalesce_flush(device);
+	dev->handle = handle;
+	dev->stats.submitted++;
+	if (dev->pending & (1u << id))
+		dev->stats.coalesced++;
+	memcpy(dev->slots[id].data, report, length);
+	dev->slots[id].length = (uint8_t)length;
+	dev->pending |= 1u << id;
+	return 1;
+}
+
+int coalesce_flush(size_t device)
+{
+	if (device >= s_device_count)
+		return 0;
+	coalesce_device* dev = &s_devices[device];
+	int ok = 1;
+	while (dev->pending)
+	{
+		/* lowest report ID first, keeps the order stable between runs */
+		uint32_t id = 0;
+		while (!(dev->pending & (1u << id)))
+			id++;
+		dev->pending &= ~(1u << id);
+		if (hid_send_feature_report(dev->handle, dev->slots[id].data, dev->slots[id].length) < 0)
+		{
+			htt_printf("Failed to send report %u to device %zu.\n", id, device);
+			dev->stats.failed++;
+			g_failures++;
+			ok = 0;
+		}
+		else
+		{
+			dev->stats.sent++;
+		}
+	}
+	return ok;
+}
+
+int coalesce_flush_all(void)
+{
+	int ok = 1;
+	for (size_t i = 0; i < s_device_count; i++)
+	{
+		if (s_devices[i].pending && !coalesce_flush(i))
+			ok = 0;
+	}
+	return ok;
+}
+
+int coalesce_pending(size_t device)
+{
+	if (device >= s_device_count)
+		return 0;
+	return s_devices[device].pending != 0;
+}
+
+void coalesce_get_stats(size_t device, coalesce_stats* stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	for (size_t i = 0; i < s_device_count; i++)
+	{
+		if (device != (size_t)-1 && device != i)
+			continue;
+		stats->submitted += s_devices[i].stats.submitted;
+		stats->coalesced += s_devices[i].stats.coalesced;
+		stats->sent += s_devices[i].stats.sent;
+		stats->failed += s_devices[i].stats.failed;
+	}
+}
+
+void coalesce_print_stats(void)
+{
+	for (size_t i = 0; i < s_device_count; i++)
+	{
+		const coalesce_stats* s = &s_devices[i].stats;
+		if (!s->submitted)
+			continue;
+		htt_printf("Device %zu volatile reports : %llu submitted, %llu coalesced, %llu sent, %llu failed\n", i,
+			(unsigned long long)s->submitted, (unsigned long long)s->coalesced,
+			(unsigned long long)s->sent, (unsigned long long)s->failed);
+	}
+}
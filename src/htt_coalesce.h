@@ -0,0 +1,42 @@
+#ifndef HTT_COALESCE_H
+#define HTT_COALESCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hidapi.h"
+
+/* Last-writer-wins queue for volatile feature reports.
+ *
+ * Volatile settings (backlight, fade without save) are not sent right away,
+ * they are parked in a slot per device and per report ID. A newer value for
+ * the same slot replaces the pending one, so a burst of updates turns into a
+ * single feature report once the queue is flushed. */
+
+#define COALESCE_MAX_REPORT_ID   32
+#define COALESCE_MAX_REPORT_SIZE 8
+
+typedef struct
+{
+	uint64_t submitted;  /* reports handed to coalesce_submit() */
+	uint64_t coalesced;  /* reports replaced before they were sent */
+	uint64_t sent;       /* reports that reached the device */
+	uint64_t failed;     /* reports the device rejected */
+} coalesce_stats;
+
+int  coalesce_init(size_t device_count);
+void coalesce_free(void);
+
+/* Queue a report, report[0] is the report ID. Returns 1 when queued. */
+int  coalesce_submit(size_t device, hid_device* handle, const unsigned char* report, size_t length);
+
+/* Send everything pending for one device / all devices. Returns 1 when all
+ * pending reports were sent successfully, 0 otherwise, every failed report
+ * counts in g_failures. */
+int  coalesce_flush(size_t device);
+int  coalesce_flush_all(void);
+int  coalesce_pending(size_t device);
+
+void coalesce_get_stats(size_t device, coalesce_stats* stats);
+void coalesce_print_stats(void);
+
+#endif
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include "htt_devindex.h"
+
+/* keyed by the selector string itself, "serial:1234" etc. */
+static std::unordered_map<std::string, size_t> s_index;
+/* units rebooting on --device all workers update the index concurrently */
+static std::mutex s_lock;
+
+static void add_keys(size_t index, const htt_identity* id)
+{
+	/* emplace keeps the first entry, multiple interfaces of one unit share
+	 * the serial and port and the lowest index is the one selected */
+	if (id->serial[0])
+		s_index.emplace(std::string("serial:") + id->serial, index);
+	if (id->path[0])
+		s_index.emplace(std::string("path:") + id->path, index);
+	if (id->port[0])
+		s_index.emplace(std::string("port:") + id->port, index);
+}
+
+static void remove_key(const char* prefix, const char* value, size_t index)
+{
+	if (!value[0])
+		return;
+	std::unordered_map<std::string, size_t>::iterator it = s_index.find(std::string(prefix) + value);
+	if (it != s_index.end() && it->second == index)
+		s_index.erase(it);
+}
+
+void device_index_build(const htt_identity* ids, size_t count)
+{
+	s_index.clear();
+	s_index.reserve(count * 3);
+	for (size_t i = 0; i < count; i++)
+		add_keys(i, &ids[i]);
+}
+
+void device_index_update(size_t index, const htt_identity* old_id, const htt_identity* new_id)
+{
+	std::lock_guard<std::mutex> guard(s_lock);
+	remove_key("serial:", old_id->serial, index);
+	remove_key("path:", old_id->path, index);
+	remove_key("port:", old_id->port, index);
+	add_keys(index, new_id);
+}
+
+void device_index_free(void)
+{
+	s_index.clear();
+}
+
+int device_index_lookup(const char* selector, size_t* index)
+{
+	if (strncmp(selector, "serial:", 7) != 0 &&
+		strncmp(selector, "path:", 5) != 0 &&
+		strncmp(selector, "port:", 5) != 0)
+		return -1;
+	std::lock_guard<std::mutex> guard(s_lock);
+	std::unordered_map<std::string, size_t>::const_iterator it = s_index.find(selector);
+	if (it == s_index.end())
+		return 0;
+	*index = it->second;
+	return 1;
+}
+
+void device_index_selector(const htt_identity* id, char* selector, size_t size)
+{
+	if (id->serial[0])
+		snprintf(selector, size, "serial:%s", id->serial);
+	else if (id->port[0])
+		snprintf(selector, size, "port:%s", id->port);
+	else
+		snprintf(selector, size, "path:%s", id->path);
+}
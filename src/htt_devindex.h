@@ -0,0 +1,24 @@
+#ifndef HTT_DEVINDEX_H
+#define HTT_DEVINDEX_H
+
+#include <stddef.h>
+#include "htt_hotplug.h"
+
+/* Index of the enumerated units by serial number, hidraw path and USB port.
+ * Built once from the identities gathered during enumeration, a selector is
+ * resolved with a single hash lookup without touching the devices.
+ *
+ * Selectors: serial:XXXX, path:/dev/hidrawN, port:1-2.3 */
+
+void device_index_build(const htt_identity* ids, size_t count);
+void device_index_update(size_t index, const htt_identity* old_id, const htt_identity* new_id);
+void device_index_free(void);
+
+/* Returns 1 and the device index when found, 0 when no unit matches and -1
+ * when the selector is not valid. */
+int device_index_lookup(const char* selector, size_t* index);
+
+/* Most stable selector for a unit: serial:, else port:, else path: */
+void device_index_selector(const htt_identity* id, char* selector, size_t size);
+
+#endif
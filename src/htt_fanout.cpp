@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "htt_util.h"
+#include "htt_devindex.h"
+#include "htt_fanout.h"
+#include "htt_coalesce.h"
+
+int g_jobs = FANOUT_DEFAULT_JOBS;
+
+static thread_local int t_worker = 0;
+
+int fanout_in_worker(void)
+{
+	return t_worker;
+}
+
+int fanout_is_selection(const char* arg)
+{
+	if (strcmp(arg, "all") == 0)
+		return 1;
+	if (strchr(arg, ','))
+		return 1;
+	/* a range, port:1-2.3 contains a dash as well */
+	return !strchr(arg, ':') && strchr(arg, '-');
+}
+
+static int parse_index(const char* str, const char* end, size_t* value)
+{
+	if (str == end)
+		return 0;
+	size_t v = 0;
+	for (const char* p = str; p < end; p++)
+	{
+		if (!isdigit((unsigned char)*p))
+			return 0;
+		v = v * 10 + (*p - '0');
+	}
+	*value = v;
+	return 1;
+}
+
+int fanout_parse_selection(const char* arg, size_t* indices, size_t max_indices)
+{
+	std::vector<char> selected(g_device_count, 0);
+	if (strcmp(arg, "all") == 0)
+	{
+		std::fill(selected.begin(), selected.end(), 1);
+	}
+	else
+	{
+		const char* p = arg;
+		while (*p)
+		{
+			const char* end = strchr(p, ',');
+			if (!end)
+				end = p + strlen(p);
+			std::string item(p, end);
+			size_t first, last;
+			const char* dash = strchr(item.c_str(), '-');
+			if (strchr(item.c_str(), ':'))
+			{
+				if (device_index_lookup(item.c_str(), &first) <= 0)
+				{
+					htt_printf("No HTT matches : %s\n", item.c_str());
+					return -1;
+				}
+				last = first;
+			}
+			else if (dash)
+			{
+				if (!parse_index(item.c_str(), dash, &first) ||
+					!parse_index(dash + 1, item.c_str() + item.size(), &last) || last < first)
+				{
+					htt_printf("Invalid device range : %s\n", item.c_str());
+					return -1;
+				}
+			}
+			else if (parse_index(item.c_str(), item.c_str() + item.size(), &first))
+			{
+				last = first;
+			}
+			else
+			{
+				htt_printf("Invalid device ID : %s\n", item.c_str());
+				return -1;
+			}
+			if (last >= g_device_count)
+			{
+				htt_printf("Invalid device ID : %zu\n", last);
+				return -1;
+			}
+			for (size_t i = first; i <= last; i++)
+				selected[i] = 1;
+			p = *end ? end + 1 : end;
+		}
+	}
+
+	size_t count = 0;
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		if (!selected[i])
+			continue;
+		if (count == max_indices)
+			return -1;
+		indices[count++] = i;
+	}
+	return (int)count;
+}
+
+size_t fanout_for_each(const size_t* indices, size_t count, fanout_job job, void* context, int* failed)
+{
+	if (!count)
+		return 0;
+
+	std::vector<std::string> output(count);
+	std::vector<char> done(count, 0);
+	std::vector<int> failures(count, 0);
+	std::atomic<size_t> next(0);
+	std::mutex lock;
+	std::condition_variable finished;
+
+	auto worker = [&]()
+	{
+		t_worker = 1;
+		g_batch = 1;
+		for (;;)
+		{
+			size_t n = next.fetch_add(1);
+			if (n >= count)
+				break;
+			g_currentDevice = indices[n];
+			g_failures = 0;
+			htt_capture_output(&output[n]);
+			job(indices[n], context);
+			htt_capture_output(NULL);
+			std::lock_guard<std::mutex> guard(lock);
+			failures[n] = g_failures;
+			done[n] = 1;
+			finished.notify_one();
+		}
+	};
+
+	size_t thread_count = g_jobs > 0 ? (size_t)g_jobs : 1;
+	if (thread_count > count)
+		thread_count = count;
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < thread_count; i++)
+		threads.push_back(std::thread(worker));
+
+	/* print in index order as soon as everything before is done */
+	size_t failed_units = 0;
+	for (size_t n = 0; n < count; n++)
+	{
+		std::unique_lock<std::mutex> guard(lock);
+		finished.wait(guard, [&]() { return done[n] != 0; });
+		guard.unlock();
+		fwrite(output[n].data(), 1, output[n].size(), stdout);
+		fflush(stdout);
+		std::string().swap(output[n]);
+		if (failures[n])
+			failed_units++;
+		if (failed)
+			failed[n] = failures[n] ? 1 : 0;
+		g_failures += failures[n];
+	}
+	for (size_t i = 0; i < threads.size(); i++)
+		threads[i].join();
+	return failed_units;
+}
+
+typedef struct
+{
+	char** argv;
+	size_t start;
+	size_t end;
+} fanout_command_context;
+
+static void run_tail(size_t index, void* context)
+{
+	fanout_command_context* ctx = (fanout_command_context*)context;
+	htt_printf("Device %zu:\n", index);
+	run_commands((int)ctx->end, ctx->argv, ctx->start);
+	/* volatile settings of this unit go out here, in parallel and before
+	 * its result, not one unit at a time once all are done */
+	coalesce_flush(index);
+	htt_printf("Device %zu : %s\n", index, g_failures ? "Failed." : "Success!");
+}
+
+int fanout_commands(const char* selection, char* argv[], size_t start, size_t end)
+{
+	std::vector<size_t> indices(g_device_count ? g_device_count : 1);
+	int count = fanout_parse_selection(selection, &indices[0], indices.size());
+	if (count <= 0)
+	{
+		if (count == 0)
+			htt_printf("No HTT detected\n");
+		g_failures++;
+		return 0;
+	}
+	fflush(stdout);
+	fanout_command_context ctx = { argv, start, end };
+	size_t failed = fanout_for_each(&indices[0], count, run_tail, &ctx, NULL);
+	htt_printf("%d devices, %zu failed.\n", count, failed);
+	return failed == 0;
+}
+
+void jobs(hid_device* device, char* argv[], int start_index)
+{
+	int count = atoi(argv[start_index + 1]);
+	if (count < 1)
+	{
+		htt_printf("Invalid job count : %s\n", argv[start_index + 1]);
+		g_failures++;
+		return;
+	}
+	g_jobs = count;
+}
@@ -0,0 +1,38 @@
+#ifndef HTT_FANOUT_H
+#define HTT_FANOUT_H
+
+#include <stddef.h>
+#include "hidapi.h"
+
+/* Runs work for several units at once on a bounded pool of threads.
+ *
+ * Every job runs with g_currentDevice set to its unit and its own failure
+ * count, its output is captured and printed in index order once the jobs
+ * before it are done, so the output reads the same as a serial run. */
+
+#define FANOUT_DEFAULT_JOBS 32
+
+extern int g_jobs;
+
+/* 1 when a --device argument selects more than one unit: all, 0,2,5-9 */
+int fanout_is_selection(const char* arg);
+
+/* Parses all / index lists / ranges / selectors separated by commas into
+ * ascending device indices. Returns the number of units, -1 on errors. */
+int fanout_parse_selection(const char* arg, size_t* indices, size_t max_indices);
+
+typedef void (*fanout_job)(size_t index, void* context);
+
+/* Runs job for every index, returns the number of units whose job failed
+ * (g_failures was raised). failed[] receives 1/0 per entry when given. */
+size_t fanout_for_each(const size_t* indices, size_t count, fanout_job job, void* context, int* failed);
+
+/* Runs argv[start..end) on every selected unit, used by --device all. */
+int fanout_commands(const char* selection, char* argv[], size_t start, size_t end);
+
+int fanout_in_worker(void);
+
+/* --jobs [count] */
+void jobs(hid_device* device, char* argv[], int start_index);
+
+#endif
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <signal.h>
+#include <string>
+#include <vector>
+#include "htt_util.h"
+#include "htt_fanout.h"
+#include "htt_calibration.h"
+#include "htt_touchreader.h"
+#include "htt_heatmap.h"
+
+static uint64_t cell_scale(int cells, int32_t min, int32_t max)
+{
+	uint64_t span = max > min ? (uint64_t)((int64_t)max - min) + 1 : 1;
+	return ((uint64_t)cells << 32) / span;
+}
+
+void heatmap_init(heatmap* map, int width, int height, const touch_layout* layout)
+{
+	memset(map, 0, sizeof(*map));
+	map->width = width;
+	map->height = height;
+	map->x_min = layout->x_min;
+	map->y_min = layout->y_min;
+	map->x_scale = cell_scale(width, layout->x_min, layout->x_max);
+	map->y_scale = cell_scale(height, layout->y_min, layout->y_max);
+}
+
+static int cell(int64_t offset, uint64_t scale, int cells)
+{
+	if (offset <= 0)
+		return 0;
+	uint64_t index = ((uint64_t)offset * scale) >> 32;
+	return index >= (uint64_t)cells ? cells - 1 : (int)index;
+}
+
+void heatmap_add(heatmap* map, int32_t x, int32_t y)
+{
+	int cx = cell((int64_t)x - map->x_min, map->x_scale, map->width);
+	int cy = cell((int64_t)y - map->y_min, map->y_scale, map->height);
+	map->cells[cy * map->width + cx]++;
+	map->points++;
+}
+
+/* Opens path.tmp, the caller renames it over path once it is complete */
+static FILE* open_temporary(const char* path, char* temporary, size_t size)
+{
+	snprintf(temporary, size, "%s.tmp", path);
+	return fopen(temporary, "wb");
+}
+
+static int finish(FILE* file, const char* temporary, const char* path)
+{
+	int ok = !ferror(file);
+	if (fclose(file) != 0)
+		ok = 0;
+	if (ok && rename(temporary, path) != 0)
+		ok = 0;
+	if (!ok)
+		remove(temporary);
+	return ok;
+}
+
+int heatmap_write_csv(const heatmap* map, const char* path)
+{
+	char temporary[1024];
+	FILE* file = open_temporary(path, temporary, sizeof(temporary));
+	if (!file)
+		return 0;
+	for (int y = 0; y < map->height; y++)
+	{
+		const uint64_t* row = &map->cells[y * map->width];
+		for (int x = 0; x < map->width; x++)
+			fprintf(file, x ? ",%llu" : "%llu", (unsigned long long)row[x]);
+		fputc('\n', file);
+	}
+	return finish(file, temporary, path);
+}
+
+int heatmap_write_pgm(const heatmap* map, const char* path)
+{
+	char temporary[1024];
+	FILE* file = open_temporary(path, temporary, sizeof(temporary));
+	if (!file)
+		return 0;
+	uint64_t most = 0;
+	int count = map->width * map->height;
+	for (int i = 0; i < count; i++)
+		if (map->cells[i] > most)
+			most = map->cells[i];
+	double scale = most ? 255.0 / log1p((double)most) : 0.0;
+	unsigned char pixels[HEATMAP_MAX_CELLS];
+	for (int i = 0; i < count; i++)
+		pixels[i] = (unsigned char)(log1p((double)map->cells[i]) * scale + 0.5);
+	fprintf(file, "P5\n# %llu touch points, brightest cell %llu, log scale\n%d %d\n255\n",
+		(unsigned long long)map->points, (unsigned long long)most, map->width, map->height);
+	fwrite(pixels, 1, count, file);
+	return finish(file, temporary, path);
+}
+
+static volatile sig_atomic_t g_heatmap_dump = 0;
+
+static void on_usr1(int signal)
+{
+	(void)signal;
+	g_heatmap_dump = 1;
+}
+
+typedef struct
+{
+	std::vector<heatmap> maps;
+	std::vector<int> active;
+	std::string prefix;
+	int pgm;
+	uint64_t interval_ns;
+	timer_node timer;
+	timer_wheel* wheel;
+} heatmap_state;
+
+static void on_frame(size_t device, const touch_frame* frame, uint64_t read_ns, void* context)
+{
+	(void)read_ns;
+	heatmap_state* state = (heatmap_state*)context;
+	heatmap* map = &state->maps[device];
+	for (int i = 0; i < frame->count; i++)
+		if (frame->contacts[i].tip)
+			heatmap_add(map, frame->contacts[i].x, frame->contacts[i].y);
+}
+
+static void dump(heatmap_state* state)
+{
+	int written = 0;
+	for (size_t i = 0; i < state->maps.size(); i++)
+	{
+		if (!state->active[i])
+			continue;
+		char key[64], path[1024];
+		if (!calibration_key(i, key, sizeof(key)))
+			snprintf(key, sizeof(key), "%zu", i);
+		for (char* c = key; *c; c++)
+			if (!isalnum((unsigned char)*c) && *c != '-')
+				*c = '_';
+		snprintf(path, sizeof(path), "%s-%s.%s", state->prefix.c_str(), key, state->pgm ? "pgm" : "csv");
+		int ok = state->pgm ? heatmap_write_pgm(&state->maps[i], path) : heatmap_write_csv(&state->maps[i], path);
+		if (ok)
+			written++;
+		else
+		{
+			htt_printf("Device %zu : writing %s failed\n", i, path);
+			g_failures++;
+		}
+	}
+	htt_printf("Heatmap : wrote %d files\n", written);
+	fflush(stdout);
+}
+
+static void on_interval(timer_node* timer, uint64_t now_ns)
+{
+	heatmap_state* state = (heatmap_state*)timer->context;
+	dump(state);
+	timerwheel_add(state->wheel, timer, now_ns + state->interval_ns);
+}
+
+static void on_wakeup(void* context)
+{
+	if (!g_heatmap_dump)
+		return;
+	g_heatmap_dump = 0;
+	dump((heatmap_state*)context);
+}
+
+void heatmap_monitor(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	int width = 0, height = 0, used = 0;
+	unsigned int seconds = 0;
+	char format[4] = "";
+	const char* spec = argv[start_index + 1];
+	int fields = sscanf(spec, "%dx%d,%u,%3[a-z]%n", &width, &height, &seconds, format, &used);
+	int pgm = !strcmp(format, "pgm");
+	/* per axis, width * height can overflow */
+	if (fields != 4 || width <= 0 || height <= 0 || width > HEATMAP_MAX_CELLS || height > HEATMAP_MAX_CELLS / width ||
+		!seconds || (!pgm && strcmp(format, "csv")) || (spec[used] && (spec[used] != ',' || !spec[used + 1])))
+	{
+		htt_printf("Invalid heatmap : %s, expected WxH,seconds,csv|pgm[,prefix] with at most %d cells\n", spec,
+			HEATMAP_MAX_CELLS);
+		g_failures++;
+		return;
+	}
+	if (fanout_in_worker())
+	{
+		htt_printf("--heatmap reads all units itself, it can't run per --device\n");
+		g_failures++;
+		return;
+	}
+	std::vector<size_t> indices(g_device_count);
+	for (size_t i = 0; i < g_device_count; i++)
+		indices[i] = i;
+	touch_reader* reader = touch_reader_open(g_device_count ? &indices[0] : NULL, g_device_count, &g_touch_filter,
+		&g_touch_transform);
+	if (!reader)
+	{
+		htt_printf("No HTT touch input to read\n");
+		g_failures++;
+		return;
+	}
+
+	heatmap_state state;
+	state.maps.resize(g_device_count);
+	state.active.assign(g_device_count, 0);
+	state.prefix = spec[used] ? spec + used + 1 : "heatmap";
+	state.pgm = pgm;
+	state.interval_ns = seconds * 1000000000ull;
+	state.wheel = touch_reader_wheel(reader);
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		const touch_layout* layout = touch_reader_layout(reader, i);
+		if (!layout)
+			continue;
+		heatmap_init(&state.maps[i], width, height, layout);
+		state.active[i] = 1;
+	}
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_usr1;
+	sigemptyset(&sa.sa_mask);
+	/* no SA_RESTART, the wait has to return to dump right away */
+	sigaction(SIGUSR1, &sa, NULL);
+	g_heatmap_dump = 0;
+
+	timer_init(&state.timer, on_interval, &state);
+	timerwheel_add(state.wheel, &state.timer, monotonic_ns() + state.interval_ns);
+	touch_reader_set_wakeup(reader, on_wakeup, &state);
+	htt_printf("Heatmap : %dx%d cells, written to %s-*.%s every %u s and on SIGUSR1, Ctrl+C to stop\n", width, height,
+		state.prefix.c_str(), pgm ? "pgm" : "csv", seconds);
+	fflush(stdout);
+	if (touch_reader_run(reader, 0, on_frame, &state) < 0)
+		g_failures++;
+	timerwheel_remove(state.wheel, &state.timer);
+	signal(SIGUSR1, SIG_DFL);
+	dump(&state);
+	for (size_t i = 0; i < g_device_count; i++)
+		if (state.active[i])
+			htt_printf("Device %zu : %llu touch points\n", i, (unsigned long long)state.maps[i].points);
+	touch_reader_close(reader);
+}
@@ -0,0 +1,44 @@
+#ifndef HTT_HEATMAP_H
+#define HTT_HEATMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hidapi.h"
+#include "htt_touch.h"
+
+/* Where the screen of every unit gets touched (Linux only).
+ *
+ * Every decoded touch point is counted in a fixed grid of cells spanning
+ * the touch range of the unit. Binning is a multiply and a shift per axis,
+ * the grid is allocated once, so it can run for months. */
+
+#define HEATMAP_MAX_CELLS 4096
+
+typedef struct
+{
+	int width;
+	int height;
+	int32_t x_min;
+	int32_t y_min;
+	uint64_t x_scale;        /* cells per touch unit, 32.32 fixed point */
+	uint64_t y_scale;
+	uint64_t points;
+	uint64_t cells[HEATMAP_MAX_CELLS];
+} heatmap;
+
+/* width * height must not exceed HEATMAP_MAX_CELLS, the caller checks */
+void heatmap_init(heatmap* map, int width, int height, const touch_layout* layout);
+void heatmap_add(heatmap* map, int32_t x, int32_t y);
+
+/* Writes the grid as CSV (one row per line) or as a binary PGM image, the
+ * brightness of a cell growing with the log of its count so rarely touched
+ * cells still show. The file is replaced atomically. Returns 0 on errors. */
+int heatmap_write_csv(const heatmap* map, const char* path);
+int heatmap_write_pgm(const heatmap* map, const char* path);
+
+/* --heatmap WxH,seconds,csv|pgm[,prefix] counts the touches of every unit
+ * until Ctrl+C, writing [prefix]-[serial].csv/.pgm every interval and on
+ * SIGUSR1. */
+void heatmap_monitor(hid_device* device, char* argv[], int start_index);
+
+#endif
@@ -0,0 +1,140 @@
+#include <string.h>
+#include "htt_util.h"
+#include "htt_histogram.h"
+
+static int highest_bit(uint64_t value)
+{
+#ifdef __GNUC__
+	return 63 - __builtin_clzll(value);
+#else
+	int bit = 0;
+	while (value >>= 1)
+		bit++;
+	return bit;
+#endif
+}
+
+static size_t bucket_of(uint64_t value)
+{
+	if (value < HISTOGRAM_SUB)
+		return (size_t)value;
+	int bit = highest_bit(value);
+	int shift = bit - HISTOGRAM_SUB_BITS;
+	return (size_t)(shift + 1) * HISTOGRAM_SUB + ((value >> shift) & (HISTOGRAM_SUB - 1));
+}
+
+/* Smallest value that lands in a bucket. */
+static uint64_t bucket_low(size_t bucket)
+{
+	if (bucket < HISTOGRAM_SUB)
+		return bucket;
+	int shift = (int)(bucket / HISTOGRAM_SUB) - 1;
+	return ((uint64_t)HISTOGRAM_SUB + bucket % HISTOGRAM_SUB) << shift;
+}
+
+void histogram_reset(htt_histogram* h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+void histogram_add(htt_histogram* h, uint64_t value)
+{
+	if (!h->count || value < h->min)
+		h->min = value;
+	if (value > h->max)
+		h->max = value;
+	h->count++;
+	h->sum += (double)value;
+	h->buckets[bucket_of(value)]++;
+}
+
+void histogram_merge(htt_histogram* into, const htt_histogram* from)
+{
+	if (!from->count)
+		return;
+	if (!into->count || from->min < into->min)
+		into->min = from->min;
+	if (from->max > into->max)
+		into->max = from->max;
+	into->count += from->count;
+	into->sum += from->sum;
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+		into->buckets[i] += from->buckets[i];
+}
+
+uint64_t histogram_percentile(const htt_histogram* h, double percentile)
+{
+	if (!h->count)
+		return 0;
+	uint64_t rank = (uint64_t)(percentile / 100.0 * (double)h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank >= h->count)
+		return h->max;
+	uint64_t seen = 0;
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		seen += h->buckets[i];
+		if (seen >= rank)
+		{
+			/* middle of the bucket, kept inside what was actually seen */
+			if (i + 1 == HISTOGRAM_BUCKETS)
+				return h->max;
+			uint64_t low = bucket_low(i);
+			uint64_t value = low + (bucket_low(i + 1) - low) / 2;
+			if (value < h->min)
+				value = h->min;
+			if (value > h->max)
+				value = h->max;
+			return value;
+		}
+	}
+	return h->max;
+}
+
+double histogram_mean(const htt_histogram* h)
+{
+	return h->count ? h->sum / (double)h->count : 0;
+}
+
+void histogram_print(const htt_histogram* h, const char* label, double scale, const char* unit)
+{
+	if (!h->count)
+	{
+		htt_printf("%s : none\n", label);
+		return;
+	}
+	htt_printf("%s : n=%llu min %.3f p50 %.3f p90 %.3f p99 %.3f p99.9 %.3f max %.3f mean %.3f %s\n", label,
+		(unsigned long long)h->count, h->min / scale,
+		histogram_percentile(h, 50) / scale, histogram_percentile(h, 90) / scale,
+		histogram_percentile(h, 99) / scale, histogram_percentile(h, 99.9) / scale,
+		h->max / scale, histogram_mean(h) / scale, unit);
+}
+
+void histogram_print_bars(const htt_histogram* h, double scale, const char* unit)
+{
+	uint64_t ranges[65] = { 0 };
+	uint64_t most = 0;
+	for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+	{
+		if (!h->buckets[i])
+			continue;
+		uint64_t low = bucket_low(i);
+		int range = low ? highest_bit(low) + 1 : 0;
+		ranges[range] += h->buckets[i];
+		if (ranges[range] > most)
+			most = ranges[range];
+	}
+	for (int range = 0; range < 65; range++)
+	{
+		if (!ranges[range])
+			continue;
+		char bar[41];
+		int width = (int)(ranges[range] * 40 / most);
+		memset(bar, '#', width);
+		bar[width] = 0;
+		double low = range ? (double)(1ull << (range - 1)) : 0;
+		htt_printf("  %10.3f - %10.3f %s : %10llu %s\n", low / scale, (range ? (double)(1ull << (range - 1)) * 2 : 1) / scale, unit,
+			(unsigned long long)ranges[range], bar);
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef HTT_HISTOGRAM_H
+#define HTT_HISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Fixed size log-linear histogram for latencies and intervals.
+ *
+ * Values below 32 get a bucket each, above that every power of two is split
+ * into 32 buckets, so any percentile is within about 3% of the real value no
+ * matter how long it runs. Adding a value is a few instructions and memory
+ * stays constant, it can sit on a hot path for months. */
+
+#define HISTOGRAM_SUB_BITS 5
+#define HISTOGRAM_SUB      (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS  ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB)
+
+typedef struct
+{
+	uint64_t count;
+	uint64_t min;
+	uint64_t max;
+	double sum;
+	uint64_t buckets[HISTOGRAM_BUCKETS];
+} htt_histogram;
+
+void histogram_reset(htt_histogram* h);
+void histogram_add(htt_histogram* h, uint64_t value);
+void histogram_merge(htt_histogram* into, const htt_histogram* from);
+
+/* Value at a percentile (0-100), 0 when empty. */
+uint64_t histogram_percentile(const htt_histogram* h, double percentile);
+double histogram_mean(const htt_histogram* h);
+
+/* One line: count, min, p50, p90, p99, p99.9, max and mean, values divided
+ * by scale and printed with unit, e.g. 1e6 and "ms" for nanoseconds. */
+void histogram_print(const htt_histogram* h, const char* label, double scale, const char* unit);
+
+/* Counts per power of two range with a bar each. */
+void histogram_print_bars(const htt_histogram* h, double scale, const char* unit);
+
+#endif
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include "htt_util.h"
+#include "htt_hotplug.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <poll.h>
+	#include <time.h>
+	#include <sys/stat.h>
+	#include <libudev.h>
+#endif
+
+static unsigned long long now_ms(void)
+{
+#ifdef _WIN32
+	return GetTickCount64();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+#endif
+}
+
+static int identity_matches(const htt_identity* a, const htt_identity* b)
+{
+	if (a->interface_number != b->interface_number)
+		return 0;
+	/* the serial number is the better key, the port is the fallback for
+	 * units that do not report one */
+	if (a->serial[0] && b->serial[0])
+		return strcmp(a->serial, b->serial) == 0;
+	if (a->port[0] && b->port[0])
+		return strcmp(a->port, b->port) == 0;
+	return 0;
+}
+
+#ifndef _WIN32
+
+struct hotplug_monitor
+{
+	struct udev* udev;
+	struct udev_monitor* monitor;
+};
+
+/* Fills port and interface_number from the udev parents of a hidraw node. */
+static void identity_from_udev(struct udev_device* raw_dev, htt_identity* id)
+{
+	struct udev_device* usb_dev = udev_device_get_parent_with_subsystem_devtype(raw_dev, "usb", "usb_device");
+	if (usb_dev)
+	{
+		const char* name = udev_device_get_sysname(usb_dev);
+		if (name)
+			snprintf(id->port, sizeof(id->port), "%s", name);
+		const char* serial = udev_device_get_sysattr_value(usb_dev, "serial");
+		if (serial && !id->serial[0])
+			snprintf(id->serial, sizeof(id->serial), "%s", serial);
+	}
+	struct udev_device* intf_dev = udev_device_get_parent_with_subsystem_devtype(raw_dev, "usb", "usb_interface");
+	if (intf_dev)
+	{
+		const char* str = udev_device_get_sysattr_value(intf_dev, "bInterfaceNumber");
+		if (str)
+			id->interface_number = strtol(str, NULL, 16);
+	}
+}
+
+void hotplug_identity(const struct hid_device_info* info, htt_identity* id)
+{
+	memset(id, 0, sizeof(*id));
+	id->interface_number = info->interface_number;
+	if (info->path)
+		snprintf(id->path, sizeof(id->path), "%s", info->path);
+	if (info->serial_number)
+		wcstombs(id->serial, info->serial_number, sizeof(id->serial) - 1);
+
+	struct stat s;
+	if (!info->path || stat(info->path, &s) != 0)
+		return;
+	struct udev* udev = udev_new();
+	if (!udev)
+		return;
+	struct udev_device* raw_dev = udev_device_new_from_devnum(udev, 'c', s.st_rdev);
+	if (raw_dev)
+	{
+		identity_from_udev(raw_dev, id);
+		udev_device_unref(raw_dev);
+	}
+	udev_unref(udev);
+}
+
+hotplug_monitor* hotplug_arm(void)
+{
+	hotplug_monitor* mon = (hotplug_monitor*)calloc(1, sizeof(hotplug_monitor));
+	if (!mon)
+		return NULL;
+	mon->udev = udev_new();
+	if (mon->udev)
+	{
+		/* "udev" rather than "kernel" events, the node is only usable once
+		 * the udev rules have set its permissions */
+		mon->monitor = udev_monitor_new_from_netlink(mon->udev, "udev");
+		if (mon->monitor)
+		{
+			udev_monitor_filter_add_match_subsystem_devtype(mon->monitor, "hidraw", NULL);
+			udev_monitor_enable_receiving(mon->monitor);
+		}
+	}
+	if (!mon->monitor)
+	{
+		htt_printf("Can't create udev monitor\n");
+		hotplug_disarm(mon);
+		return NULL;
+	}
+	return mon;
+}
+
+void hotplug_disarm(hotplug_monitor* mon)
+{
+	if (!mon)
+		return;
+	if (mon->monitor)
+		udev_monitor_unref(mon->monitor);
+	if (mon->udev)
+		udev_unref(mon->udev);
+	free(mon);
+}
+
+int hotplug_wait(hotplug_monitor* mon, htt_identity* id, int timeout_ms)
+{
+	if (!mon)
+		return -1;
+	unsigned long long start = now_ms();
+	unsigned long long deadline = start + timeout_ms;
+	int fd = udev_monitor_get_fd(mon->monitor);
+	int found = 0;
+
+	while (!found)
+	{
+		unsigned long long now = now_ms();
+		if (now >= deadline)
+			break;
+		struct pollfd fds;
+		fds.fd = fd;
+		fds.events = POLLIN;
+		fds.revents = 0;
+		if (poll(&fds, 1, (int)(deadline - now)) <= 0)
+			continue;
+
+		struct udev_device* dev = udev_monitor_receive_device(mon->monitor);
+		if (!dev)
+			continue;
+		const char* action = udev_device_get_action(dev);
+		const char* node = udev_device_get_devnode(dev);
+		if (action && node && strcmp(action, "add") == 0)
+		{
+			htt_identity candidate;
+			memset(&candidate, 0, sizeof(candidate));
+			candidate.interface_number = -1;
+			identity_from_udev(dev, &candidate);
+			if (identity_matches(id, &candidate))
+			{
+				snprintf(id->path, sizeof(id->path), "%s", node);
+				found = 1;
+			}
+		}
+		udev_device_unref(dev);
+	}
+	hotplug_disarm(mon);
+	return found ? (int)(now_ms() - start) : -1;
+}
+
+#else
+
+/* No udev on Windows, the enumeration is polled instead. The unit has to
+ * disappear first, its path may well be the same once it is back. */
+struct hotplug_monitor
+{
+	int unused;
+};
+
+void hotplug_identity(const struct hid_device_info* info, htt_identity* id)
+{
+	memset(id, 0, sizeof(*id));
+	id->interface_number = info->interface_number;
+	if (info->path)
+		snprintf(id->path, sizeof(id->path), "%s", info->path);
+	if (info->serial_number)
+		wcstombs(id->serial, info->serial_number, sizeof(id->serial) - 1);
+}
+
+hotplug_monitor* hotplug_arm(void)
+{
+	return (hotplug_monitor*)calloc(1, sizeof(hotplug_monitor));
+}
+
+void hotplug_disarm(hotplug_monitor* mon)
+{
+	free(mon);
+}
+
+int hotplug_wait(hotplug_monitor* mon, htt_identity* id, int timeout_ms)
+{
+	if (!mon)
+		return -1;
+	unsigned long long start = now_ms();
+	unsigned long long deadline = start + timeout_ms;
+	int gone = 0;
+	int found = 0;
+	while (!found && now_ms() < deadline)
+	{
+		int present = 0;
+		struct hid_device_info* devs = hid_enumerate(HTT_VENDOR_ID, HTT_PRODUCT_ID);
+		for (struct hid_device_info* cur = devs; cur; cur = cur->next)
+		{
+			htt_identity candidate;
+			hotplug_identity(cur, &candidate);
+			if (identity_matches(id, &candidate))
+			{
+				present = 1;
+				if (gone)
+				{
+					snprintf(id->path, sizeof(id->path), "%s", candidate.path);
+					found = 1;
+				}
+				break;
+			}
+		}
+		hid_free_enumeration(devs);
+		if (!present)
+			gone = 1;
+		if (!found)
+			Sleep(100);
+	}
+	hotplug_disarm(mon);
+	return found ? (int)(now_ms() - start) : -1;
+}
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef HTT_HOTPLUG_H
+#define HTT_HOTPLUG_H
+
+#include <stddef.h>
+#include "hidapi.h"
+
+/* What makes an HTT the same physical unit across a reboot, a reboot gives
+ * it a new hidraw node but keeps its serial number and USB port. */
+typedef struct
+{
+	char path[256];    /* node it was opened from */
+	char serial[64];   /* USB serial number, empty when unknown */
+	char port[32];     /* USB port path (sysfs name of the usb device, e.g. 1-2.3) */
+	int interface_number;
+	int driver;        /* get_driver() when enumerated, -1 when it failed */
+	int fwrev;         /* get_fwrev() when enumerated */
+} htt_identity;
+
+typedef struct hotplug_monitor hotplug_monitor;
+
+void hotplug_identity(const struct hid_device_info* info, htt_identity* id);
+
+/* Start watching for devices being added. This has to be done before the
+ * command that reboots the unit is sent, so the add event can't be missed. */
+hotplug_monitor* hotplug_arm(void);
+void hotplug_disarm(hotplug_monitor* monitor);
+
+/* Waits until the unit described by id is back, the new node is written
+ * to path. Returns the milliseconds it took, -1 on timeout. The monitor is
+ * released in both cases. */
+int hotplug_wait(hotplug_monitor* monitor, htt_identity* id, int timeout_ms);
+
+#endif
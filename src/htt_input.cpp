@@ -0,0 +1,213 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "htt_util.h"
+#include "htt_input.h"
+
+#define INPUT_MAX_EVENTS 64
+#define TIMER_TAG ((uint64_t)-1)
+
+volatile sig_atomic_t g_input_stop = 0;
+
+struct htt_input
+{
+	int epoll_fd;
+	int timer_fd;
+	size_t count;      /* units watched */
+	int* fds;          /* per device index, -1 when not watched */
+	uint64_t deadline; /* what the timerfd is armed for */
+	unsigned char buffer[INPUT_REPORT_MAX];
+	struct epoll_event events[INPUT_MAX_EVENTS];
+};
+
+static void on_stop_signal(int sig)
+{
+	(void)sig;
+	g_input_stop = 1;
+}
+
+void input_catch_signals(void)
+{
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_stop_signal;
+	sigemptyset(&sa.sa_mask);
+	/* no SA_RESTART, epoll_wait has to return so the loop sees the flag */
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	g_input_stop = 0;
+}
+
+uint64_t monotonic_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+htt_input* input_open(const size_t* indices, size_t count)
+{
+	htt_input* input = (htt_input*)calloc(1, sizeof(htt_input));
+	if (!input)
+		return NULL;
+	input->fds = (int*)malloc(g_device_count * sizeof(int));
+	input->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	input->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	input->deadline = UINT64_MAX;
+	if (!input->fds || input->epoll_fd < 0 || input->timer_fd < 0)
+	{
+		htt_printf("Input   : %s\n", strerror(errno));
+		input_close(input);
+		return NULL;
+	}
+	for (size_t i = 0; i < g_device_count; i++)
+		input->fds[i] = -1;
+
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.u64 = TIMER_TAG;
+	epoll_ctl(input->epoll_fd, EPOLL_CTL_ADD, input->timer_fd, &ev);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		size_t index = indices[i];
+		if (index >= g_device_count || input->fds[index] >= 0)
+			continue;
+		int fd = open(g_identities[index].path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+		if (fd < 0)
+		{
+			htt_printf("Device %zu : can't open %s for input, %s\n", index, g_identities[index].path, strerror(errno));
+			continue;
+		}
+		ev.events = EPOLLIN;
+		ev.data.u64 = index;
+		if (epoll_ctl(input->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)
+		{
+			close(fd);
+			continue;
+		}
+		input->fds[index] = fd;
+		input->count++;
+	}
+	if (!input->count)
+	{
+		input_close(input);
+		return NULL;
+	}
+	return input;
+}
+
+void input_close(htt_input* input)
+{
+	if (!input)
+		return;
+	if (input->fds)
+	{
+		for (size_t i = 0; i < g_device_count; i++)
+		{
+			if (input->fds[i] >= 0)
+				close(input->fds[i]);
+		}
+		free(input->fds);
+	}
+	if (input->timer_fd >= 0)
+		close(input->timer_fd);
+	if (input->epoll_fd >= 0)
+		close(input->epoll_fd);
+	free(input);
+}
+
+size_t input_device_count(const htt_input* input)
+{
+	return input->count;
+}
+
+int input_device_fd(const htt_input* input, size_t device)
+{
+	return device < g_device_count ? input->fds[device] : -1;
+}
+
+void input_set_timer(htt_input* input, uint64_t deadline_ns)
+{
+	if (deadline_ns == input->deadline)
+		return;
+	input->deadline = deadline_ns;
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	if (deadline_ns != UINT64_MAX)
+	{
+		/* an all zero it_value disarms, a deadline of 0 still has to fire */
+		its.it_value.tv_sec = deadline_ns / 1000000000ull;
+		its.it_value.tv_nsec = deadline_ns % 1000000000ull;
+		if (!its.it_value.tv_sec && !its.it_value.tv_nsec)
+			its.it_value.tv_nsec = 1;
+	}
+	timerfd_settime(input->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+static void remove_device(htt_input* input, size_t device, const input_callbacks* callbacks)
+{
+	epoll_ctl(input->epoll_fd, EPOLL_CTL_DEL, input->fds[device], NULL);
+	close(input->fds[device]);
+	input->fds[device] = -1;
+	input->count--;
+	if (callbacks->removed)
+		callbacks->removed(device, callbacks->context);
+}
+
+int input_dispatch(htt_input* input, int timeout_ms, const input_callbacks* callbacks)
+{
+	int ready = epoll_wait(input->epoll_fd, input->events, INPUT_MAX_EVENTS, timeout_ms);
+	if (ready < 0)
+		return errno == EINTR ? 0 : -1;
+
+	int reports = 0;
+	for (int e = 0; e < ready; e++)
+	{
+		uint64_t tag = input->events[e].data.u64;
+		if (tag == TIMER_TAG)
+		{
+			uint64_t expirations;
+			if (read(input->timer_fd, &expirations, sizeof(expirations)) > 0)
+			{
+				input->deadline = UINT64_MAX;
+				if (callbacks->timer)
+					callbacks->timer(monotonic_ns(), callbacks->context);
+			}
+			continue;
+		}
+
+		size_t device = (size_t)tag;
+		if (input->fds[device] < 0)
+			continue;
+		int drained = 0;
+		for (;;)
+		{
+			ssize_t length = read(input->fds[device], input->buffer, sizeof(input->buffer));
+			if (length > 0)
+			{
+				drained++;
+				if (callbacks->report)
+					callbacks->report(device, input->buffer, (int)length, monotonic_ns(), callbacks->context);
+				continue;
+			}
+			if (length < 0 && (errno == EAGAIN || errno == EINTR))
+			{
+				if (callbacks->drained)
+					callbacks->drained(device, drained, callbacks->context);
+				break;
+			}
+			/* 0 or an error like ENODEV, the node is gone */
+			remove_device(input, device, callbacks);
+			break;
+		}
+		reports += drained;
+	}
+	return reports;
+}
@@ -0,0 +1,63 @@
+#ifndef HTT_INPUT_H
+#define HTT_INPUT_H
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Input reports of many units on one thread (Linux only).
+ *
+ * Every unit's hidraw node is opened a second time, read only and non
+ * blocking, next to the hidapi handle used for the feature reports. hidraw
+ * hands every reader its own copy of each input report, so watching the
+ * reports takes nothing away from the kernel touch driver. One epoll set
+ * watches all nodes plus a timerfd, the resident modes run their timer wheel
+ * off that timerfd. */
+
+#define INPUT_REPORT_MAX 256
+
+/* reports hidraw keeps per reader, older ones are dropped when it is full */
+#define INPUT_KERNEL_QUEUE 64
+
+typedef struct htt_input htt_input;
+
+typedef struct
+{
+	/* one input report, timestamp_ns is CLOCK_MONOTONIC taken at read() */
+	void (*report)(size_t device, const unsigned char* data, int length, uint64_t timestamp_ns, void* context);
+	/* the timerfd deadline passed */
+	void (*timer)(uint64_t now_ns, void* context);
+	/* the node went away (unplugged, rebooted), no more reports for device */
+	void (*removed)(size_t device, void* context);
+	/* a node was read dry, count reports were waiting in its queue */
+	void (*drained)(size_t device, int count, void* context);
+	void* context;
+} input_callbacks;
+
+/* Set by SIGINT / SIGTERM once input_catch_signals() was called. */
+extern volatile sig_atomic_t g_input_stop;
+
+void input_catch_signals(void);
+
+uint64_t monotonic_ns(void);
+
+/* Opens the nodes of the given device indices, units that can't be opened
+ * are reported and left out. NULL when none could be opened. */
+htt_input* input_open(const size_t* indices, size_t count);
+void input_close(htt_input* input);
+
+size_t input_device_count(const htt_input* input);
+
+/* Raw fd of the node of a device, -1 when it isn't watched. */
+int input_device_fd(const htt_input* input, size_t device);
+
+/* Arms the timerfd for an absolute CLOCK_MONOTONIC time, UINT64_MAX
+ * disarms it. */
+void input_set_timer(htt_input* input, uint64_t deadline_ns);
+
+/* Waits up to timeout_ms (-1 forever) and dispatches everything that is
+ * ready, reading each node until it runs dry. Returns the number of
+ * reports dispatched, 0 when interrupted by a signal, -1 on errors. */
+int input_dispatch(htt_input* input, int timeout_ms, const input_callbacks* callbacks);
+
+#endif
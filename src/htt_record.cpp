@@ -0,0 +1,727 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <linux/hidraw.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include "htt_util.h"
+#include "htt_fanout.h"
+#include "htt_input.h"
+#include "htt_touch.h"
+#include "htt_record.h"
+
+static const char record_magic[8] = { 'H', 'T', 'T', 'R', 'E', 'C', '1', 0 };
+
+/* a record never takes more than this: tag, delta, length and a whole report */
+#define RECORD_MAX_BYTES (3 * 10 + INPUT_REPORT_MAX)
+
+static size_t put_varint(unsigned char* p, uint64_t value)
+{
+	size_t used = 0;
+	while (value >= 0x80)
+	{
+		p[used++] = (unsigned char)(value | 0x80);
+		value >>= 7;
+	}
+	p[used++] = (unsigned char)value;
+	return used;
+}
+
+/* 0 when the varint runs past end */
+static int get_varint(const unsigned char** p, const unsigned char* end, uint64_t* value)
+{
+	uint64_t result = 0;
+	for (int shift = 0; shift < 64 && *p < end; shift += 7)
+	{
+		unsigned char byte = *(*p)++;
+		result |= (uint64_t)(byte & 0x7f) << shift;
+		if (!(byte & 0x80))
+		{
+			*value = result;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void segment_name(const char* path, unsigned int segment, char* name, size_t size)
+{
+	snprintf(name, size, "%s.%04u", path, segment);
+}
+
+/* Writing */
+
+typedef struct
+{
+	unsigned char* data;
+	size_t used;
+	int new_segment;
+	unsigned int segment;
+} record_buffer;
+
+typedef struct
+{
+	unsigned char last[INPUT_REPORT_MAX];
+	int length;           /* 0 until the first report of the segment */
+	uint64_t reports;
+} record_device;
+
+typedef struct
+{
+	std::string path;
+	std::vector<std::string> serials;
+	std::vector<std::vector<unsigned char> > descriptors;
+	std::vector<record_device> devices;
+
+	/* read thread */
+	record_buffer* current;
+	int need_header;
+	unsigned int segment;
+	uint64_t segment_bytes;
+	uint64_t last_ns;
+	uint64_t next_flush_ns;
+	uint64_t raw_bytes;
+	uint64_t encoded_bytes;
+	uint64_t dropped;
+
+	/* shared with the writer */
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<record_buffer*> full;
+	std::vector<record_buffer*> free_buffers;
+	int stop;
+	std::atomic<int> write_error;
+	std::atomic<unsigned int> segments_written;
+} recorder;
+
+static void writer_thread(recorder* rec)
+{
+	int fd = -1;
+	for (;;)
+	{
+		record_buffer* buffer;
+		{
+			std::unique_lock<std::mutex> guard(rec->lock);
+			rec->wake.wait(guard, [rec] { return rec->stop || !rec->full.empty(); });
+			if (rec->full.empty())
+				break;
+			buffer = rec->full.front();
+			rec->full.pop_front();
+		}
+		if (buffer->new_segment && !rec->write_error)
+		{
+			char name[1024];
+			if (fd >= 0)
+				close(fd);
+			segment_name(rec->path.c_str(), buffer->segment, name, sizeof(name));
+			fd = open(name, O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+			if (fd < 0)
+				rec->write_error = errno;
+			else
+				rec->segments_written++;
+		}
+		size_t done = 0;
+		while (done < buffer->used && fd >= 0 && !rec->write_error)
+		{
+			ssize_t written = write(fd, buffer->data + done, buffer->used - done);
+			if (written < 0 && errno == EINTR)
+				continue;
+			if (written <= 0)
+			{
+				rec->write_error = written < 0 ? errno : EIO;
+				break;
+			}
+			done += written;
+		}
+		buffer->used = 0;
+		buffer->new_segment = 0;
+		std::lock_guard<std::mutex> guard(rec->lock);
+		rec->free_buffers.push_back(buffer);
+	}
+	if (fd >= 0)
+		close(fd);
+}
+
+static void submit(recorder* rec)
+{
+	if (!rec->current)
+		return;
+	{
+		std::lock_guard<std::mutex> guard(rec->lock);
+		rec->full.push_back(rec->current);
+	}
+	rec->wake.notify_one();
+	rec->current = NULL;
+}
+
+static void write_header(recorder* rec, uint64_t now_ns)
+{
+	record_buffer* buffer = rec->current;
+	unsigned char* p = buffer->data;
+	struct timespec realtime;
+	clock_gettime(CLOCK_REALTIME, &realtime);
+	memcpy(p, record_magic, sizeof(record_magic));
+	p += sizeof(record_magic);
+	p += put_varint(p, rec->segment);
+	p += put_varint(p, now_ns);
+	p += put_varint(p, (uint64_t)realtime.tv_sec * 1000000000ull + realtime.tv_nsec);
+	p += put_varint(p, rec->devices.size());
+	for (size_t i = 0; i < rec->devices.size(); i++)
+	{
+		p += put_varint(p, rec->serials[i].size());
+		memcpy(p, rec->serials[i].data(), rec->serials[i].size());
+		p += rec->serials[i].size();
+		p += put_varint(p, rec->descriptors[i].size());
+		if (!rec->descriptors[i].empty())
+			memcpy(p, &rec->descriptors[i][0], rec->descriptors[i].size());
+		p += rec->descriptors[i].size();
+		rec->devices[i].length = 0;
+	}
+	buffer->used = p - buffer->data;
+	buffer->new_segment = 1;
+	buffer->segment = rec->segment;
+	rec->segment_bytes = buffer->used;
+	rec->last_ns = now_ns;
+	rec->need_header = 0;
+}
+
+/* Makes sure there is room for one more record, starting a new segment
+ * when the current one is full. 0 when the writer can't keep up. */
+static int reserve(recorder* rec, uint64_t now_ns)
+{
+	if (rec->segment_bytes + RECORD_MAX_BYTES > RECORD_SEGMENT_BYTES && !rec->need_header)
+	{
+		submit(rec);
+		rec->segment++;
+		rec->need_header = 1;
+	}
+	if (rec->current && rec->current->used + RECORD_MAX_BYTES > RECORD_BUFFER_BYTES)
+		submit(rec);
+	if (!rec->current)
+	{
+		std::lock_guard<std::mutex> guard(rec->lock);
+		if (rec->free_buffers.empty())
+			return 0;
+		rec->current = rec->free_buffers.back();
+		rec->free_buffers.pop_back();
+	}
+	if (rec->need_header)
+		write_header(rec, now_ns);
+	return 1;
+}
+
+static size_t encode_report(recorder* rec, size_t index, const unsigned char* data, int length, uint64_t delta,
+	unsigned char* out)
+{
+	record_device* device = &rec->devices[index];
+	unsigned char* p = out;
+	if (device->length == length)
+	{
+		/* runs of bytes that differ from the previous report */
+		unsigned char runs[INPUT_REPORT_MAX * 3];
+		size_t used = 0, count = 0;
+		int i = 0;
+		while (i < length)
+		{
+			int skip = 0;
+			while (i + skip < length && data[i + skip] == device->last[i + skip])
+				skip++;
+			if (i + skip == length)
+				break;
+			int start = i + skip, end = start;
+			while (end < length && data[end] != device->last[end])
+				end++;
+			used += put_varint(runs + used, skip);
+			used += put_varint(runs + used, end - start);
+			memcpy(runs + used, data + start, end - start);
+			used += end - start;
+			count++;
+			i = end;
+		}
+		unsigned char head[10];
+		size_t head_bytes = put_varint(head, count);
+		if (head_bytes + used < (size_t)length + 2)
+		{
+			p += put_varint(p, index << 2 | RECORD_DELTA);
+			p += put_varint(p, delta);
+			memcpy(p, head, head_bytes);
+			p += head_bytes;
+			memcpy(p, runs, used);
+			return p + used - out;
+		}
+	}
+	p += put_varint(p, index << 2 | RECORD_FULL);
+	p += put_varint(p, delta);
+	p += put_varint(p, length);
+	memcpy(p, data, length);
+	return p + length - out;
+}
+
+static void on_report(size_t index, const unsigned char* data, int length, uint64_t timestamp_ns, void* context)
+{
+	recorder* rec = (recorder*)context;
+	if (length <= 0 || length > INPUT_REPORT_MAX)
+		return;
+	if (!reserve(rec, timestamp_ns))
+	{
+		rec->dropped++;
+		return;
+	}
+	if (timestamp_ns < rec->last_ns)
+		timestamp_ns = rec->last_ns;
+	record_buffer* buffer = rec->current;
+	size_t used = encode_report(rec, index, data, length, timestamp_ns - rec->last_ns, buffer->data + buffer->used);
+	buffer->used += used;
+	rec->segment_bytes += used;
+	rec->encoded_bytes += used;
+	/* what the same report takes as timestamp, device and report */
+	rec->raw_bytes += 8 + 1 + length;
+	rec->last_ns = timestamp_ns;
+	record_device* device = &rec->devices[index];
+	memcpy(device->last, data, length);
+	device->length = length;
+	device->reports++;
+}
+
+static void on_removed(size_t index, void* context)
+{
+	recorder* rec = (recorder*)context;
+	uint64_t now = monotonic_ns();
+	htt_printf("Device %zu : input gone\n", index);
+	if (!reserve(rec, now))
+	{
+		rec->dropped++;
+		return;
+	}
+	record_buffer* buffer = rec->current;
+	unsigned char* p = buffer->data + buffer->used;
+	size_t used = put_varint(p, index << 2 | RECORD_REMOVED);
+	used += put_varint(p + used, now - rec->last_ns);
+	buffer->used += used;
+	rec->segment_bytes += used;
+	rec->encoded_bytes += used;
+	rec->last_ns = now;
+}
+
+static void on_timer(uint64_t now_ns, void* context)
+{
+	recorder* rec = (recorder*)context;
+	if (rec->current && rec->current->used)
+		submit(rec);
+	rec->next_flush_ns = now_ns + RECORD_FLUSH_MS * 1000000ull;
+}
+
+static std::vector<unsigned char> load_descriptor(int fd)
+{
+	std::vector<unsigned char> result;
+	int size = 0;
+	struct hidraw_report_descriptor descriptor;
+	if (fd < 0 || ioctl(fd, HIDIOCGRDESCSIZE, &size) < 0 || size <= 0 || size > HID_MAX_DESCRIPTOR_SIZE)
+		return result;
+	descriptor.size = size;
+	if (ioctl(fd, HIDIOCGRDESC, &descriptor) < 0)
+		return result;
+	result.assign(descriptor.value, descriptor.value + descriptor.size);
+	return result;
+}
+
+void record(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	const char* path = argv[start_index + 1];
+	if (fanout_in_worker())
+	{
+		htt_printf("--record reads all units itself, it can't run per --device\n");
+		g_failures++;
+		return;
+	}
+	char name[1024];
+	segment_name(path, 0, name, sizeof(name));
+	if (access(name, F_OK) == 0)
+	{
+		htt_printf("%s already exists, the log is never overwritten\n", name);
+		g_failures++;
+		return;
+	}
+	std::vector<size_t> indices(g_device_count);
+	for (size_t i = 0; i < g_device_count; i++)
+		indices[i] = i;
+	htt_input* input = g_device_count ? input_open(&indices[0], indices.size()) : NULL;
+	if (!input)
+	{
+		htt_printf("No HTT input to record\n");
+		g_failures++;
+		return;
+	}
+
+	recorder* rec = new recorder();
+	rec->path = path;
+	rec->serials.resize(g_device_count);
+	rec->descriptors.resize(g_device_count);
+	rec->devices.resize(g_device_count);
+	memset(&rec->devices[0], 0, sizeof(record_device) * g_device_count);
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		rec->serials[i] = g_identities[i].serial;
+		rec->descriptors[i] = load_descriptor(input_device_fd(input, i));
+	}
+	std::vector<unsigned char> memory((size_t)RECORD_BUFFERS * RECORD_BUFFER_BYTES);
+	record_buffer buffers[RECORD_BUFFERS];
+	for (int i = 0; i < RECORD_BUFFERS; i++)
+	{
+		buffers[i].data = &memory[(size_t)i * RECORD_BUFFER_BYTES];
+		buffers[i].used = 0;
+		buffers[i].new_segment = 0;
+		rec->free_buffers.push_back(&buffers[i]);
+	}
+	rec->current = NULL;
+	rec->need_header = 1;
+	rec->segment = 0;
+	rec->segment_bytes = 0;
+	rec->last_ns = 0;
+	rec->raw_bytes = rec->encoded_bytes = rec->dropped = 0;
+	rec->stop = 0;
+	rec->write_error = 0;
+	rec->segments_written = 0;
+	std::thread writer(writer_thread, rec);
+
+	uint64_t start = monotonic_ns();
+	rec->next_flush_ns = start + RECORD_FLUSH_MS * 1000000ull;
+	input_callbacks callbacks = { on_report, on_timer, on_removed, NULL, rec };
+	htt_printf("Recording the input reports of %zu units to %s.*, Ctrl+C to stop\n", input_device_count(input), path);
+	fflush(stdout);
+	input_catch_signals();
+	/* the header goes out right away, so the log exists while it's quiet */
+	reserve(rec, start);
+	while (!g_input_stop && input_device_count(input) && !rec->write_error)
+	{
+		input_set_timer(input, rec->next_flush_ns);
+		if (input_dispatch(input, -1, &callbacks) < 0)
+		{
+			htt_printf("Input   : wait failed\n");
+			g_failures++;
+			break;
+		}
+	}
+	double elapsed = (monotonic_ns() - start) / 1e9;
+	input_close(input);
+	submit(rec);
+	{
+		std::lock_guard<std::mutex> guard(rec->lock);
+		rec->stop = 1;
+	}
+	rec->wake.notify_one();
+	writer.join();
+
+	if (rec->write_error)
+	{
+		htt_printf("Writing %s.* failed : %s\n", path, strerror(rec->write_error));
+		g_failures++;
+	}
+	for (size_t i = 0; i < g_device_count; i++)
+		htt_printf("Device %zu : %llu reports\n", i, (unsigned long long)rec->devices[i].reports);
+	htt_printf("Recorded %.1f s in %u segments : %llu bytes raw, %llu bytes logged (%.1fx)",
+		elapsed, rec->segments_written.load(), (unsigned long long)rec->raw_bytes,
+		(unsigned long long)rec->encoded_bytes,
+		rec->encoded_bytes ? (double)rec->raw_bytes / rec->encoded_bytes : 0.0);
+	if (rec->dropped)
+		htt_printf(", %llu reports dropped as the disk fell behind", (unsigned long long)rec->dropped);
+	htt_printf("\n");
+	delete rec;
+}
+
+/* Reading */
+
+typedef struct
+{
+	std::string serial;
+	std::vector<unsigned char> descriptor;
+	unsigned char last[INPUT_REPORT_MAX];
+	int length;
+} replay_device;
+
+struct record_reader
+{
+	std::string path;
+	unsigned int segment;
+	const unsigned char* map;
+	size_t map_size;
+	const unsigned char* pos;
+	const unsigned char* end;
+	uint64_t mono_base;
+	uint64_t real_base;
+	uint64_t last_ns;
+	std::vector<replay_device> devices;
+};
+
+static void unmap_segment(record_reader* reader)
+{
+	if (reader->map)
+		munmap((void*)reader->map, reader->map_size);
+	reader->map = NULL;
+	reader->pos = reader->end = NULL;
+}
+
+/* 1 when the segment is mapped and its header read, 0 when it doesn't
+ * exist, -1 when it is damaged */
+static int map_segment(record_reader* reader, unsigned int segment)
+{
+	char name[1024];
+	unmap_segment(reader);
+	segment_name(reader->path.c_str(), segment, name, sizeof(name));
+	int fd = open(name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	struct stat st;
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(record_magic))
+	{
+		close(fd);
+		return -1;
+	}
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return -1;
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	reader->map = (const unsigned char*)map;
+	reader->map_size = st.st_size;
+	reader->segment = segment;
+
+	const unsigned char* p = reader->map;
+	const unsigned char* end = p + reader->map_size;
+	uint64_t index, count;
+	if (memcmp(p, record_magic, sizeof(record_magic)))
+		return -1;
+	p += sizeof(record_magic);
+	if (!get_varint(&p, end, &index) || !get_varint(&p, end, &reader->mono_base) ||
+		!get_varint(&p, end, &reader->real_base) || !get_varint(&p, end, &count) || count > 4096)
+		return -1;
+	reader->devices.assign(count, replay_device());
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t size;
+		replay_device* device = &reader->devices[i];
+		if (!get_varint(&p, end, &size) || size > (uint64_t)(end - p))
+			return -1;
+		device->serial.assign((const char*)p, size);
+		p += size;
+		if (!get_varint(&p, end, &size) || size > (uint64_t)(end - p))
+			return -1;
+		device->descriptor.assign(p, p + size);
+		p += size;
+		device->length = 0;
+	}
+	reader->pos = p;
+	reader->end = end;
+	reader->last_ns = reader->mono_base;
+	return 1;
+}
+
+record_reader* record_reader_open(const char* path)
+{
+	record_reader* reader = new record_reader();
+	reader->path = path;
+	reader->map = NULL;
+	if (map_segment(reader, 0) <= 0)
+	{
+		record_reader_close(reader);
+		return NULL;
+	}
+	return reader;
+}
+
+void record_reader_close(record_reader* reader)
+{
+	if (!reader)
+		return;
+	unmap_segment(reader);
+	delete reader;
+}
+
+int record_reader_next(record_reader* reader, record_entry* entry)
+{
+	for (;;)
+	{
+		const unsigned char* p = reader->pos;
+		const unsigned char* end = reader->end;
+		if (p && p < end)
+		{
+			uint64_t tag, delta, value;
+			if (!get_varint(&p, end, &tag) || !get_varint(&p, end, &delta))
+				goto next_segment;
+			size_t index = tag >> 2;
+			int kind = tag & 3;
+			if (index >= reader->devices.size() || kind > RECORD_REMOVED)
+				return -1;
+			replay_device* device = &reader->devices[index];
+			if (kind == RECORD_DELTA)
+			{
+				uint64_t runs, skip, count;
+				size_t at = 0;
+				if (!device->length)
+					return -1;
+				if (!get_varint(&p, end, &runs))
+					goto next_segment;
+				for (uint64_t r = 0; r < runs; r++)
+				{
+					if (!get_varint(&p, end, &skip) || !get_varint(&p, end, &count))
+						goto next_segment;
+					at += skip;
+					if (at + count > (size_t)device->length)
+						return -1;
+					if (count > (uint64_t)(end - p))
+						goto next_segment;
+					memcpy(device->last + at, p, count);
+					p += count;
+					at += count;
+				}
+			}
+			else if (kind == RECORD_FULL)
+			{
+				if (!get_varint(&p, end, &value))
+					goto next_segment;
+				if (value == 0 || value > INPUT_REPORT_MAX)
+					return -1;
+				if (value > (uint64_t)(end - p))
+					goto next_segment;
+				memcpy(device->last, p, value);
+				device->length = (int)value;
+				p += value;
+			}
+			reader->last_ns += delta;
+			entry->device = index;
+			entry->kind = kind;
+			entry->timestamp_ns = reader->last_ns;
+			entry->data = kind == RECORD_REMOVED ? NULL : device->last;
+			entry->length = kind == RECORD_REMOVED ? 0 : device->length;
+			entry->encoded = p - reader->pos;
+			reader->pos = p;
+			return 1;
+		}
+	next_segment:
+		int res = map_segment(reader, reader->segment + 1);
+		if (res <= 0)
+			return res;
+	}
+}
+
+size_t record_reader_devices(const record_reader* reader)
+{
+	return reader->devices.size();
+}
+
+const char* record_reader_serial(const record_reader* reader, size_t device)
+{
+	return reader->devices[device].serial.c_str();
+}
+
+const unsigned char* record_reader_descriptor(const record_reader* reader, size_t device, size_t* size)
+{
+	*size = reader->devices[device].descriptor.size();
+	return *size ? &reader->devices[device].descriptor[0] : NULL;
+}
+
+unsigned int record_reader_segment(const record_reader* reader)
+{
+	return reader->segment;
+}
+
+uint64_t record_reader_realtime_ns(const record_reader* reader, uint64_t timestamp_ns)
+{
+	return reader->real_base + (timestamp_ns - reader->mono_base);
+}
+
+void replay(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	const char* path = argv[start_index + 1];
+	record_reader* reader = record_reader_open(path);
+	if (!reader)
+	{
+		htt_printf("%s.0000 is not a touch log\n", path);
+		g_failures++;
+		return;
+	}
+	std::vector<touch_layout> layouts;
+	std::vector<int> has_layout;
+	unsigned int segment = (unsigned int)-1;
+	uint64_t records = 0, raw = 0, encoded = 0, first_ns = 0, last_ns = 0;
+	record_entry entry;
+	int res;
+	char line[512];
+	while ((res = record_reader_next(reader, &entry)) > 0)
+	{
+		if (segment != record_reader_segment(reader))
+		{
+			/* the units are listed again in every segment */
+			segment = record_reader_segment(reader);
+			size_t count = record_reader_devices(reader);
+			layouts.resize(count);
+			has_layout.assign(count, 0);
+			for (size_t i = 0; i < count; i++)
+			{
+				size_t size;
+				const unsigned char* descriptor = record_reader_descriptor(reader, i, &size);
+				has_layout[i] = descriptor && touch_layout_parse(descriptor, size, &layouts[i]);
+			}
+		}
+		if (!records)
+			first_ns = entry.timestamp_ns;
+		last_ns = entry.timestamp_ns;
+		records++;
+		encoded += entry.encoded;
+		uint64_t realtime = record_reader_realtime_ns(reader, entry.timestamp_ns);
+		time_t seconds = (time_t)(realtime / 1000000000ull);
+		struct tm local;
+		localtime_r(&seconds, &local);
+		int used = snprintf(line, sizeof(line), "%s %04d-%02d-%02d %02d:%02d:%02d.%06u", record_reader_serial(reader, entry.device),
+			local.tm_year + 1900, local.tm_mon + 1, local.tm_mday, local.tm_hour, local.tm_min, local.tm_sec,
+			(unsigned)(realtime % 1000000000ull / 1000));
+		if (entry.kind == RECORD_REMOVED)
+		{
+			htt_printf("%s gone\n", line);
+			continue;
+		}
+		raw += 8 + 1 + entry.length;
+		touch_frame frame;
+		if (has_layout[entry.device] && touch_decode(&layouts[entry.device], entry.data, entry.length, &frame) >= 0)
+		{
+			for (int i = 0; i < frame.count && used < (int)sizeof(line); i++)
+			{
+				const touch_contact* c = &frame.contacts[i];
+				if (c->tip)
+					used += snprintf(line + used, sizeof(line) - used, " %d:%d,%d,%d", c->id, c->x, c->y, c->pressure);
+				else
+					used += snprintf(line + used, sizeof(line) - used, " %d:up", c->id);
+			}
+		}
+		else
+		{
+			used += snprintf(line + used, sizeof(line) - used, " ");
+			for (int i = 0; i < entry.length && used < (int)sizeof(line) - 3; i++)
+				used += snprintf(line + used, sizeof(line) - used, "%02x", entry.data[i]);
+		}
+		htt_printf("%s\n", line);
+	}
+	if (res < 0)
+	{
+		htt_printf("Segment %u of %s is damaged, stopped there\n", record_reader_segment(reader), path);
+		g_failures++;
+	}
+	htt_printf("%llu records over %.1f s in %u segments : %llu bytes raw, %llu bytes logged (%.1fx)\n",
+		(unsigned long long)records, (last_ns - first_ns) / 1e9, record_reader_segment(reader) + 1,
+		(unsigned long long)raw, (unsigned long long)encoded, encoded ? (double)raw / encoded : 0.0);
+	record_reader_close(reader);
+}
@@ -0,0 +1,76 @@
+#ifndef HTT_RECORD_H
+#define HTT_RECORD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hidapi.h"
+
+/* Capture log of input reports (Linux only).
+ *
+ * The log is a series of segments named [file].0000, [file].0001, ... that
+ * are only ever appended to. A segment starts with a header holding the
+ * serial number and report descriptor of every unit and the clock it was
+ * started at, so each one can be read on its own. Records follow:
+ *
+ *   varint tag        device << 2 | kind
+ *   varint delta      ns since the previous record of the segment
+ *   kind 0 (delta)    varint runs, then per run: varint skip, varint count,
+ *                     count bytes; the bytes of the previous report of the
+ *                     device that the runs don't cover stay as they were
+ *   kind 1 (full)     varint length, length bytes
+ *   kind 2 (removed)  the unit went away
+ *
+ * Reports are encoded on the read thread into large buffers, a writer
+ * thread hands the filled buffers to write(). */
+
+#define RECORD_SEGMENT_BYTES (64u << 20)
+#define RECORD_BUFFER_BYTES (1u << 20)
+#define RECORD_BUFFERS 8
+/* a partly filled buffer is written out after this long */
+#define RECORD_FLUSH_MS 1000
+
+enum
+{
+	RECORD_DELTA,
+	RECORD_FULL,
+	RECORD_REMOVED
+};
+
+typedef struct
+{
+	size_t device;
+	int kind;
+	uint64_t timestamp_ns;       /* CLOCK_MONOTONIC of the recording host */
+	const unsigned char* data;   /* the whole report, valid until the next record */
+	int length;
+	size_t encoded;              /* bytes the record took in the log */
+} record_entry;
+
+typedef struct record_reader record_reader;
+
+/* Maps the segments of a log one after the other. NULL when the first
+ * segment can't be opened or has no valid header. */
+record_reader* record_reader_open(const char* path);
+void record_reader_close(record_reader* reader);
+
+/* Decodes the next record straight from the mapping. Returns 1, 0 at the
+ * end of the log and -1 when a segment is damaged; a record cut short at
+ * the end of a segment (the recorder was killed) ends the segment. */
+int record_reader_next(record_reader* reader, record_entry* entry);
+
+/* Units of the current segment */
+size_t record_reader_devices(const record_reader* reader);
+const char* record_reader_serial(const record_reader* reader, size_t device);
+const unsigned char* record_reader_descriptor(const record_reader* reader, size_t device, size_t* size);
+unsigned int record_reader_segment(const record_reader* reader);
+
+/* Wall clock time (ns since the epoch) of a record timestamp */
+uint64_t record_reader_realtime_ns(const record_reader* reader, uint64_t timestamp_ns);
+
+/* --record file, records the input reports of every unit until Ctrl+C */
+void record(hid_device* device, char* argv[], int start_index);
+
+/* --replay file, prints the records of a log and how well it compressed */
+void replay(hid_device* device, char* argv[], int start_index);
+
+#endif
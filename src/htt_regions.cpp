@@ -0,0 +1,316 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <vector>
+#include "htt_util.h"
+#include "htt_fanout.h"
+#include "htt_histogram.h"
+#include "htt_touchreader.h"
+#include "htt_regions.h"
+
+static uint64_t cell_scale(int32_t min, int32_t max)
+{
+	uint64_t span = max > min ? (uint64_t)((int64_t)max - min) + 1 : 1;
+	return ((uint64_t)REGION_GRID << 32) / span;
+}
+
+static int cell(int64_t offset, uint64_t scale)
+{
+	if (offset <= 0)
+		return 0;
+	uint64_t index = ((uint64_t)offset * scale) >> 32;
+	return index >= REGION_GRID ? REGION_GRID - 1 : (int)index;
+}
+
+void region_map_build(region_map* map, const touch_layout* layout)
+{
+	map->x_min = layout->x_min;
+	map->y_min = layout->y_min;
+	map->x_scale = cell_scale(layout->x_min, layout->x_max);
+	map->y_scale = cell_scale(layout->y_min, layout->y_max);
+	map->cell_start.assign(REGION_GRID * REGION_GRID + 1, 0);
+	map->cell_regions.clear();
+
+	/* count the regions of every cell, then fill them in region order so the
+	 * first region listed is tested first */
+	std::vector<int> bounds(map->regions.size() * 4);
+	for (size_t r = 0; r < map->regions.size(); r++)
+	{
+		const touch_region* region = &map->regions[r];
+		int* b = &bounds[r * 4];
+		b[0] = cell((int64_t)region->x0 - map->x_min, map->x_scale);
+		b[1] = cell((int64_t)region->y0 - map->y_min, map->y_scale);
+		b[2] = cell((int64_t)region->x1 - 1 - map->x_min, map->x_scale);
+		b[3] = cell((int64_t)region->y1 - 1 - map->y_min, map->y_scale);
+		for (int y = b[1]; y <= b[3]; y++)
+			for (int x = b[0]; x <= b[2]; x++)
+				map->cell_start[y * REGION_GRID + x + 1]++;
+	}
+	for (int i = 0; i < REGION_GRID * REGION_GRID; i++)
+		map->cell_start[i + 1] += map->cell_start[i];
+	map->cell_regions.resize(map->cell_start[REGION_GRID * REGION_GRID]);
+	std::vector<uint32_t> fill(map->cell_start.begin(), map->cell_start.end() - 1);
+	for (size_t r = 0; r < map->regions.size(); r++)
+	{
+		const int* b = &bounds[r * 4];
+		for (int y = b[1]; y <= b[3]; y++)
+			for (int x = b[0]; x <= b[2]; x++)
+				map->cell_regions[fill[y * REGION_GRID + x]++] = (uint32_t)r;
+	}
+}
+
+int region_map_find(const region_map* map, int32_t x, int32_t y)
+{
+	if (map->regions.empty())
+		return -1;
+	int c = cell((int64_t)y - map->y_min, map->y_scale) * REGION_GRID + cell((int64_t)x - map->x_min, map->x_scale);
+	for (uint32_t i = map->cell_start[c]; i < map->cell_start[c + 1]; i++)
+	{
+		const touch_region* region = &map->regions[map->cell_regions[i]];
+		if (x >= region->x0 && x < region->x1 && y >= region->y0 && y < region->y1)
+			return (int)map->cell_regions[i];
+	}
+	return -1;
+}
+
+static char* trim(char* s)
+{
+	while (isspace((unsigned char)*s))
+		s++;
+	size_t len = strlen(s);
+	while (len && isspace((unsigned char)s[len - 1]))
+		s[--len] = 0;
+	return s;
+}
+
+static int parse_region(const char* name, const char* value, touch_region* region)
+{
+	int x, y, width, height, duration, used = 0;
+	char kind[8] = "";
+	if (strlen(name) >= sizeof(region->name) ||
+		sscanf(value, "%d,%d,%d,%d,%7[a-z],%d%n", &x, &y, &width, &height, kind, &duration, &used) != 6 ||
+		value[used] || width <= 0 || height <= 0 || duration <= 0 || duration > 100)
+		return 0;
+	memset(region, 0, sizeof(*region));
+	snprintf(region->name, sizeof(region->name), "%s", name);
+	if (!strcmp(kind, "haptic"))
+		region->kind = REGION_HAPTIC;
+	else if (!strcmp(kind, "piezo"))
+		region->kind = REGION_PIEZO;
+	else
+		return 0;
+	region->x0 = x;
+	region->y0 = y;
+	region->x1 = x + width;
+	region->y1 = y + height;
+	region->duration = (uint8_t)duration;
+	return 1;
+}
+
+static int load_map(const char* path, std::vector<region_map>& maps)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+	{
+		htt_printf("error opening %s\n", path);
+		return 0;
+	}
+	char buffer[512];
+	int line = 0;
+	int ok = 1;
+	std::vector<size_t> indices(g_device_count ? g_device_count : 1);
+	int count = -1;
+	while (ok && fgets(buffer, sizeof(buffer), f))
+	{
+		line++;
+		char* s = trim(buffer);
+		if (!*s || *s == '#')
+			continue;
+		if (*s == '[')
+		{
+			size_t len = strlen(s);
+			if (s[len - 1] != ']')
+			{
+				htt_printf("%s:%d : expected [units]\n", path, line);
+				ok = 0;
+				break;
+			}
+			s[len - 1] = 0;
+			count = g_device_count ? fanout_parse_selection(s + 1, &indices[0], indices.size()) : 0;
+			if (count < 0)
+			{
+				htt_printf("%s:%d : invalid units %s\n", path, line, s + 1);
+				ok = 0;
+			}
+			continue;
+		}
+		char* eq = strchr(s, '=');
+		touch_region region;
+		if (!eq || count < 0)
+		{
+			htt_printf("%s:%d : expected [units] and then name = x,y,width,height,haptic|piezo,duration\n", path, line);
+			ok = 0;
+			break;
+		}
+		*eq = 0;
+		if (!parse_region(trim(s), trim(eq + 1), &region))
+		{
+			htt_printf("%s:%d : invalid region, expected name = x,y,width,height,haptic|piezo,duration\n", path, line);
+			ok = 0;
+			break;
+		}
+		for (int i = 0; i < count; i++)
+			maps[indices[i]].regions.push_back(region);
+	}
+	fclose(f);
+	return ok;
+}
+
+typedef struct
+{
+	int active;
+	int original;            /* touch feedback setting to restore */
+	uint64_t down;           /* contact ids touching, by id modulo 64 */
+	uint64_t touches;
+	uint64_t hits;
+	uint64_t failed;
+} region_unit;
+
+typedef struct
+{
+	std::vector<region_map> maps;
+	std::vector<region_unit> units;
+	htt_histogram latency;
+} region_state;
+
+static void on_frame(size_t device, const touch_frame* frame, uint64_t read_ns, void* context)
+{
+	region_state* state = (region_state*)context;
+	region_unit* unit = &state->units[device];
+	if (!unit->active)
+		return;
+	for (int i = 0; i < frame->count; i++)
+	{
+		const touch_contact* contact = &frame->contacts[i];
+		uint64_t bit = 1ull << (contact->id & 63);
+		if (!contact->tip)
+		{
+			unit->down &= ~bit;
+			continue;
+		}
+		if (unit->down & bit)
+			continue;
+		unit->down |= bit;
+		unit->touches++;
+		int r = region_map_find(&state->maps[device], contact->x, contact->y);
+		if (r < 0)
+			continue;
+		touch_region* region = &state->maps[device].regions[r];
+		int success = region->kind == REGION_PIEZO ? set_piezoduration(g_handles[device], region->duration) :
+			set_hapticduration(g_handles[device], region->duration);
+		if (!success)
+		{
+			unit->failed++;
+			continue;
+		}
+		histogram_add(&state->latency, monotonic_ns() - read_ns);
+		region->hits++;
+		unit->hits++;
+	}
+}
+
+void touch_regions(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	const char* path = argv[start_index + 1];
+	if (fanout_in_worker())
+	{
+		htt_printf("--touch-regions reads all units itself, it can't run per --device\n");
+		g_failures++;
+		return;
+	}
+	region_state* state = new region_state();
+	state->maps.resize(g_device_count);
+	state->units.resize(g_device_count);
+	histogram_reset(&state->latency);
+	if (!load_map(path, state->maps))
+	{
+		g_failures++;
+		delete state;
+		return;
+	}
+	std::vector<size_t> indices;
+	for (size_t i = 0; i < g_device_count; i++)
+		if (!state->maps[i].regions.empty() && g_handles[i])
+			indices.push_back(i);
+	touch_reader* reader = indices.empty() ? NULL : touch_reader_open(&indices[0], indices.size(), &g_touch_filter,
+		&g_touch_transform);
+	if (!reader)
+	{
+		htt_printf("%s : no HTT touch input with regions to read\n", path);
+		g_failures++;
+		delete state;
+		return;
+	}
+
+	size_t active = 0;
+	for (size_t k = 0; k < indices.size(); k++)
+	{
+		size_t i = indices[k];
+		region_unit* unit = &state->units[i];
+		const touch_layout* layout = touch_reader_layout(reader, i);
+		if (!layout)
+			continue;
+		region_map_build(&state->maps[i], layout);
+		/* the unit itself would buzz on every touch */
+		unit->original = get_touchfeedback(g_handles[i]);
+		if (unit->original < 0)
+		{
+			htt_printf("Device %zu : Error reading touch feedback\n", i);
+			g_failures++;
+			continue;
+		}
+		if (unit->original && !set_touchfeedback(g_handles[i], 0))
+		{
+			htt_printf("Device %zu : Error turning touch feedback off\n", i);
+			g_failures++;
+			continue;
+		}
+		unit->active = 1;
+		active++;
+		htt_printf("Device %zu : %zu regions, %zu index entries\n", i, state->maps[i].regions.size(),
+			state->maps[i].cell_regions.size());
+	}
+	if (active)
+	{
+		htt_printf("Feedback on the regions of %zu units, Ctrl+C to stop\n", active);
+		fflush(stdout);
+		if (touch_reader_run(reader, 0, on_frame, state) < 0)
+			g_failures++;
+	}
+	else
+		g_failures++;
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		region_unit* unit = &state->units[i];
+		if (!unit->active)
+			continue;
+		if (unit->original && !set_touchfeedback(g_handles[i], (uint8_t)unit->original))
+		{
+			htt_printf("Device %zu : Error restoring touch feedback %d\n", i, unit->original);
+			g_failures++;
+		}
+		htt_printf("Device %zu : %llu touches, %llu on regions, %llu commands failed\n", i,
+			(unsigned long long)unit->touches, (unsigned long long)unit->hits, (unsigned long long)unit->failed);
+		const region_map* map = &state->maps[i];
+		for (size_t r = 0; r < map->regions.size(); r++)
+			htt_printf("  %-16s %llu\n", map->regions[r].name, (unsigned long long)map->regions[r].hits);
+		if (unit->failed)
+			g_failures++;
+	}
+	histogram_print(&state->latency, "Touch to command", 1e3, "us");
+	histogram_print_bars(&state->latency, 1e3, "us");
+	touch_reader_close(reader);
+	delete state;
+}
@@ -0,0 +1,67 @@
+#ifndef HTT_REGIONS_H
+#define HTT_REGIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "hidapi.h"
+#include "htt_touch.h"
+
+/* Haptic / piezo feedback on buttons only, driven by the host (Linux only).
+ *
+ * A region map lists the rectangles of every unit that should give
+ * feedback. Touches are read from the input reports of all units, a contact
+ * touching down inside a rectangle sends that region's haptic or piezo
+ * duration to its unit, touches anywhere else stay silent. The touch
+ * feedback of the units is switched off meanwhile and restored at the end.
+ *
+ * Map file, a [units] section per set of units (see --device) with one
+ * name = x,y,width,height,haptic|piezo,duration line per region, in touch
+ * units or after --touch-transform, the duration 1-100 in 100 ms steps as
+ * for --haptic / --piezo:
+ *
+ *   [serial:A1B2C3]
+ *   ok     = 40,600,300,120,haptic,1
+ *   cancel = 460,600,300,120,piezo,2
+ *
+ *   [all]
+ *   help   = 0,0,100,100,haptic,1
+ *
+ * The first region listed wins where regions overlap. */
+
+#define REGION_GRID 32           /* index cells per axis */
+#define REGION_HAPTIC 0
+#define REGION_PIEZO 1
+
+typedef struct
+{
+	char name[32];
+	int32_t x0, y0;          /* inclusive */
+	int32_t x1, y1;          /* exclusive */
+	int kind;
+	uint8_t duration;
+	uint64_t hits;
+} touch_region;
+
+/* The regions of one unit, indexed in a uniform grid over its touch range:
+ * every cell lists the regions overlapping it, so a lookup is one multiply
+ * and shift per axis and a test of the few regions in the cell. */
+typedef struct
+{
+	std::vector<touch_region> regions;
+	int32_t x_min, y_min;
+	uint64_t x_scale, y_scale;                /* cells per touch unit, 32.32 */
+	std::vector<uint32_t> cell_start;         /* REGION_GRID^2 + 1 offsets */
+	std::vector<uint32_t> cell_regions;
+} region_map;
+
+/* Builds the grid for the regions of map over the range of layout */
+void region_map_build(region_map* map, const touch_layout* layout);
+
+/* Index of the region holding the point, -1 for none. Doesn't allocate. */
+int region_map_find(const region_map* map, int32_t x, int32_t y);
+
+/* --touch-regions mapfile, runs until Ctrl+C */
+void touch_regions(hid_device* device, char* argv[], int start_index);
+
+#endif
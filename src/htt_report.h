@@ -0,0 +1,217 @@
+#ifndef HTT_REPORT_H
+#define HTT_REPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "hidapi.h"
+#include "htt_util.h"
+
+/* Feature report layouts checked at compile time.
+ *
+ * A layout lists the fields that follow the report ID, every field type
+ * knows its width and byte order. FeatureReport<ID, Layout> is a buffer of
+ * exactly 1 + Layout::size bytes and its fields are reached by index, an
+ * index past the end of the layout or an accessor that doesn't match the
+ * kind of field (scalar, array, raw bytes) doesn't compile. */
+
+/* unsigned big endian field of Bytes bytes */
+template <size_t Bytes>
+struct be
+{
+	static const size_t size = Bytes;
+	static const int kind = 0;
+	static void put(unsigned char* p, uint32_t value)
+	{
+		for (size_t i = 0; i < Bytes; i++)
+			p[i] = (unsigned char)(value >> (8 * (Bytes - 1 - i)));
+	}
+	static uint32_t get(const unsigned char* p)
+	{
+		uint32_t value = 0;
+		for (size_t i = 0; i < Bytes; i++)
+			value = (value << 8) | p[i];
+		return value;
+	}
+};
+
+/* unsigned little endian field of Bytes bytes */
+template <size_t Bytes>
+struct le
+{
+	static const size_t size = Bytes;
+	static const int kind = 0;
+	static void put(unsigned char* p, uint32_t value)
+	{
+		for (size_t i = 0; i < Bytes; i++)
+			p[i] = (unsigned char)(value >> (8 * i));
+	}
+	static uint32_t get(const unsigned char* p)
+	{
+		uint32_t value = 0;
+		for (size_t i = Bytes; i > 0; i--)
+			value = (value << 8) | p[i - 1];
+		return value;
+	}
+};
+
+typedef be<1> u8;
+typedef be<2> be16;
+typedef le<2> le16;
+typedef le<4> le32;
+
+/* Count fields of the same type back to back */
+template <typename Field, size_t Count>
+struct array
+{
+	static const size_t size = Field::size * Count;
+	static const size_t count = Count;
+	static const int kind = 1;
+	typedef Field element;
+};
+
+/* Opaque bytes passed through as they are */
+template <size_t Bytes>
+struct raw
+{
+	static const size_t size = Bytes;
+	static const int kind = 2;
+};
+
+template <typename... Fields>
+struct Layout;
+
+template <>
+struct Layout<>
+{
+	static const size_t size = 0;
+	static const size_t count = 0;
+};
+
+template <typename First, typename... Rest>
+struct Layout<First, Rest...>
+{
+	typedef First first;
+	typedef Layout<Rest...> rest;
+	static const size_t size = First::size + Layout<Rest...>::size;
+	static const size_t count = 1 + sizeof...(Rest);
+};
+
+/* Type and offset (from the byte after the report ID) of field N */
+template <size_t N, typename L>
+struct field_at
+{
+	typedef typename field_at<N - 1, typename L::rest>::type type;
+	static const size_t offset = L::first::size + field_at<N - 1, typename L::rest>::offset;
+};
+
+template <typename L>
+struct field_at<0, L>
+{
+	typedef typename L::first type;
+	static const size_t offset = 0;
+};
+
+template <uint8_t ID, typename L>
+class FeatureReport
+{
+public:
+	static const uint8_t id = ID;
+	static const size_t size = 1 + L::size;
+
+	/* Only the report ID is written, every field of a report that is sent
+	 * has to be set. */
+	FeatureReport()
+	{
+		buf[0] = ID;
+	}
+
+	template <size_t N>
+	void set(uint32_t value)
+	{
+		static_assert(N < L::count, "field index past the end of the report layout");
+		typedef typename field_at<N, L>::type field;
+		static_assert(field::kind == 0, "field is not a scalar");
+		field::put(buf + 1 + field_at<N, L>::offset, value);
+	}
+
+	template <size_t N>
+	uint32_t get() const
+	{
+		static_assert(N < L::count, "field index past the end of the report layout");
+		typedef typename field_at<N, L>::type field;
+		static_assert(field::kind == 0, "field is not a scalar");
+		return field::get(buf + 1 + field_at<N, L>::offset);
+	}
+
+	template <size_t N>
+	void set(size_t index, uint32_t value)
+	{
+		static_assert(N < L::count, "field index past the end of the report layout");
+		typedef typename field_at<N, L>::type field;
+		static_assert(field::kind == 1, "field is not an array");
+		field::element::put(buf + 1 + field_at<N, L>::offset + index * field::element::size, value);
+	}
+
+	template <size_t N>
+	uint32_t get(size_t index) const
+	{
+		static_assert(N < L::count, "field index past the end of the report layout");
+		typedef typename field_at<N, L>::type field;
+		static_assert(field::kind == 1, "field is not an array");
+		return field::element::get(buf + 1 + field_at<N, L>::offset + index * field::element::size);
+	}
+
+	template <size_t N>
+	unsigned char* data()
+	{
+		static_assert(N < L::count, "field index past the end of the report layout");
+		static_assert(field_at<N, L>::type::kind == 2, "field is not raw bytes");
+		return buf + 1 + field_at<N, L>::offset;
+	}
+
+	const unsigned char* bytes() const
+	{
+		return buf;
+	}
+
+	int send(hid_device* handle) const
+	{
+		return hid_send_feature_report(handle, buf, size);
+	}
+
+	/* A short answer leaves the fields it didn't cover zero. */
+	int read(hid_device* handle)
+	{
+		int res = hid_get_feature_report(handle, buf, size);
+		if (res >= 0 && (size_t)res < size)
+			memset(buf + res, 0, size - res);
+		return res;
+	}
+
+private:
+	unsigned char buf[size];
+};
+
+typedef FeatureReport<REPORT_DRIVER_TYPE, Layout<u8> > DriverReport;
+typedef FeatureReport<REPORT_CALMATRIX, Layout<raw<56> > > CalmatrixReport;
+typedef FeatureReport<REPORT_MXT_SENSITIVITY, Layout<u8> > SensitivityReport;
+typedef FeatureReport<REPORT_SCREENROTATION, Layout<u8> > RotationReport;
+typedef FeatureReport<REPORT_FWREV, Layout<le32> > FwrevReport;
+typedef FeatureReport<REPORT_BACKLIGHT, Layout<u8, u8> > BacklightReport;          /* level, save */
+typedef FeatureReport<REPORT_HAPTIC, Layout<u8> > HapticReport;
+typedef FeatureReport<REPORT_PIEZO, Layout<u8> > PiezoReport;
+typedef FeatureReport<REPORT_MODULEID, Layout<u8, u8> > ModuleIdReport;
+typedef FeatureReport<REPORT_TOUCHFEEDBACK, Layout<u8> > TouchFeedbackReport;
+typedef FeatureReport<REPORT_TOUCHDIM, Layout<array<u8, 4>, array<be16, 4> > > TouchDimReport; /* brightness, timeout */
+typedef FeatureReport<REPORT_PCAPCALIBRATE, Layout<u8> > CapCalibrateReport;
+typedef FeatureReport<REPORT_BACKLIGHT_FADE, Layout<be16, u8> > FadeReport;        /* time, save */
+typedef FeatureReport<REPORT_FACTORY_RESET, Layout<u8> > FactoryResetReport;
+typedef FeatureReport<REPORT_ALARM, Layout<u8, be16, u8> > AlarmReport;            /* type, duration, blink */
+typedef FeatureReport<REPORT_TOUCH_THRESHOLD, Layout<be16> > ThresholdReport;
+
+static_assert(CalmatrixReport::size == 57, "calibration matrix report is 56 bytes after the ID");
+static_assert(TouchDimReport::size == 13, "touch dim report is 4 levels and 4 timeouts");
+static_assert(AlarmReport::size == 5, "alarm report is type, duration and blink");
+
+#endif
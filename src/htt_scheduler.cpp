@@ -0,0 +1,468 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "htt_util.h"
+#include "htt_coalesce.h"
+#include "htt_fanout.h"
+#include "htt_input.h"
+#include "htt_timerwheel.h"
+#include "htt_scheduler.h"
+
+#define SCHEDULE_TICK_NS 100000000ull /* 100 ms */
+#define NS_PER_SEC 1000000000ull
+#define ALL_DAYS 0x7f
+
+enum
+{
+	ACTION_BACKLIGHT,
+	ACTION_BACKLIGHTSET,
+	ACTION_FADE,
+	ACTION_TOUCHFEEDBACK,
+	ACTION_HAPTIC,
+	ACTION_PIEZO,
+	ACTION_ALARM,
+	ACTION_COUNT
+};
+
+/* limits of every argument, the same as the command line options */
+static const struct
+{
+	const char* name;
+	int args;
+	int max[3];
+} Actions[ACTION_COUNT] =
+{
+	{ "backlight", 1, { 255 } },
+	{ "backlightset", 1, { 255 } },
+	{ "fade", 1, { 65535 } },
+	{ "touchfeedback", 1, { 3 } },
+	{ "haptic", 1, { 100 } },
+	{ "piezo", 1, { 100 } },
+	{ "alarm", 3, { 17, 65535, 10 } },   /* type, duration (65535 no timeout), flashes per second */
+};
+
+static const char* DayNames[7] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+
+typedef struct
+{
+	timer_node timer;
+	int line;
+	int days;           /* bit per tm_wday, 0 for a one time event */
+	int year, month, day;
+	int hour, minute, second;
+	int action;
+	int args[3];
+	size_t first;       /* units, a range of schedule_state::units */
+	size_t count;
+	time_t when;        /* wall clock time it is scheduled for */
+} schedule_event;
+
+typedef struct
+{
+	std::vector<schedule_event> events;
+	std::vector<size_t> units;
+	timer_wheel wheel;
+	size_t fired;
+} schedule_state;
+
+static schedule_state* s_state;
+
+static char* trim(char* s)
+{
+	while (isspace((unsigned char)*s))
+		s++;
+	size_t len = strlen(s);
+	while (len && isspace((unsigned char)s[len - 1]))
+		s[--len] = 0;
+	return s;
+}
+
+static int day_index(const char* name, size_t len)
+{
+	for (int i = 0; i < 7; i++)
+	{
+		if (len == 3 && strncmp(name, DayNames[i], 3) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/* daily, weekdays, weekends or mon,wed,fri-sun */
+static int parse_days(const char* spec)
+{
+	if (strcmp(spec, "daily") == 0)
+		return ALL_DAYS;
+	if (strcmp(spec, "weekdays") == 0)
+		return 0x3e;
+	if (strcmp(spec, "weekends") == 0)
+		return 0x41;
+	int days = 0;
+	const char* p = spec;
+	while (*p)
+	{
+		const char* end = strchr(p, ',');
+		if (!end)
+			end = p + strlen(p);
+		const char* dash = (const char*)memchr(p, '-', end - p);
+		int first = day_index(p, (dash ? dash : end) - p);
+		int last = dash ? day_index(dash + 1, end - dash - 1) : first;
+		if (first < 0 || last < 0)
+			return 0;
+		for (int d = first; ; d = (d + 1) % 7)
+		{
+			days |= 1 << d;
+			if (d == last)
+				break;
+		}
+		p = *end ? end + 1 : end;
+	}
+	return days;
+}
+
+static int parse_event(char* s, schedule_event* event)
+{
+	char* save = NULL;
+	char* when = strtok_r(s, " \t", &save);
+	char* clock = strtok_r(NULL, " \t", &save);
+	char* action = strtok_r(NULL, " \t", &save);
+	if (!when || !clock || !action)
+		return 0;
+
+	char tail;
+	if (sscanf(when, "%d-%d-%d%c", &event->year, &event->month, &event->day, &tail) == 3)
+	{
+		event->days = 0;
+		if (event->month < 1 || event->month > 12 || event->day < 1 || event->day > 31)
+			return 0;
+	}
+	else if (!(event->days = parse_days(when)))
+		return 0;
+
+	event->second = 0;
+	int fields = sscanf(clock, "%d:%d:%d%c", &event->hour, &event->minute, &event->second, &tail);
+	if ((fields != 2 && fields != 3) || event->hour < 0 || event->hour > 23 ||
+		event->minute < 0 || event->minute > 59 || event->second < 0 || event->second > 59)
+		return 0;
+
+	event->action = 0;
+	while (event->action < ACTION_COUNT && strcmp(action, Actions[event->action].name) != 0)
+		event->action++;
+	if (event->action == ACTION_COUNT)
+		return 0;
+	for (int i = 0; i < Actions[event->action].args; i++)
+	{
+		char* arg = strtok_r(NULL, " \t", &save);
+		char* end;
+		if (!arg)
+			return 0;
+		long value = strtol(arg, &end, 10);
+		if (*end || value < 0 || value > Actions[event->action].max[i])
+			return 0;
+		event->args[i] = (int)value;
+	}
+	return strtok_r(NULL, " \t", &save) == NULL;
+}
+
+static int load_schedule(const char* path, schedule_state* state)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+	{
+		htt_printf("error opening %s\n", path);
+		return 0;
+	}
+	std::map<std::string, std::string> groups;
+	std::vector<size_t> indices(g_device_count ? g_device_count : 1);
+	size_t first = 0;
+	int count = -1;     /* units of the current section, -1 before the first */
+	char buffer[512];
+	int line = 0;
+	int ok = 1;
+	while (ok && fgets(buffer, sizeof(buffer), f))
+	{
+		line++;
+		char* s = trim(buffer);
+		if (!*s || *s == '#')
+			continue;
+		if (*s == '[')
+		{
+			char* end = strchr(s, ']');
+			if (!end)
+			{
+				htt_printf("%s:%d : missing ]\n", path, line);
+				ok = 0;
+				break;
+			}
+			*end = 0;
+			std::string selector = trim(s + 1);
+			std::map<std::string, std::string>::const_iterator group = groups.find(selector);
+			if (group != groups.end())
+				selector = group->second;
+			count = g_device_count ? fanout_parse_selection(selector.c_str(), &indices[0], indices.size()) : 0;
+			if (count <= 0)
+			{
+				htt_printf("%s:%d : no HTT matches [%s]\n", path, line, s + 1);
+				ok = 0;
+				break;
+			}
+			first = state->units.size();
+			state->units.insert(state->units.end(), indices.begin(), indices.begin() + count);
+			continue;
+		}
+		if (count < 0 && strncmp(s, "group", 5) == 0 && isspace((unsigned char)s[5]) && strchr(s, '='))
+		{
+			char* eq = strchr(s, '=');
+			*eq = 0;
+			groups[trim(s + 5)] = trim(eq + 1);
+			continue;
+		}
+		if (count < 0)
+		{
+			htt_printf("%s:%d : expected [selector] or group name = selection\n", path, line);
+			ok = 0;
+			break;
+		}
+		schedule_event event;
+		memset(&event, 0, sizeof(event));
+		if (!parse_event(s, &event))
+		{
+			htt_printf("%s:%d : expected days|YYYY-MM-DD HH:MM[:SS] action values\n", path, line);
+			ok = 0;
+			break;
+		}
+		event.line = line;
+		event.first = first;
+		event.count = count;
+		state->events.push_back(event);
+	}
+	fclose(f);
+	return ok;
+}
+
+/* First wall clock time after "after" the event is due, -1 when never. */
+static time_t next_occurrence(const schedule_event* event, time_t after)
+{
+	struct tm tm;
+	if (!event->days)
+	{
+		memset(&tm, 0, sizeof(tm));
+		tm.tm_year = event->year - 1900;
+		tm.tm_mon = event->month - 1;
+		tm.tm_mday = event->day;
+		tm.tm_hour = event->hour;
+		tm.tm_min = event->minute;
+		tm.tm_sec = event->second;
+		tm.tm_isdst = -1;
+		time_t t = mktime(&tm);
+		return t > after ? t : -1;
+	}
+	localtime_r(&after, &tm);
+	/* one more than a week, the time of day may have passed today */
+	for (int i = 0; i <= 7; i++)
+	{
+		struct tm day = tm;
+		day.tm_mday += i;
+		day.tm_hour = event->hour;
+		day.tm_min = event->minute;
+		day.tm_sec = event->second;
+		day.tm_isdst = -1;
+		time_t t = mktime(&day);
+		if (t > after && (event->days & (1 << day.tm_wday)))
+			return t;
+	}
+	return -1;
+}
+
+/* Puts the event on the wheel for event->when, the wall clock time turned
+ * into the monotonic time of the wheel as of now. */
+static void schedule_timer(schedule_state* state, schedule_event* event)
+{
+	struct timespec wall;
+	clock_gettime(CLOCK_REALTIME, &wall);
+	uint64_t now = monotonic_ns();
+	int64_t delta = ((int64_t)event->when - wall.tv_sec) * (int64_t)NS_PER_SEC - wall.tv_nsec;
+	timerwheel_add(&state->wheel, &event->timer, delta > 0 ? now + delta : now);
+}
+
+static void arm(schedule_state* state, schedule_event* event, time_t after)
+{
+	event->when = next_occurrence(event, after);
+	if (event->when < 0)
+		return;
+	schedule_timer(state, event);
+}
+
+/* The wall clock was set (NTP, by hand): the monotonic deadlines no longer
+ * match the times the events are due. An event the step jumped over fires
+ * right away, once. */
+static void clock_was_set(schedule_state* state)
+{
+	for (size_t i = 0; i < state->events.size(); i++)
+	{
+		schedule_event* event = &state->events[i];
+		if (!timer_pending(&event->timer))
+			continue;
+		timerwheel_remove(&state->wheel, &event->timer);
+		schedule_timer(state, event);
+	}
+}
+
+/* A realtime timer far out that is cancelled when the clock is set */
+static int watch_clock(int fd)
+{
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = time(NULL) + 10 * 365 * 86400;
+	return timerfd_settime(fd, TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET, &its, NULL);
+}
+
+static int run_action(const schedule_event* event, size_t index)
+{
+	hid_device* handle = g_handles[index];
+	g_currentDevice = index;
+	switch (event->action)
+	{
+	/* queued only replaces what is pending, the result is the send */
+	case ACTION_BACKLIGHT:
+		return queue_backlight(handle, (uint8_t)event->args[0]) && coalesce_flush(index);
+	case ACTION_FADE:
+		return queue_fade(handle, (uint16_t)event->args[0]) && coalesce_flush(index);
+	case ACTION_BACKLIGHTSET:
+		return set_backlight(handle, (uint8_t)event->args[0], 1);
+	case ACTION_TOUCHFEEDBACK:
+		return set_touchfeedback(handle, (uint8_t)event->args[0]);
+	case ACTION_HAPTIC:
+		return set_hapticduration(handle, (uint8_t)event->args[0]);
+	case ACTION_PIEZO:
+		return set_piezoduration(handle, (uint8_t)event->args[0]);
+	case ACTION_ALARM:
+		return do_alarm(handle, (uint8_t)event->args[0], (uint16_t)event->args[1], (uint8_t)event->args[2]);
+	}
+	return 0;
+}
+
+static void on_event(timer_node* timer, uint64_t now_ns)
+{
+	(void)now_ns;
+	schedule_state* state = s_state;
+	schedule_event* event = (schedule_event*)timer->context;
+	size_t current = g_currentDevice;
+	int failed = 0;
+	for (size_t i = 0; i < event->count; i++)
+	{
+		if (!run_action(event, state->units[event->first + i]))
+			failed++;
+	}
+	g_currentDevice = current;
+	state->fired++;
+
+	struct tm tm;
+	char stamp[32];
+	time_t now = time(NULL);
+	localtime_r(&now, &tm);
+	strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &tm);
+	htt_printf("%s line %d : %s on %zu units : %s\n", stamp, event->line, Actions[event->action].name, event->count, result_string(!failed));
+
+	/* from the time it was due, or now when that passed: a late wakeup
+	 * (suspend, a stalled loop) fires it once rather than for every missed
+	 * occurrence, and a wakeup a tick early doesn't fire it twice */
+	arm(state, event, event->when > now ? event->when : now);
+}
+
+void schedule(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	const char* path = argv[start_index + 1];
+	if (fanout_in_worker())
+	{
+		htt_printf("--schedule runs the units of its file itself, it can't run per --device\n");
+		g_failures++;
+		return;
+	}
+
+	schedule_state state;
+	state.fired = 0;
+	if (!load_schedule(path, &state))
+	{
+		g_failures++;
+		return;
+	}
+	int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	int clock_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK);
+	if (timer_fd < 0 || clock_fd < 0 || watch_clock(clock_fd) < 0)
+	{
+		htt_printf("timerfd : %s\n", strerror(errno));
+		g_failures++;
+		if (timer_fd >= 0)
+			close(timer_fd);
+		if (clock_fd >= 0)
+			close(clock_fd);
+		return;
+	}
+
+	s_state = &state;
+	timerwheel_init(&state.wheel, SCHEDULE_TICK_NS, monotonic_ns());
+	time_t now = time(NULL);
+	size_t pending = 0;
+	for (size_t i = 0; i < state.events.size(); i++)
+	{
+		schedule_event* event = &state.events[i];
+		timer_init(&event->timer, on_event, event);
+		arm(&state, event, now);
+		if (timer_pending(&event->timer))
+			pending++;
+	}
+	htt_printf("%zu scheduled events, %zu of them pending, Ctrl+C to stop\n", state.events.size(), pending);
+	fflush(stdout);
+
+	input_catch_signals();
+	while (!g_input_stop && state.wheel.count)
+	{
+		uint64_t next = timerwheel_next_ns(&state.wheel);
+		struct itimerspec its;
+		memset(&its, 0, sizeof(its));
+		its.it_value.tv_sec = next / NS_PER_SEC;
+		its.it_value.tv_nsec = next % NS_PER_SEC;
+		timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+
+		struct pollfd fds[2] = { { timer_fd, POLLIN, 0 }, { clock_fd, POLLIN, 0 } };
+		if (poll(fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			htt_printf("poll : %s\n", strerror(errno));
+			g_failures++;
+			break;
+		}
+		uint64_t expirations;
+		if (fds[1].revents && read(clock_fd, &expirations, sizeof(expirations)) < 0 && errno == ECANCELED)
+		{
+			if (g_verbose)
+				htt_printf("Clock set, rescheduling\n");
+			watch_clock(clock_fd);
+			clock_was_set(&state);
+		}
+		if (fds[0].revents && read(timer_fd, &expirations, sizeof(expirations)) < 0 && errno != EINTR)
+		{
+			htt_printf("timerfd : %s\n", strerror(errno));
+			g_failures++;
+			break;
+		}
+		timerwheel_advance(&state.wheel, monotonic_ns());
+		fflush(stdout);
+	}
+	if (g_verbose)
+		htt_printf("%zu events fired\n", state.fired);
+	close(timer_fd);
+	close(clock_fd);
+	s_state = NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef HTT_SCHEDULER_H
+#define HTT_SCHEDULER_H
+
+#include "hidapi.h"
+
+/* Resident calendar scheduler (Linux only).
+ *
+ * Loads a schedule of actions per unit or group and fires them through the
+ * handles opened at start, replacing one cron entry (and one htt_util
+ * process) per device per change. Every pending event sits in one timer
+ * wheel, the process only wakes up when the earliest of them is due.
+ *
+ *   group lobby = 0-3,serial:A1B2C3   # optional named groups
+ *
+ *   [lobby]                           # group, all, or a --device selection
+ *   daily 07:00 backlight 255
+ *   mon-fri 19:00:30 backlight 40
+ *   sat,sun 09:00 fade 1000
+ *   2026-12-24 16:00 alarm 1 50 1
+ *
+ * Days are daily, weekdays, weekends or a list of mon..sun with ranges, a
+ * date makes it a one time event. Actions: backlight, backlightset, fade,
+ * touchfeedback, haptic, piezo, alarm, taking the same values as the
+ * command line options of the same name. */
+
+/* --schedule file, runs until SIGINT / SIGTERM */
+void schedule(hid_device* device, char* argv[], int start_index);
+
+#endif
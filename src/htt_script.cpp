@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include "htt_util.h"
+#include "htt_coalesce.h"
+#include "htt_script.h"
+#include "htt_fanout.h"
+
+#ifndef _WIN32
+	#include <poll.h>
+	#include <sys/stat.h>
+#endif
+
+#define SCRIPT_MAX_LINE   4096
+#define SCRIPT_MAX_TOKENS 64
+
+static int s_in_script = 0;
+
+/* Splits a line into arguments in place. Arguments are separated by white
+ * space, double quotes can be used for arguments containing spaces.
+ * Returns the number of arguments or -1 when there are too many. */
+static int tokenize(char* line, char* tokens[], int max_tokens)
+{
+	int count = 0;
+	char* p = line;
+	while (*p)
+	{
+		while (isspace((unsigned char)*p))
+			p++;
+		if (!*p || *p == '#')
+			break;
+		if (count == max_tokens)
+			return -1;
+		if (*p == '"')
+		{
+			tokens[count++] = ++p;
+			while (*p && *p != '"')
+				p++;
+		}
+		else
+		{
+			tokens[count++] = p;
+			while (*p && !isspace((unsigned char)*p))
+				p++;
+		}
+		if (*p)
+			*p++ = 0;
+	}
+	return count;
+}
+
+/* Returns 1 when the next line can be read without waiting. Volatile settings
+ * are only flushed once the input runs dry, so a fast producer (a slider
+ * feeding stdin) gets its stale values coalesced instead of queued up. */
+static int more_input_ready(FILE* f, int regular_file)
+{
+#ifdef _WIN32
+	return regular_file;
+#else
+	if (regular_file)
+		return 1;
+	struct pollfd fds;
+	fds.fd = fileno(f);
+	fds.events = POLLIN;
+	fds.revents = 0;
+	return poll(&fds, 1, 0) > 0;
+#endif
+}
+
+void script(hid_device* device, char* argv[], int start_index)
+{
+	const char* name = argv[start_index + 1];
+	if (s_in_script || fanout_in_worker())
+	{
+		htt_printf("--script can not be used inside a script.\n");
+		g_failures++;
+		return;
+	}
+
+	FILE* f = strcmp(name, "-") == 0 ? stdin : fopen(name, "r");
+	if (!f)
+	{
+		htt_printf("error opening %s\n", name);
+		g_failures++;
+		return;
+	}
+
+	int regular_file = 1;
+#ifndef _WIN32
+	struct stat st;
+	if (fstat(fileno(f), &st) == 0 && !S_ISREG(st.st_mode))
+	{
+		/* Nothing may hide in the stdio buffer, more_input_ready() has to
+		 * see every pending line on the descriptor. */
+		regular_file = 0;
+		setvbuf(f, NULL, _IONBF, 0);
+	}
+#endif
+
+	s_in_script = 1;
+	int batch = g_batch;
+	g_batch = 1;
+
+	char line[SCRIPT_MAX_LINE];
+	char* tokens[SCRIPT_MAX_TOKENS];
+	int line_number = 0;
+	int failed_lines = 0;
+	int executed_lines = 0;
+	while (fgets(line, sizeof(line), f))
+	{
+		line_number++;
+		size_t len = strlen(line);
+		if (len == sizeof(line) - 1 && line[len - 1] != '\n')
+		{
+			htt_printf("Line %d : too long.\n", line_number);
+			g_failures++;
+			failed_lines++;
+			/* skip the rest of the line */
+			int c;
+			while ((c = fgetc(f)) != EOF && c != '\n')
+				;
+			continue;
+		}
+
+		int count = tokenize(line, tokens, SCRIPT_MAX_TOKENS);
+		if (count == 0)
+			continue;
+		if (count < 0)
+		{
+			htt_printf("Line %d : too many arguments.\n", line_number);
+			g_failures++;
+			failed_lines++;
+			continue;
+		}
+
+		/* every line behaves like its own invocation of the utility */
+		g_currentDevice = 0;
+		executed_lines++;
+		int failures = run_commands(count, tokens, 0);
+		if (!more_input_ready(f, regular_file))
+		{
+			if (!coalesce_flush_all())
+				failures++;
+		}
+		if (failures)
+			failed_lines++;
+		htt_printf("Line %d : %s\n", line_number, failures ? "Failed." : "Success!");
+		fflush(stdout);
+	}
+	coalesce_flush_all();
+
+	if (f != stdin)
+		fclose(f);
+	htt_printf("Script %s : %d lines executed, %d failed.\n", name, executed_lines, failed_lines);
+	g_batch = batch;
+	s_in_script = 0;
+}
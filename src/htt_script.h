@@ -0,0 +1,11 @@
+#ifndef HTT_SCRIPT_H
+#define HTT_SCRIPT_H
+
+#include "hidapi.h"
+
+/* --script [filename|-]
+ * Runs one command line per line of the file against the handles opened at
+ * startup. */
+void script(hid_device* device, char* argv[], int start_index);
+
+#endif
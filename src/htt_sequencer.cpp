@@ -0,0 +1,225 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "htt_util.h"
+#include "htt_input.h"
+#include "htt_sequencer.h"
+
+#define SEQUENCER_LEAD_NS 2000000ull /* time given to get going before step 1 */
+#define REPORT_SIZE 8
+
+typedef struct
+{
+	uint64_t offset_ns;   /* planned, from the start of playback */
+	uint64_t sent_ns;     /* achieved, when the report went out */
+	uint64_t took_ns;     /* how long sending it took */
+	const char* name;
+	int ok;
+	uint8_t length;
+	unsigned char report[REPORT_SIZE];
+} sequencer_step;
+
+typedef struct
+{
+	sequencer_step steps[SEQUENCER_MAX_STEPS];
+	int count;
+	uint64_t end_ns;      /* offset after the last wait */
+} sequencer_pattern;
+
+static int parse_values(char* save, int* values, int count, const int* max)
+{
+	for (int i = 0; i < count; i++)
+	{
+		char* token = strtok_r(NULL, " \t", &save);
+		char* end;
+		if (!token)
+			return 0;
+		long value = strtol(token, &end, 10);
+		if (*end || value < 0 || value > max[i])
+			return 0;
+		values[i] = (int)value;
+	}
+	return strtok_r(NULL, " \t", &save) == NULL;
+}
+
+static int add_step(sequencer_pattern* pattern, const char* name, uint64_t offset)
+{
+	if (pattern->count >= SEQUENCER_MAX_STEPS)
+	{
+		htt_printf("Pattern has more than %d steps\n", SEQUENCER_MAX_STEPS);
+		return 0;
+	}
+	sequencer_step* step = &pattern->steps[pattern->count++];
+	memset(step, 0, sizeof(*step));
+	step->name = name;
+	step->offset_ns = offset;
+	return 1;
+}
+
+/* Parses the steps and serializes every report. */
+static int parse_pattern(const char* text, sequencer_pattern* pattern)
+{
+	/* the same limits as --haptic, --piezo, --backlight and --alarm */
+	static const int max_duration[1] = { 100 };
+	static const int max_level[1] = { 255 };
+	static const int max_alarm[3] = { 17, 65535, 10 };
+	char buffer[1024];
+	snprintf(buffer, sizeof(buffer), "%s", text);
+	pattern->count = 0;
+	uint64_t offset = 0;
+
+	char* outer = NULL;
+	for (char* item = strtok_r(buffer, ",;", &outer); item; item = strtok_r(NULL, ",;", &outer))
+	{
+		char* save = NULL;
+		char* verb = strtok_r(item, " \t", &save);
+		if (!verb)
+			continue;
+		int values[3];
+		if (strcmp(verb, "wait") == 0)
+		{
+			char* token = strtok_r(NULL, " \t", &save);
+			char* end;
+			double ms = token ? strtod(token, &end) : -1;
+			if (!token || *end || ms < 0 || strtok_r(NULL, " \t", &save))
+			{
+				htt_printf("Invalid step : wait %s\n", token ? token : "");
+				return 0;
+			}
+			offset += (uint64_t)(ms * 1000000.0);
+			continue;
+		}
+		if (strcmp(verb, "repeat") == 0)
+		{
+			static const int max_repeat[1] = { SEQUENCER_MAX_STEPS };
+			if (!parse_values(save, values, 1, max_repeat) || !values[0])
+			{
+				htt_printf("Invalid step : repeat\n");
+				return 0;
+			}
+			int count = pattern->count;
+			uint64_t length = offset;
+			for (int r = 1; r < values[0]; r++)
+			{
+				for (int i = 0; i < count; i++)
+				{
+					const sequencer_step* step = &pattern->steps[i];
+					if (!add_step(pattern, step->name, step->offset_ns + length * r))
+						return 0;
+					sequencer_step* copy = &pattern->steps[pattern->count - 1];
+					memcpy(copy->report, step->report, sizeof(step->report));
+					copy->length = step->length;
+				}
+			}
+			offset = length * values[0];
+			continue;
+		}
+
+		int ok;
+		if (strcmp(verb, "haptic") == 0 || strcmp(verb, "piezo") == 0)
+			ok = parse_values(save, values, 1, max_duration);
+		else if (strcmp(verb, "backlight") == 0)
+			ok = parse_values(save, values, 1, max_level);
+		else if (strcmp(verb, "alarm") == 0)
+			ok = parse_values(save, values, 3, max_alarm);
+		else
+			ok = 0;
+		if (!ok)
+		{
+			htt_printf("Invalid step : %s\n", verb);
+			return 0;
+		}
+		if (!add_step(pattern, NULL, offset))
+			return 0;
+		sequencer_step* step = &pattern->steps[pattern->count - 1];
+		if (verb[0] == 'h')
+		{
+			step->name = "haptic";
+			step->length = (uint8_t)haptic_report(step->report, (uint8_t)values[0]);
+		}
+		else if (verb[0] == 'p')
+		{
+			step->name = "piezo";
+			step->length = (uint8_t)piezo_report(step->report, (uint8_t)values[0]);
+		}
+		else if (verb[0] == 'b')
+		{
+			step->name = "backlight";
+			step->length = (uint8_t)backlight_report(step->report, (uint8_t)values[0], 0);
+		}
+		else
+		{
+			step->name = "alarm";
+			step->length = (uint8_t)alarm_report(step->report, (uint8_t)values[0], (uint16_t)values[1], (uint8_t)values[2]);
+		}
+	}
+	pattern->end_ns = offset;
+	if (!pattern->count)
+	{
+		htt_printf("Pattern has no steps\n");
+		return 0;
+	}
+	return 1;
+}
+
+static void sleep_until(uint64_t deadline_ns)
+{
+	struct timespec ts;
+	ts.tv_sec = deadline_ns / 1000000000ull;
+	ts.tv_nsec = deadline_ns % 1000000000ull;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+/* The timing path, nothing in here allocates, formats or prints. */
+static void play(hid_device* handle, sequencer_pattern* pattern)
+{
+	uint64_t start = monotonic_ns() + SEQUENCER_LEAD_NS;
+	for (int i = 0; i < pattern->count; i++)
+	{
+		sequencer_step* step = &pattern->steps[i];
+		sleep_until(start + step->offset_ns);
+		uint64_t sent = monotonic_ns();
+		step->ok = hid_send_feature_report(handle, step->report, step->length) >= 0;
+		uint64_t done = monotonic_ns();
+		step->sent_ns = sent - start;
+		step->took_ns = done - sent;
+	}
+	sleep_until(start + pattern->end_ns);
+}
+
+void pattern(hid_device* device, char* argv[], int start_index)
+{
+	if (!checkhtt(device))
+		return;
+	sequencer_pattern* steps = (sequencer_pattern*)malloc(sizeof(sequencer_pattern));
+	if (!steps || !parse_pattern(argv[start_index + 1], steps))
+	{
+		free(steps);
+		g_failures++;
+		return;
+	}
+
+	play(device, steps);
+
+	int failed = 0;
+	double worst = 0, total = 0;
+	for (int i = 0; i < steps->count; i++)
+	{
+		const sequencer_step* step = &steps->steps[i];
+		double planned = step->offset_ns / 1e6;
+		double error = ((double)step->sent_ns - (double)step->offset_ns) / 1e6;
+		if (!step->ok)
+			failed++;
+		if (error > worst)
+			worst = error;
+		total += error;
+		htt_printf("Step %3d %-9s : planned %9.3f ms, sent %9.3f ms (%+.3f), took %.3f ms%s\n", i + 1, step->name,
+			planned, step->sent_ns / 1e6, error, step->took_ns / 1e6, step->ok ? "" : ", failed");
+	}
+	htt_printf("Pattern of %d steps, %.3f ms : timing error mean %+.3f ms, worst %+.3f ms : %s\n", steps->count,
+		steps->end_ns / 1e6, total / steps->count, worst, result_string(!failed));
+	free(steps);
+}
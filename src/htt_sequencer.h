@@ -0,0 +1,25 @@
+#ifndef HTT_SEQUENCER_H
+#define HTT_SEQUENCER_H
+
+#include "hidapi.h"
+
+/* Host composed haptic / piezo / alarm patterns (Linux only).
+ *
+ * The firmware plays one event of a fixed duration per report, a pattern is
+ * a list of those reports with waits in between:
+ *
+ *   --pattern "haptic 1, wait 150, haptic 1, wait 150, haptic 4"
+ *
+ * Steps are haptic N, piezo N (N up to 100 in 100ms units), alarm type
+ * duration blink (as for --alarm), backlight level (volatile) and wait ms,
+ * "repeat N" plays everything before it N times in total. Every report is
+ * serialized before playback starts, each step then sleeps until its
+ * absolute deadline on CLOCK_MONOTONIC and the planned and achieved times
+ * of every step are reported. */
+
+#define SEQUENCER_MAX_STEPS 256
+
+/* --pattern "steps" */
+void pattern(hid_device* device, char* argv[], int start_index);
+
+#endif
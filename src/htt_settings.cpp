@@ -0,0 +1,388 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "htt_util.h"
+#include "htt_devindex.h"
+#include "htt_settings.h"
+
+const char* SettingNames[SETTING_COUNT] =
+{
+	"rotation", "backlight", "fade", "touchfeedback", "touchdim", "threshold", "calmatrix", "sensitivity"
+};
+
+uint32_t settings_supported(int driver, int fwrev)
+{
+	uint32_t mask = SETTING_BIT(SETTING_ROTATION) | SETTING_BIT(SETTING_BACKLIGHT) | SETTING_BIT(SETTING_TOUCHFEEDBACK);
+	if (fwrev > 11762)
+		mask |= SETTING_BIT(SETTING_FADE) | SETTING_BIT(SETTING_TOUCHDIM);
+	if (driver == TOUCH_MXTxx || driver == TOUCH_GT9xx)
+		mask |= SETTING_BIT(SETTING_SENSITIVITY);
+	if (fwrev > 14684)
+		mask |= SETTING_BIT(SETTING_THRESHOLD);
+	if (driver == TOUCH_RESISTIVE)
+		mask |= SETTING_BIT(SETTING_CALMATRIX);
+	return mask;
+}
+
+uint32_t settings_read(hid_device* handle, uint32_t mask, htt_settings* out)
+{
+	uint32_t failed = 0;
+	for (int field = 0; field < SETTING_COUNT; field++)
+	{
+		if (!(mask & SETTING_BIT(field)))
+			continue;
+		int ok = 1;
+		switch (field)
+		{
+		case SETTING_ROTATION:
+			out->rotation = get_rotation(handle);
+			ok = out->rotation >= 0 && out->rotation < 4;
+			break;
+		case SETTING_BACKLIGHT:
+			out->backlight = get_backlight(handle);
+			ok = out->backlight >= 0;
+			break;
+		case SETTING_FADE:
+			out->fade = get_backlight_fade(handle);
+			ok = out->fade >= 0;
+			break;
+		case SETTING_TOUCHFEEDBACK:
+			out->touchfeedback = get_touchfeedback(handle);
+			ok = out->touchfeedback >= 0 && out->touchfeedback <= 3;
+			break;
+		case SETTING_TOUCHDIM:
+			ok = get_touchdim(handle, out->dim_brightness, out->dim_timeout);
+			break;
+		case SETTING_THRESHOLD:
+			out->threshold = get_touch_threshold(handle);
+			ok = out->threshold >= 0;
+			break;
+		case SETTING_CALMATRIX:
+			ok = get_calmatrix(handle, out->calmatrix, sizeof(out->calmatrix)) == (int)sizeof(out->calmatrix);
+			break;
+		case SETTING_SENSITIVITY:
+			out->sensitivity = get_sensitivity(handle);
+			ok = out->sensitivity >= 0 && out->sensitivity < 3;
+			break;
+		}
+		if (ok)
+		{
+			out->present |= SETTING_BIT(field);
+		}
+		else
+		{
+			out->present &= ~SETTING_BIT(field);
+			failed |= SETTING_BIT(field);
+		}
+	}
+	return failed;
+}
+
+int settings_write(hid_device* handle, int field, const htt_settings* s)
+{
+	switch (field)
+	{
+	case SETTING_ROTATION:
+		return set_rotation(handle, s->rotation);
+	case SETTING_BACKLIGHT:
+		return set_backlight(handle, s->backlight, 1);
+	case SETTING_FADE:
+		return set_fade(handle, s->fade, 1);
+	case SETTING_TOUCHFEEDBACK:
+		return set_touchfeedback(handle, s->touchfeedback);
+	case SETTING_TOUCHDIM:
+	{
+		int brightness[4], timeout[4];
+		memcpy(brightness, s->dim_brightness, sizeof(brightness));
+		memcpy(timeout, s->dim_timeout, sizeof(timeout));
+		return set_touchdim(handle, brightness, timeout);
+	}
+	case SETTING_THRESHOLD:
+		return set_touch_threshold(handle, s->threshold);
+	case SETTING_CALMATRIX:
+		return set_calmatrix(handle, (unsigned char*)s->calmatrix, sizeof(s->calmatrix));
+	case SETTING_SENSITIVITY:
+		return set_sensitivity(handle, s->sensitivity);
+	}
+	return 0;
+}
+
+int settings_equal(int field, const htt_settings* a, const htt_settings* b)
+{
+	switch (field)
+	{
+	case SETTING_ROTATION:
+		return a->rotation == b->rotation;
+	case SETTING_BACKLIGHT:
+		return a->backlight == b->backlight;
+	case SETTING_FADE:
+		return a->fade == b->fade;
+	case SETTING_TOUCHFEEDBACK:
+		return a->touchfeedback == b->touchfeedback;
+	case SETTING_TOUCHDIM:
+		return memcmp(a->dim_brightness, b->dim_brightness, sizeof(a->dim_brightness)) == 0 &&
+			memcmp(a->dim_timeout, b->dim_timeout, sizeof(a->dim_timeout)) == 0;
+	case SETTING_THRESHOLD:
+		return a->threshold == b->threshold;
+	case SETTING_CALMATRIX:
+		return memcmp(a->calmatrix, b->calmatrix, sizeof(a->calmatrix)) == 0;
+	case SETTING_SENSITIVITY:
+		return a->sensitivity == b->sensitivity;
+	}
+	return 0;
+}
+
+void settings_format(int field, const htt_settings* s, char* out, size_t size)
+{
+	switch (field)
+	{
+	case SETTING_ROTATION:
+		snprintf(out, size, "%s", Rotation[s->rotation & 3]);
+		break;
+	case SETTING_BACKLIGHT:
+		snprintf(out, size, "%d", s->backlight);
+		break;
+	case SETTING_FADE:
+		snprintf(out, size, "%d", s->fade);
+		break;
+	case SETTING_TOUCHFEEDBACK:
+		snprintf(out, size, "%d", s->touchfeedback);
+		break;
+	case SETTING_TOUCHDIM:
+		/* same order as the --touchdim arguments */
+		snprintf(out, size, "%d %d %d %d %d %d %d %d",
+			s->dim_timeout[0], s->dim_brightness[0], s->dim_timeout[1], s->dim_brightness[1],
+			s->dim_timeout[2], s->dim_brightness[2], s->dim_timeout[3], s->dim_brightness[3]);
+		break;
+	case SETTING_THRESHOLD:
+		snprintf(out, size, "%d", s->threshold);
+		break;
+	case SETTING_CALMATRIX:
+		for (size_t i = 0; i < sizeof(s->calmatrix) && i * 2 + 2 < size; i++)
+			snprintf(out + i * 2, size - i * 2, "%02x", s->calmatrix[i]);
+		break;
+	case SETTING_SENSITIVITY:
+		snprintf(out, size, "%s", Sensitivity[s->sensitivity < 3 ? s->sensitivity : 0]);
+		break;
+	default:
+		out[0] = 0;
+	}
+}
+
+static int parse_int(const char* value, int min_value, int max_value, int* out)
+{
+	char* end;
+	long v = strtol(value, &end, 10);
+	if (end == value || *end || v < min_value || v > max_value)
+		return 0;
+	*out = (int)v;
+	return 1;
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	c = tolower((unsigned char)c);
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+static int settings_parse(int field, const char* value, htt_settings* s)
+{
+	switch (field)
+	{
+	case SETTING_ROTATION:
+		for (int i = 0; i < 4; i++)
+		{
+			if (strcmp(value, Rotation[i]) == 0)
+			{
+				s->rotation = i;
+				return 1;
+			}
+		}
+		return 0;
+	case SETTING_BACKLIGHT:
+		return parse_int(value, 0, 255, &s->backlight);
+	case SETTING_FADE:
+		return parse_int(value, 0, 0xffff, &s->fade);
+	case SETTING_TOUCHFEEDBACK:
+		return parse_int(value, 0, 3, &s->touchfeedback);
+	case SETTING_TOUCHDIM:
+	{
+		int v[8];
+		if (sscanf(value, "%d %d %d %d %d %d %d %d", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) != 8)
+			return 0;
+		for (int i = 0; i < 4; i++)
+		{
+			if (v[i * 2] < 0 || v[i * 2] > 0xffff || v[i * 2 + 1] < 0 || v[i * 2 + 1] > 255)
+				return 0;
+			s->dim_timeout[i] = v[i * 2];
+			s->dim_brightness[i] = v[i * 2 + 1];
+		}
+		return 1;
+	}
+	case SETTING_THRESHOLD:
+		return parse_int(value, 0, 0xffff, &s->threshold);
+	case SETTING_CALMATRIX:
+		if (strlen(value) != sizeof(s->calmatrix) * 2)
+			return 0;
+		for (size_t i = 0; i < sizeof(s->calmatrix); i++)
+		{
+			int hi = hex_digit(value[i * 2]);
+			int lo = hex_digit(value[i * 2 + 1]);
+			if (hi < 0 || lo < 0)
+				return 0;
+			s->calmatrix[i] = (unsigned char)(hi << 4 | lo);
+		}
+		return 1;
+	case SETTING_SENSITIVITY:
+		for (int i = 0; i < 3; i++)
+		{
+			if (strcmp(value, Sensitivity[i]) == 0)
+			{
+				s->sensitivity = i;
+				return 1;
+			}
+		}
+		return 0;
+	}
+	return 0;
+}
+
+static char* trim(char* s)
+{
+	while (isspace((unsigned char)*s))
+		s++;
+	size_t len = strlen(s);
+	while (len && isspace((unsigned char)s[len - 1]))
+		s[--len] = 0;
+	return s;
+}
+
+int settings_load(const char* path, std::vector<settings_section>& sections)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+	{
+		htt_printf("error opening %s\n", path);
+		return 0;
+	}
+	char buffer[512];
+	int line = 0;
+	int ok = 1;
+	while (ok && fgets(buffer, sizeof(buffer), f))
+	{
+		line++;
+		char* s = trim(buffer);
+		if (!*s || *s == '#')
+			continue;
+		if (*s == '[')
+		{
+			char* end = strchr(s, ']');
+			if (!end)
+			{
+				htt_printf("%s:%d : missing ]\n", path, line);
+				ok = 0;
+				break;
+			}
+			*end = 0;
+			settings_section section;
+			section.selector = trim(s + 1);
+			section.line = line;
+			memset(&section.settings, 0, sizeof(section.settings));
+			sections.push_back(section);
+			continue;
+		}
+		char* eq = strchr(s, '=');
+		if (!eq || sections.empty())
+		{
+			htt_printf("%s:%d : expected [selector] or name=value\n", path, line);
+			ok = 0;
+			break;
+		}
+		*eq = 0;
+		char* name = trim(s);
+		char* value = trim(eq + 1);
+		int field = 0;
+		while (field < SETTING_COUNT && strcmp(name, SettingNames[field]) != 0)
+			field++;
+		if (field == SETTING_COUNT)
+		{
+			htt_printf("%s:%d : unknown setting %s\n", path, line, name);
+			ok = 0;
+			break;
+		}
+		htt_settings* target = &sections.back().settings;
+		if (!settings_parse(field, value, target))
+		{
+			htt_printf("%s:%d : invalid value for %s : %s\n", path, line, name, value);
+			ok = 0;
+			break;
+		}
+		target->present |= SETTING_BIT(field);
+	}
+	fclose(f);
+	return ok;
+}
+
+static void merge(htt_settings* into, const htt_settings* from)
+{
+	for (int field = 0; field < SETTING_COUNT; field++)
+	{
+		if (!(from->present & SETTING_BIT(field)))
+			continue;
+		switch (field)
+		{
+		case SETTING_ROTATION: into->rotation = from->rotation; break;
+		case SETTING_BACKLIGHT: into->backlight = from->backlight; break;
+		case SETTING_FADE: into->fade = from->fade; break;
+		case SETTING_TOUCHFEEDBACK: into->touchfeedback = from->touchfeedback; break;
+		case SETTING_TOUCHDIM:
+			memcpy(into->dim_brightness, from->dim_brightness, sizeof(into->dim_brightness));
+			memcpy(into->dim_timeout, from->dim_timeout, sizeof(into->dim_timeout));
+			break;
+		case SETTING_THRESHOLD: into->threshold = from->threshold; break;
+		case SETTING_CALMATRIX: memcpy(into->calmatrix, from->calmatrix, sizeof(into->calmatrix)); break;
+		case SETTING_SENSITIVITY: into->sensitivity = from->sensitivity; break;
+		}
+		into->present |= SETTING_BIT(field);
+	}
+}
+
+int settings_for_device(const std::vector<settings_section>& sections, size_t index, htt_settings* merged)
+{
+	int matched = 0;
+	memset(merged, 0, sizeof(*merged));
+	for (size_t i = 0; i < sections.size(); i++)
+	{
+		const char* selector = sections[i].selector.c_str();
+		size_t found;
+		if (strcmp(selector, "all") != 0 && (device_index_lookup(selector, &found) <= 0 || found != index))
+			continue;
+		merge(merged, &sections[i].settings);
+		matched++;
+	}
+	return matched;
+}
+
+void settings_append(std::string& out, const char* selector, const htt_settings* s)
+{
+	char value[160];
+	out += "[";
+	out += selector;
+	out += "]\n";
+	for (int field = 0; field < SETTING_COUNT; field++)
+	{
+		if (!(s->present & SETTING_BIT(field)))
+			continue;
+		settings_format(field, s, value, sizeof(value));
+		out += SettingNames[field];
+		out += "=";
+		out += value;
+		out += "\n";
+	}
+	out += "\n";
+}
@@ -0,0 +1,77 @@
+#ifndef HTT_SETTINGS_H
+#define HTT_SETTINGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "hidapi.h"
+
+/* Every setting of a unit that can be read back, as used by --snapshot,
+ * --restore and --check. */
+
+enum
+{
+	SETTING_ROTATION,
+	SETTING_BACKLIGHT,
+	SETTING_FADE,
+	SETTING_TOUCHFEEDBACK,
+	SETTING_TOUCHDIM,
+	SETTING_THRESHOLD,
+	SETTING_CALMATRIX,
+	SETTING_SENSITIVITY,  /* reboots the unit, keep it last */
+	SETTING_COUNT
+};
+
+#define SETTING_BIT(field) (1u << (field))
+#define SETTING_ALL        ((1u << SETTING_COUNT) - 1)
+
+typedef struct
+{
+	uint32_t present;  /* SETTING_BIT() of the fields holding a value */
+	int rotation;      /* index into Rotation[] */
+	int backlight;
+	int fade;
+	int touchfeedback;
+	int dim_brightness[4];
+	int dim_timeout[4];
+	int threshold;
+	unsigned char calmatrix[56];
+	int sensitivity;   /* index into Sensitivity[] */
+} htt_settings;
+
+/* A [selector] section of a snapshot or profile file, [all] applies to every unit. */
+typedef struct
+{
+	std::string selector;
+	int line;
+	htt_settings settings;
+} settings_section;
+
+extern const char* SettingNames[SETTING_COUNT];
+
+/* Fields this unit supports, going by the same driver / firmware checks as
+ * scan_internal(). */
+uint32_t settings_supported(int driver, int fwrev);
+
+/* Reads the fields in mask, one feature report per field. Fields that can't
+ * be read are left out of present. Returns the fields that failed. */
+uint32_t settings_read(hid_device* handle, uint32_t mask, htt_settings* out);
+
+/* Writes a single field, returns 1 on success. */
+int settings_write(hid_device* handle, int field, const htt_settings* settings);
+
+int settings_equal(int field, const htt_settings* a, const htt_settings* b);
+void settings_format(int field, const htt_settings* settings, char* out, size_t size);
+
+/* Loads a snapshot / profile, returns 0 (and prints why) when it can't be parsed. */
+int settings_load(const char* path, std::vector<settings_section>& sections);
+
+/* Merges every section that applies to the unit, later sections win. Returns
+ * the number of sections that matched. */
+int settings_for_device(const std::vector<settings_section>& sections, size_t index, htt_settings* merged);
+
+/* Appends a section with the fields in settings to out. */
+void settings_append(std::string& out, const char* selector, const htt_settings* settings);
+
+#endif
@@ -0,0 +1,308 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "htt_util.h"
+#include "htt_devindex.h"
+#include "htt_fanout.h"
+#include "htt_settings.h"
+#include "htt_snapshot.h"
+
+typedef struct
+{
+	std::vector<htt_settings> settings;
+	std::vector<int> driver;
+	std::vector<int> fwrev;
+} snapshot_job;
+
+static std::vector<size_t> all_devices(void)
+{
+	std::vector<size_t> indices(g_device_count);
+	for (size_t i = 0; i < g_device_count; i++)
+		indices[i] = i;
+	return indices;
+}
+
+static void snapshot_device(size_t index, void* context)
+{
+	snapshot_job* job = (snapshot_job*)context;
+	hid_device* handle = g_handles[index];
+	if (!handle)
+	{
+		htt_printf("Device %zu : not available.\n", index);
+		g_failures++;
+		return;
+	}
+	int driver = g_identities[index].driver;
+	int fwrev = g_identities[index].fwrev;
+	if (driver < 0)
+	{
+		htt_printf("Device %zu : Error retrieving driver type.\n", index);
+		g_failures++;
+		return;
+	}
+	htt_settings* s = &job->settings[index];
+	uint32_t failed = settings_read(handle, settings_supported(driver, fwrev), s);
+	job->driver[index] = driver;
+	job->fwrev[index] = fwrev;
+	for (int field = 0; field < SETTING_COUNT; field++)
+	{
+		if (failed & SETTING_BIT(field))
+		{
+			htt_printf("Device %zu : error reading %s.\n", index, SettingNames[field]);
+			g_failures++;
+		}
+	}
+	htt_printf("Device %zu : %s\n", index, failed ? "Failed." : "Success!");
+}
+
+void snapshot(hid_device* device, char* argv[], int start_index)
+{
+	const char* path = argv[start_index + 1];
+	if (!g_device_count)
+	{
+		htt_printf("No HTT detected\n");
+		g_failures++;
+		return;
+	}
+
+	snapshot_job job;
+	job.settings.resize(g_device_count);
+	memset(&job.settings[0], 0, sizeof(htt_settings) * g_device_count);
+	job.driver.resize(g_device_count, 0);
+	job.fwrev.resize(g_device_count, 0);
+	std::vector<size_t> indices = all_devices();
+	fflush(stdout);
+	std::vector<int> failed(g_device_count, 0);
+	fanout_for_each(&indices[0], indices.size(), snapshot_device, &job, &failed[0]);
+
+	std::string out = "# htt_util snapshot\n\n";
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		if (!job.settings[i].present)
+			continue;
+		char selector[128];
+		char comment[128];
+		device_index_selector(&g_identities[i], selector, sizeof(selector));
+		int driver = job.driver[i] >= TOUCH_NONE && job.driver[i] <= TOUCH_ILI25xx ? job.driver[i] : TOUCH_NONE;
+		snprintf(comment, sizeof(comment), "# device %zu, firmware rev %d, %s driver\n", i, job.fwrev[i], TouchTypes[driver]);
+		out += comment;
+		settings_append(out, selector, &job.settings[i]);
+	}
+
+	FILE* f = fopen(path, "w");
+	if (!f)
+	{
+		htt_printf("error opening %s\n", path);
+		g_failures++;
+		return;
+	}
+	size_t written = fwrite(out.data(), 1, out.size(), f);
+	if (fclose(f) != 0 || written != out.size())
+	{
+		htt_printf("error writing %s\n", path);
+		g_failures++;
+		return;
+	}
+	htt_printf("Snapshot written to %s\n", path);
+}
+
+/* Fields of wanted the unit has, going by the driver and firmware read
+ * when it was enumerated. The others are listed and left out, a unit with
+ * older firmware or another driver doesn't have those reports at all.
+ * Returns 0 when the driver couldn't be read. */
+static int supported_fields(size_t index, uint32_t wanted, uint32_t* fields)
+{
+	int driver = g_identities[index].driver;
+	int fwrev = g_identities[index].fwrev;
+	if (driver < 0)
+	{
+		htt_printf("Device %zu : Error retrieving driver type.\n", index);
+		g_failures++;
+		return 0;
+	}
+	uint32_t unsupported = wanted & ~settings_supported(driver, fwrev);
+	if (driver > TOUCH_ILI25xx)
+		driver = TOUCH_NONE;
+	for (int field = 0; field < SETTING_COUNT; field++)
+	{
+		if (unsupported & SETTING_BIT(field))
+			htt_printf("Device %zu : %s not supported (firmware rev %d, %s driver), skipped.\n", index,
+				SettingNames[field], fwrev, TouchTypes[driver]);
+	}
+	*fields = wanted & ~unsupported;
+	return 1;
+}
+
+static void restore_device(size_t index, void* context)
+{
+	const std::vector<settings_section>* sections = (const std::vector<settings_section>*)context;
+	hid_device* handle = g_handles[index];
+	htt_settings target;
+	if (!settings_for_device(*sections, index, &target) || !target.present)
+	{
+		htt_printf("Device %zu : not in the snapshot, skipped.\n", index);
+		return;
+	}
+	if (!handle)
+	{
+		htt_printf("Device %zu : not available.\n", index);
+		g_failures++;
+		return;
+	}
+
+	uint32_t fields;
+	if (!supported_fields(index, target.present, &fields))
+		return;
+	htt_settings current;
+	memset(&current, 0, sizeof(current));
+	settings_read(handle, fields, &current);
+
+	int unchanged = 0;
+	for (int field = 0; field < SETTING_COUNT; field++)
+	{
+		if (!(fields & SETTING_BIT(field)))
+			continue;
+		if ((current.present & SETTING_BIT(field)) && settings_equal(field, &current, &target))
+		{
+			unchanged++;
+			continue;
+		}
+		char from[160] = "?";
+		char to[160];
+		if (current.present & SETTING_BIT(field))
+			settings_format(field, &current, from, sizeof(from));
+		settings_format(field, &target, to, sizeof(to));
+		/* sensitivity is the last field, the unit comes back with a new
+		 * handle for whatever runs after the restore */
+		hotplug_monitor* monitor = field == SETTING_SENSITIVITY ? hotplug_arm() : NULL;
+		int success = settings_write(handle, field, &target);
+		if (field == SETTING_CALMATRIX)
+			htt_printf("Device %zu : calmatrix : %s\n", index, result_string(success));
+		else
+			htt_printf("Device %zu : %s %s -> %s : %s\n", index, SettingNames[field], from, to, result_string(success));
+		if (success && field == SETTING_CALMATRIX)
+			htt_printf("Device %zu : reconnect the USB cable to load the new calibration.\n", index);
+		if (success && field == SETTING_SENSITIVITY)
+		{
+			htt_printf("Device %zu : the sensitivity command reboots the unit.\n", index);
+			reboot_barrier(index, monitor);
+		}
+		else
+			hotplug_disarm(monitor);
+	}
+	htt_printf("Device %zu : %d settings already matched.\n", index, unchanged);
+}
+
+void restore(hid_device* device, char* argv[], int start_index)
+{
+	const char* path = argv[start_index + 1];
+	std::vector<settings_section> sections;
+	if (!settings_load(path, sections))
+	{
+		g_failures++;
+		return;
+	}
+	for (size_t i = 0; i < sections.size(); i++)
+	{
+		size_t index;
+		const char* selector = sections[i].selector.c_str();
+		if (strcmp(selector, "all") != 0 && device_index_lookup(selector, &index) <= 0)
+			htt_printf("%s:%d : no HTT matches [%s]\n", path, sections[i].line, selector);
+	}
+	if (!g_device_count)
+	{
+		htt_printf("No HTT detected\n");
+		g_failures++;
+		return;
+	}
+	std::vector<size_t> indices = all_devices();
+	fflush(stdout);
+	fanout_for_each(&indices[0], indices.size(), restore_device, &sections, NULL);
+}
+
+static void check_device(size_t index, void* context)
+{
+	const std::vector<settings_section>* sections = (const std::vector<settings_section>*)context;
+	hid_device* handle = g_handles[index];
+	htt_settings expected;
+	if (!settings_for_device(*sections, index, &expected) || !expected.present)
+		return;
+	if (!handle)
+	{
+		htt_printf("Device %zu : not available.\n", index);
+		g_failures++;
+		return;
+	}
+
+	uint32_t fields;
+	if (!supported_fields(index, expected.present, &fields))
+		return;
+	htt_settings current;
+	memset(&current, 0, sizeof(current));
+	uint32_t failed = settings_read(handle, fields, &current);
+	int drifted = 0;
+	for (int field = 0; field < SETTING_COUNT; field++)
+	{
+		if (!(fields & SETTING_BIT(field)))
+			continue;
+		if (failed & SETTING_BIT(field))
+		{
+			htt_printf("Device %zu : %s could not be read.\n", index, SettingNames[field]);
+			drifted++;
+			continue;
+		}
+		if (settings_equal(field, &current, &expected))
+			continue;
+		char is[160];
+		char should[160];
+		settings_format(field, &current, is, sizeof(is));
+		settings_format(field, &expected, should, sizeof(should));
+		htt_printf("Device %zu : %s is %s, expected %s\n", index, SettingNames[field], is, should);
+		drifted++;
+	}
+	if (drifted)
+		g_failures += drifted;
+	else
+		htt_printf("Device %zu : OK\n", index);
+}
+
+void check(hid_device* device, char* argv[], int start_index)
+{
+	const char* path = argv[start_index + 1];
+	std::vector<settings_section> sections;
+	if (!settings_load(path, sections))
+	{
+		g_failures++;
+		return;
+	}
+	/* a unit the reference expects but that is gone is drift as well */
+	for (size_t i = 0; i < sections.size(); i++)
+	{
+		size_t index;
+		const char* selector = sections[i].selector.c_str();
+		if (strcmp(selector, "all") != 0 && device_index_lookup(selector, &index) <= 0)
+		{
+			htt_printf("%s:%d : no HTT matches [%s]\n", path, sections[i].line, selector);
+			g_failures++;
+		}
+	}
+
+	std::vector<size_t> indices;
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		htt_settings expected;
+		if (settings_for_device(sections, i, &expected) && expected.present)
+			indices.push_back(i);
+	}
+	if (indices.empty())
+	{
+		htt_printf("No HTT to check.\n");
+		g_failures++;
+		return;
+	}
+	fflush(stdout);
+	size_t drifted = fanout_for_each(&indices[0], indices.size(), check_device, &sections, NULL);
+	htt_printf("%zu units checked, %zu drifted.\n", indices.size(), drifted);
+}
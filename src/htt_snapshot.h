@@ -0,0 +1,22 @@
+#ifndef HTT_SNAPSHOT_H
+#define HTT_SNAPSHOT_H
+
+#include "hidapi.h"
+
+/* --snapshot [filename]
+ * Saves every setting of every unit to a text file, one [selector] section
+ * per unit. */
+void snapshot(hid_device* device, char* argv[], int start_index);
+
+/* --restore [filename]
+ * Writes a snapshot back to the units it names, all units at once. Only the
+ * settings that differ from the unit are written. */
+void restore(hid_device* device, char* argv[], int start_index);
+
+/* --check [profile|snapshot]
+ * Compares the units with a snapshot or a hand written profile (same format,
+ * only the settings of interest). Only the settings named in the file are
+ * read, one feature report each. Drift counts as a failure. */
+void check(hid_device* device, char* argv[], int start_index);
+
+#endif
@@ -0,0 +1,172 @@
+#include <string.h>
+#include "htt_timerwheel.h"
+
+#define SLOT_MASK (TIMERWHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(level) ((level) * TIMERWHEEL_BITS)
+
+void timerwheel_init(timer_wheel* wheel, uint64_t tick_ns, uint64_t now_ns)
+{
+	memset(wheel, 0, sizeof(*wheel));
+	wheel->tick_ns = tick_ns ? tick_ns : 1;
+	wheel->origin_ns = now_ns;
+}
+
+void timer_init(timer_node* timer, timer_callback callback, void* context)
+{
+	memset(timer, 0, sizeof(*timer));
+	timer->callback = callback;
+	timer->context = context;
+}
+
+int timer_pending(const timer_node* timer)
+{
+	return timer->pprev != NULL;
+}
+
+static void unlink_timer(timer_wheel* wheel, timer_node* timer)
+{
+	*timer->pprev = timer->next;
+	if (timer->next)
+		timer->next->pprev = timer->pprev;
+	timer->next = NULL;
+	timer->pprev = NULL;
+	wheel->count--;
+}
+
+static void place(timer_wheel* wheel, timer_node* timer)
+{
+	uint64_t delta = timer->expires - wheel->now;
+	int level = 0;
+	while (level < TIMERWHEEL_LEVELS - 1 && delta >= (1ull << LEVEL_SHIFT(level + 1)))
+		level++;
+	uint64_t at = timer->expires;
+	/* out of range, park it as far out as the last level goes */
+	if (delta >= (1ull << LEVEL_SHIFT(TIMERWHEEL_LEVELS)))
+		at = wheel->now + (1ull << LEVEL_SHIFT(TIMERWHEEL_LEVELS)) - 1;
+	unsigned slot = (unsigned)(at >> LEVEL_SHIFT(level)) & SLOT_MASK;
+
+	timer_node** head = &wheel->slots[level][slot];
+	timer->next = *head;
+	if (*head)
+		(*head)->pprev = &timer->next;
+	*head = timer;
+	timer->pprev = head;
+	wheel->occupied[level] |= 1ull << slot;
+	wheel->count++;
+}
+
+void timerwheel_add(timer_wheel* wheel, timer_node* timer, uint64_t expires_ns)
+{
+	if (timer->pprev)
+		unlink_timer(wheel, timer);
+	uint64_t ticks = expires_ns > wheel->origin_ns ? (expires_ns - wheel->origin_ns + wheel->tick_ns - 1) / wheel->tick_ns : 0;
+	timer->expires = ticks > wheel->now ? ticks : wheel->now + 1;
+	place(wheel, timer);
+}
+
+void timerwheel_remove(timer_wheel* wheel, timer_node* timer)
+{
+	if (timer->pprev)
+		unlink_timer(wheel, timer);
+}
+
+static void clear_if_empty(timer_wheel* wheel, int level, unsigned slot)
+{
+	if (!wheel->slots[level][slot])
+		wheel->occupied[level] &= ~(1ull << slot);
+}
+
+/* Moves the timers of the current slot of a level down the hierarchy. */
+static void cascade(timer_wheel* wheel, int level)
+{
+	unsigned slot = (unsigned)(wheel->now >> LEVEL_SHIFT(level)) & SLOT_MASK;
+	timer_node* list = wheel->slots[level][slot];
+	wheel->slots[level][slot] = NULL;
+	wheel->occupied[level] &= ~(1ull << slot);
+	while (list)
+	{
+		timer_node* timer = list;
+		list = timer->next;
+		timer->pprev = NULL;
+		timer->next = NULL;
+		wheel->count--;
+		place(wheel, timer);
+	}
+}
+
+/* Next tick after now where something happens on a level, or UINT64_MAX. */
+static uint64_t level_next_tick(const timer_wheel* wheel, int level)
+{
+	uint64_t mask = wheel->occupied[level];
+	if (!mask)
+		return UINT64_MAX;
+	int shift = LEVEL_SHIFT(level);
+	unsigned current = (unsigned)(wheel->now >> shift) & SLOT_MASK;
+	/* rotate so bit 0 is the slot after the current one */
+	unsigned start = (current + 1) & SLOT_MASK;
+	uint64_t rotated = start ? (mask >> start) | (mask << (TIMERWHEEL_SLOTS - start)) : mask;
+	unsigned distance = 1;
+	while (!(rotated & 1))
+	{
+		rotated >>= 1;
+		distance++;
+	}
+	uint64_t block = (wheel->now >> shift) + distance;
+	return block << shift;
+}
+
+uint64_t timerwheel_next_ns(const timer_wheel* wheel)
+{
+	if (!wheel->count)
+		return UINT64_MAX;
+	uint64_t next = UINT64_MAX;
+	for (int level = 0; level < TIMERWHEEL_LEVELS; level++)
+	{
+		uint64_t tick = level_next_tick(wheel, level);
+		if (tick < next)
+			next = tick;
+	}
+	return wheel->origin_ns + next * wheel->tick_ns;
+}
+
+size_t timerwheel_advance(timer_wheel* wheel, uint64_t now_ns)
+{
+	uint64_t target = now_ns > wheel->origin_ns ? (now_ns - wheel->origin_ns) / wheel->tick_ns : 0;
+	size_t fired = 0;
+	while (wheel->now < target)
+	{
+		/* skip straight to the next tick with work instead of walking every tick */
+		uint64_t next = UINT64_MAX;
+		for (int level = 0; level < TIMERWHEEL_LEVELS; level++)
+		{
+			uint64_t tick = level_next_tick(wheel, level);
+			if (tick < next)
+				next = tick;
+		}
+		if (next > target)
+		{
+			wheel->now = target;
+			break;
+		}
+		wheel->now = next;
+
+		for (int level = 1; level < TIMERWHEEL_LEVELS; level++)
+		{
+			if (wheel->now & ((1ull << LEVEL_SHIFT(level)) - 1))
+				break;
+			cascade(wheel, level);
+		}
+
+		unsigned slot = (unsigned)wheel->now & SLOT_MASK;
+		timer_node* timer;
+		while ((timer = wheel->slots[0][slot]) != NULL)
+		{
+			unlink_timer(wheel, timer);
+			clear_if_empty(wheel, 0, slot);
+			fired++;
+			timer->callback(timer, now_ns);
+		}
+		clear_if_empty(wheel, 0, slot);
+	}
+	return fired;
+}
@@ -0,0 +1,57 @@
+#ifndef HTT_TIMERWHEEL_H
+#define HTT_TIMERWHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hierarchical timer wheel, 4 levels of 64 slots.
+ *
+ * Timers are intrusive nodes owned by the caller, adding, removing and
+ * firing a timer doesn't allocate. Level n holds the timers due within 64^(n+1)
+ * ticks and is cascaded into the level below when its slot comes up, so every
+ * timer is touched at most once per level. Timers further out than 64^4 ticks
+ * are parked in the last level and cascaded again until they are in range. */
+
+#define TIMERWHEEL_LEVELS 4
+#define TIMERWHEEL_BITS   6
+#define TIMERWHEEL_SLOTS  (1 << TIMERWHEEL_BITS)
+
+typedef struct timer_node timer_node;
+typedef void (*timer_callback)(timer_node* timer, uint64_t now_ns);
+
+struct timer_node
+{
+	timer_node* next;
+	timer_node** pprev;  /* NULL when not scheduled */
+	uint64_t expires;    /* in ticks */
+	timer_callback callback;
+	void* context;
+};
+
+typedef struct
+{
+	uint64_t now;        /* current tick, everything up to it has fired */
+	uint64_t tick_ns;
+	uint64_t origin_ns;  /* time of tick 0 */
+	size_t count;
+	uint64_t occupied[TIMERWHEEL_LEVELS];  /* bit n set when slot n holds timers */
+	timer_node* slots[TIMERWHEEL_LEVELS][TIMERWHEEL_SLOTS];
+} timer_wheel;
+
+void timerwheel_init(timer_wheel* wheel, uint64_t tick_ns, uint64_t now_ns);
+void timer_init(timer_node* timer, timer_callback callback, void* context);
+
+/* (Re)schedules a timer, a time in the past fires on the next tick. */
+void timerwheel_add(timer_wheel* wheel, timer_node* timer, uint64_t expires_ns);
+void timerwheel_remove(timer_wheel* wheel, timer_node* timer);
+int timer_pending(const timer_node* timer);
+
+/* Fires every timer due at now_ns, returns how many fired. Callbacks may add
+ * and remove timers. */
+size_t timerwheel_advance(timer_wheel* wheel, uint64_t now_ns);
+
+/* Earliest time the wheel needs to be advanced, either a timer expiring or
+ * a slot that has to be cascaded. UINT64_MAX when no timer is scheduled. */
+uint64_t timerwheel_next_ns(const timer_wheel* wheel);
+
+#endif
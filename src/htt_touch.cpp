@@ -0,0 +1,489 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/hidraw.h>
+#include <vector>
+#include "htt_util.h"
+#include "htt_input.h"
+#include "htt_touch.h"
+#include "htt_transform.h"
+
+#define USAGE(page, id) (((uint32_t)(page) << 16) | (id))
+
+#define USAGE_X             USAGE(0x01, 0x30)
+#define USAGE_Y             USAGE(0x01, 0x31)
+#define USAGE_DIGITIZERS    0x0d
+#define USAGE_STYLUS        USAGE(0x0d, 0x20)
+#define USAGE_FINGER        USAGE(0x0d, 0x22)
+#define USAGE_TIP_PRESSURE  USAGE(0x0d, 0x30)
+#define USAGE_TIP_SWITCH    USAGE(0x0d, 0x42)
+#define USAGE_CONTACT_ID    USAGE(0x0d, 0x51)
+#define USAGE_CONTACT_COUNT USAGE(0x0d, 0x54)
+
+#define MAX_USAGES 32
+
+typedef struct
+{
+	uint32_t usage_page;
+	int32_t logical_min;
+	int32_t logical_max;
+	uint32_t report_size;
+	uint32_t report_count;
+	int report_id;
+} parser_globals;
+
+static uint32_t item_value(const unsigned char* data, int size)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < size; i++)
+		value |= (uint32_t)data[i] << (8 * i);
+	return value;
+}
+
+static int32_t item_signed(const unsigned char* data, int size)
+{
+	uint32_t value = item_value(data, size);
+	if (size == 1)
+		return (int8_t)value;
+	if (size == 2)
+		return (int16_t)value;
+	return (int32_t)value;
+}
+
+static int field_index(uint32_t usage)
+{
+	switch (usage)
+	{
+	case USAGE_TIP_SWITCH: return TOUCH_FIELD_TIP;
+	case USAGE_CONTACT_ID: return TOUCH_FIELD_ID;
+	case USAGE_X: return TOUCH_FIELD_X;
+	case USAGE_Y: return TOUCH_FIELD_Y;
+	case USAGE_TIP_PRESSURE: return TOUCH_FIELD_PRESSURE;
+	}
+	return -1;
+}
+
+static void add_op(touch_layout* layout, const touch_field* field, int value)
+{
+	touch_op* op = &layout->ops[layout->op_count++];
+	op->byte = field->offset / 8;
+	op->end = (field->offset + field->bits + 7) / 8;
+	op->shift = field->offset % 8;
+	op->value = (uint8_t)value;
+	op->mask = field->bits >= 32 ? 0xffffffffu : (1u << field->bits) - 1;
+	op->sign = field->is_signed && field->bits < 32 ? 1u << (field->bits - 1) : 0;
+}
+
+/* Turns the fields into extraction ops sorted by their place in the report
+ * and sets the values of the fields a report doesn't have: a contact
+ * without tip switch is down, one without contact ID is named after its
+ * slot. */
+static void compile_layout(touch_layout* layout)
+{
+	layout->op_count = 0;
+	memset(layout->defaults, 0, sizeof(layout->defaults));
+	for (int slot = 0; slot < layout->slots; slot++)
+	{
+		int32_t* defaults = &layout->defaults[slot * TOUCH_FIELD_COUNT];
+		defaults[TOUCH_FIELD_TIP] = 1;
+		defaults[TOUCH_FIELD_ID] = slot;
+		for (int field = 0; field < TOUCH_FIELD_COUNT; field++)
+			if (layout->fields[slot][field].bits)
+				add_op(layout, &layout->fields[slot][field], slot * TOUCH_FIELD_COUNT + field);
+	}
+	if (layout->contact_count.bits)
+		add_op(layout, &layout->contact_count, TOUCH_VALUE_CONTACT_COUNT);
+	for (int i = 1; i < layout->op_count; i++)
+	{
+		touch_op op = layout->ops[i];
+		int j = i;
+		for (; j > 0 && layout->ops[j - 1].byte > op.byte; j--)
+			layout->ops[j] = layout->ops[j - 1];
+		layout->ops[j] = op;
+	}
+}
+
+int touch_layout_parse(const unsigned char* descriptor, size_t size, touch_layout* layout)
+{
+	parser_globals globals;
+	parser_globals stack[4];
+	int stack_depth = 0;
+	uint32_t usages[MAX_USAGES];
+	int usage_count = 0;
+	uint32_t usage_min = 0, usage_max = 0;
+	int has_range = 0;
+	int depth = 0;
+	int digitizer_depth = -1;   /* depth of the digitizer application collection */
+	int slot_depth = -1;        /* depth of the finger collection being filled */
+	int slot = -1;
+	uint16_t offsets[256];      /* next input bit per report ID */
+	int numbered = 0;
+
+	memset(&globals, 0, sizeof(globals));
+	memset(layout, 0, sizeof(*layout));
+	memset(offsets, 0, sizeof(offsets));
+	layout->report_id = -2;     /* not found yet */
+
+	size_t pos = 0;
+	while (pos < size)
+	{
+		unsigned char prefix = descriptor[pos];
+		if (prefix == 0xfe)
+		{
+			/* long item, nothing of interest */
+			if (pos + 1 >= size)
+				break;
+			pos += 3 + descriptor[pos + 1];
+			continue;
+		}
+		int data_size = (prefix & 3) == 3 ? 4 : (prefix & 3);
+		int type = (prefix >> 2) & 3;
+		int tag = prefix >> 4;
+		if (pos + 1 + data_size > size)
+			break;
+		const unsigned char* data = descriptor + pos + 1;
+		uint32_t value = item_value(data, data_size);
+		pos += 1 + data_size;
+
+		if (type == 1)
+		{
+			switch (tag)
+			{
+			case 0x0: globals.usage_page = value; break;
+			case 0x1: globals.logical_min = item_signed(data, data_size); break;
+			case 0x2: globals.logical_max = globals.logical_min < 0 ? item_signed(data, data_size) : (int32_t)value; break;
+			case 0x7: globals.report_size = value; break;
+			case 0x8:
+				globals.report_id = (int)(value & 0xff);
+				if (!numbered)
+					memset(offsets, 0, sizeof(offsets));
+				numbered = 1;
+				if (!offsets[globals.report_id])
+					offsets[globals.report_id] = 8;
+				break;
+			case 0x9: globals.report_count = value; break;
+			case 0xa:
+				if (stack_depth < 4)
+					stack[stack_depth++] = globals;
+				break;
+			case 0xb:
+				if (stack_depth)
+					globals = stack[--stack_depth];
+				break;
+			}
+			continue;
+		}
+		if (type == 2)
+		{
+			uint32_t usage = data_size == 4 ? value : USAGE(globals.usage_page, value);
+			if (tag == 0x0 && usage_count < MAX_USAGES)
+				usages[usage_count++] = usage;
+			else if (tag == 0x1)
+			{
+				usage_min = usage;
+				has_range = 1;
+			}
+			else if (tag == 0x2)
+				usage_max = usage;
+			continue;
+		}
+		if (type != 0)
+			continue;
+
+		if (tag == 0xa)
+		{
+			uint32_t usage = usage_count ? usages[0] : 0;
+			/* application collection of the digitizer page */
+			if (value == 0x01 && (usage >> 16) == USAGE_DIGITIZERS && digitizer_depth < 0 &&
+				layout->report_id == -2)
+				digitizer_depth = depth;
+			if (digitizer_depth >= 0 && slot_depth < 0 && (usage == USAGE_FINGER || usage == USAGE_STYLUS) &&
+				layout->slots < TOUCH_MAX_CONTACTS)
+			{
+				slot_depth = depth;
+				slot = layout->slots++;
+			}
+			depth++;
+		}
+		else if (tag == 0xc)
+		{
+			if (depth)
+				depth--;
+			if (depth == slot_depth)
+			{
+				slot_depth = -1;
+				slot = -1;
+			}
+			if (depth == digitizer_depth)
+			{
+				digitizer_depth = -1;
+				/* the first digitizer collection with a position is the one */
+				if (layout->report_id != -2)
+					break;
+				layout->slots = 0;
+				memset(&layout->contact_count, 0, sizeof(layout->contact_count));
+				memset(layout->fields, 0, sizeof(layout->fields));
+			}
+		}
+		else if (tag == 0x8)
+		{
+			int id = numbered ? globals.report_id : 0;
+			uint32_t bits = globals.report_size;
+			int is_variable = (value & 0x02) != 0;
+			int is_constant = (value & 0x01) != 0;
+			for (uint32_t i = 0; i < globals.report_count; i++)
+			{
+				uint16_t offset = offsets[id];
+				offsets[id] += (uint16_t)bits;
+				if (digitizer_depth < 0 || is_constant || !is_variable)
+					continue;
+				uint32_t usage;
+				if (has_range)
+					usage = usage_min + i <= usage_max ? usage_min + i : usage_max;
+				else if (usage_count)
+					usage = usages[i < (uint32_t)usage_count ? i : usage_count - 1];
+				else
+					continue;
+
+				touch_field field;
+				field.offset = offset;
+				field.bits = (uint8_t)(bits > 32 ? 32 : bits);
+				field.is_signed = globals.logical_min < 0;
+				if (usage == USAGE_CONTACT_COUNT)
+				{
+					layout->contact_count = field;
+					continue;
+				}
+				int index = field_index(usage);
+				if (index < 0)
+					continue;
+				int target = slot;
+				if (target < 0)
+				{
+					/* single touch panel, fields straight in the application collection */
+					if (!layout->slots)
+						layout->slots = 1;
+					target = 0;
+				}
+				if (layout->fields[target][index].bits)
+					continue;
+				layout->fields[target][index] = field;
+				if (layout->report_id == -2 && (index == TOUCH_FIELD_X || index == TOUCH_FIELD_Y))
+					layout->report_id = numbered ? id : -1;
+				if (target == 0 && index == TOUCH_FIELD_X)
+				{
+					layout->x_min = globals.logical_min;
+					layout->x_max = globals.logical_max;
+				}
+				else if (target == 0 && index == TOUCH_FIELD_Y)
+				{
+					layout->y_min = globals.logical_min;
+					layout->y_max = globals.logical_max;
+				}
+				else if (target == 0 && index == TOUCH_FIELD_PRESSURE)
+					layout->pressure_max = globals.logical_max;
+			}
+		}
+		/* local items only last until the next main item */
+		usage_count = 0;
+		has_range = 0;
+	}
+	if (layout->report_id == -2)
+		return 0;
+	int id = layout->report_id < 0 ? 0 : layout->report_id;
+	layout->report_bytes = (offsets[id] + 7) / 8;
+	compile_layout(layout);
+	return 1;
+}
+
+int touch_layout_load(int fd, touch_layout* layout)
+{
+	int size = 0;
+	struct hidraw_report_descriptor descriptor;
+	if (ioctl(fd, HIDIOCGRDESCSIZE, &size) < 0 || size <= 0 || size > HID_MAX_DESCRIPTOR_SIZE)
+		return 0;
+	descriptor.size = size;
+	if (ioctl(fd, HIDIOCGRDESC, &descriptor) < 0)
+		return 0;
+	return touch_layout_parse(descriptor.value, descriptor.size, layout);
+}
+
+/* Fields of a report that is cut short read as 0 */
+static inline uint64_t load_tail(const unsigned char* report, int length, const touch_op* op)
+{
+	uint64_t raw = 0;
+	if (op->end > length)
+		return 0;
+	for (int i = op->end - 1; i >= op->byte; i--)
+		raw = (raw << 8) | report[i];
+	return raw;
+}
+
+static inline uint64_t load_le64(const unsigned char* p)
+{
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	uint64_t raw;
+	memcpy(&raw, p, sizeof(raw));
+	return raw;
+#else
+	uint64_t raw = 0;
+	for (int i = 7; i >= 0; i--)
+		raw = (raw << 8) | p[i];
+	return raw;
+#endif
+}
+
+int touch_decode(const touch_layout* layout, const unsigned char* report, int length, touch_frame* frame)
+{
+	if (layout->report_id >= 0 && (length < 1 || report[0] != layout->report_id))
+		return -1;
+	int32_t values[TOUCH_VALUE_COUNT];
+	memcpy(values, layout->defaults, sizeof(values));
+	const touch_op* op = layout->ops;
+	const touch_op* ops_end = op + layout->op_count;
+	for (; op < ops_end; op++)
+	{
+		uint64_t raw = op->byte + 8 <= length ? load_le64(report + op->byte) : load_tail(report, length, op);
+		uint32_t value = (uint32_t)(raw >> op->shift) & op->mask;
+		values[op->value] = (int32_t)((value ^ op->sign) - op->sign);
+	}
+
+	int slots = layout->slots;
+	int count = values[TOUCH_VALUE_CONTACT_COUNT];
+	if (count > 0 && count < slots)
+		slots = count;
+	frame->count = 0;
+	for (int slot = 0; slot < slots; slot++)
+	{
+		const int32_t* fields = &values[slot * TOUCH_FIELD_COUNT];
+		/* a slot that is past the contact count in hybrid mode, or an unused
+		 * slot of a report that lists all of them, has nothing to say */
+		if (!layout->fields[slot][TOUCH_FIELD_X].bits ||
+			(!fields[TOUCH_FIELD_TIP] && !fields[TOUCH_FIELD_ID] && !fields[TOUCH_FIELD_X] && !fields[TOUCH_FIELD_Y]))
+			continue;
+		touch_contact* contact = &frame->contacts[frame->count++];
+		contact->tip = fields[TOUCH_FIELD_TIP] != 0;
+		contact->id = fields[TOUCH_FIELD_ID];
+		contact->x = fields[TOUCH_FIELD_X];
+		contact->y = fields[TOUCH_FIELD_Y];
+		contact->pressure = fields[TOUCH_FIELD_PRESSURE];
+	}
+	return frame->count;
+}
+
+/* 10 finger digitizer as the MXT and GT9xx firmwares describe it: tip
+ * switch, contact ID, 12 bit X and Y and pressure per finger, then the
+ * contact count. */
+static const unsigned char bench_header[] =
+{
+	0x05, 0x0d, 0x09, 0x04, 0xa1, 0x01, 0x85, 0x01,
+};
+static const unsigned char bench_finger[] =
+{
+	0x05, 0x0d, 0x09, 0x22, 0xa1, 0x02,
+	0x09, 0x42, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x01, 0x81, 0x02,
+	0x75, 0x07, 0x81, 0x03,
+	0x09, 0x51, 0x25, 0x7f, 0x75, 0x08, 0x81, 0x02,
+	0x05, 0x01, 0x09, 0x30, 0x26, 0xff, 0x0f, 0x75, 0x10, 0x81, 0x02,
+	0x09, 0x31, 0x81, 0x02,
+	0x05, 0x0d, 0x09, 0x30, 0x26, 0xff, 0x00, 0x75, 0x08, 0x81, 0x02,
+	0xc0,
+};
+static const unsigned char bench_trailer[] =
+{
+	0x05, 0x0d, 0x09, 0x54, 0x25, 0x0a, 0x75, 0x08, 0x95, 0x01, 0x81, 0x02, 0xc0,
+};
+
+#define BENCH_REPORTS 1024
+
+static void put_field(unsigned char* report, const touch_field* field, uint32_t value)
+{
+	for (int i = 0; i < field->bits; i++)
+	{
+		int bit = field->offset + i;
+		if (value & (1u << i))
+			report[bit / 8] |= 1 << (bit % 8);
+		else
+			report[bit / 8] &= ~(1 << (bit % 8));
+	}
+}
+
+static void bench_layout(const char* name, const touch_layout* layout, double seconds)
+{
+	int bytes = layout->report_bytes;
+	std::vector<unsigned char> reports(BENCH_REPORTS * bytes);
+	unsigned int seed = 1;
+	for (int r = 0; r < BENCH_REPORTS; r++)
+	{
+		unsigned char* report = &reports[r * bytes];
+		for (int i = 0; i < bytes; i++)
+			report[i] = (unsigned char)rand_r(&seed);
+		if (layout->report_id >= 0)
+			report[0] = (unsigned char)layout->report_id;
+		if (layout->contact_count.bits)
+			put_field(report, &layout->contact_count, 1 + rand_r(&seed) % layout->slots);
+	}
+
+	/* time whole passes over the reports, the clock is read once per pass */
+	touch_frame frame;
+	uint64_t decoded = 0, contacts = 0;
+	uint64_t start = monotonic_ns();
+	uint64_t deadline = start + (uint64_t)(seconds * 1e9);
+	uint64_t now = start;
+	while (now < deadline && !g_input_stop)
+	{
+		for (int r = 0; r < BENCH_REPORTS; r++)
+			contacts += touch_decode(layout, &reports[r * bytes], bytes, &frame);
+		decoded += BENCH_REPORTS;
+		now = monotonic_ns();
+	}
+	double elapsed = (now - start) / 1e9;
+	htt_printf("%-20s: %d bytes, %d contacts, %d ops : %.2f M reports/s, %.1f ns/report, %.2f M contacts/s\n",
+		name, bytes, layout->slots, layout->op_count, decoded / elapsed / 1e6, elapsed * 1e9 / decoded,
+		contacts / elapsed / 1e6);
+}
+
+void touch_bench(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	char* end;
+	double seconds = strtod(argv[start_index + 1], &end);
+	if (*end || seconds <= 0)
+	{
+		htt_printf("Invalid duration : %s\n", argv[start_index + 1]);
+		g_failures++;
+		return;
+	}
+	input_catch_signals();
+
+	std::vector<unsigned char> descriptor(bench_header, bench_header + sizeof(bench_header));
+	for (int i = 0; i < TOUCH_MAX_CONTACTS; i++)
+		descriptor.insert(descriptor.end(), bench_finger, bench_finger + sizeof(bench_finger));
+	descriptor.insert(descriptor.end(), bench_trailer, bench_trailer + sizeof(bench_trailer));
+	touch_layout layout;
+	if (!touch_layout_parse(&descriptor[0], descriptor.size(), &layout))
+	{
+		htt_printf("Reference layout doesn't parse\n");
+		g_failures++;
+		return;
+	}
+	bench_layout("10 finger reference", &layout, seconds);
+	transform_bench(seconds);
+
+	for (size_t i = 0; i < g_device_count && !g_input_stop; i++)
+	{
+		int fd = open(g_identities[i].path, O_RDONLY);
+		if (fd < 0)
+			continue;
+		int found = touch_layout_load(fd, &layout);
+		close(fd);
+		if (!found)
+			continue;
+		char name[32];
+		snprintf(name, sizeof(name), "Device %zu", i);
+		bench_layout(name, &layout, seconds);
+	}
+}
@@ -0,0 +1,102 @@
+#ifndef HTT_TOUCH_H
+#define HTT_TOUCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hidapi.h"
+
+/* Decodes the contacts of HTT input reports (Linux only).
+ *
+ * The layout is taken from the report descriptor of the unit, the touch
+ * report is the input report of the digitizer application collection that
+ * carries X and Y. Every Finger (or Stylus) collection in it is one contact
+ * slot, single touch panels without one get a single slot. The MXT, GT9xx,
+ * FT5xx, ILI25xx and resistive firmwares all describe their reports this way,
+ * so none of them needs its own decoder. */
+
+#define TOUCH_MAX_CONTACTS 10
+
+enum
+{
+	TOUCH_FIELD_TIP,
+	TOUCH_FIELD_ID,
+	TOUCH_FIELD_X,
+	TOUCH_FIELD_Y,
+	TOUCH_FIELD_PRESSURE,
+	TOUCH_FIELD_COUNT
+};
+
+typedef struct
+{
+	uint16_t offset;     /* in bits from the start of the report, report ID included */
+	uint8_t bits;        /* 0 when the report doesn't have it */
+	uint8_t is_signed;
+} touch_field;
+
+/* Values a report decodes into: every field of every slot, then the
+ * contact count */
+#define TOUCH_VALUE_COUNT (TOUCH_MAX_CONTACTS * TOUCH_FIELD_COUNT + 1)
+#define TOUCH_VALUE_CONTACT_COUNT (TOUCH_VALUE_COUNT - 1)
+
+/* One field of the report as a bit field extraction: load 8 bytes little
+ * endian from byte, shift, mask and sign extend. */
+typedef struct
+{
+	uint16_t byte;
+	uint16_t end;        /* one past the last byte of the field */
+	uint8_t shift;
+	uint8_t value;       /* index into the decoded values */
+	uint32_t mask;
+	uint32_t sign;       /* sign bit of a signed field, 0 otherwise */
+} touch_op;
+
+typedef struct
+{
+	int report_id;       /* -1 when the unit doesn't number its reports */
+	int report_bytes;
+	int slots;
+	touch_field contact_count;
+	touch_field fields[TOUCH_MAX_CONTACTS][TOUCH_FIELD_COUNT];
+	int32_t x_min, x_max;
+	int32_t y_min, y_max;
+	int32_t pressure_max;
+	/* compiled from the fields by touch_layout_parse(), in report order */
+	int op_count;
+	touch_op ops[TOUCH_VALUE_COUNT];
+	int32_t defaults[TOUCH_VALUE_COUNT];
+} touch_layout;
+
+typedef struct
+{
+	int32_t id;
+	int32_t x;
+	int32_t y;
+	int32_t pressure;
+	uint8_t tip;         /* 0 is the report of the contact lifting */
+} touch_contact;
+
+typedef struct
+{
+	int count;
+	touch_contact contacts[TOUCH_MAX_CONTACTS];
+} touch_frame;
+
+/* Builds the layout from a report descriptor and compiles it into the
+ * extraction ops touch_decode() runs. Returns 0 when it has no touch
+ * report. */
+int touch_layout_parse(const unsigned char* descriptor, size_t size, touch_layout* layout);
+
+/* Reads the descriptor of an open hidraw node and builds the layout. */
+int touch_layout_load(int fd, touch_layout* layout);
+
+/* Decodes the contacts of one input report. Returns the number of contacts,
+ * -1 when it isn't a touch report. Slots without a contact are left out,
+ * a report that continues a previous one (contact count 0 in hybrid mode)
+ * yields the contacts it holds. */
+int touch_decode(const touch_layout* layout, const unsigned char* report, int length, touch_frame* frame);
+
+/* --touch-bench seconds, decode rate of a 10 finger reference layout and of
+ * the touch report of every unit */
+void touch_bench(hid_device* device, char* argv[], int start_index);
+
+#endif
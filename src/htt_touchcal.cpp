@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "htt_util.h"
+#include "htt_fanout.h"
+#include "htt_calibration.h"
+#include "htt_touchreader.h"
+#include "htt_touchcal.h"
+
+/* Targets as fractions of the screen, the outer ones 10% in from the edges */
+static const double targets5[][2] = { { 0.1, 0.1 }, { 0.9, 0.1 }, { 0.9, 0.9 }, { 0.1, 0.9 }, { 0.5, 0.5 } };
+static const double targets9[][2] =
+{
+	{ 0.1, 0.1 }, { 0.5, 0.1 }, { 0.9, 0.1 },
+	{ 0.1, 0.5 }, { 0.5, 0.5 }, { 0.9, 0.5 },
+	{ 0.1, 0.9 }, { 0.5, 0.9 }, { 0.9, 0.9 },
+};
+
+#define TOUCHCAL_MAX_TARGETS 9
+
+/* a fit further off than this (fraction of the larger span) at any target
+ * means a target was touched in the wrong place */
+#define TOUCHCAL_MAX_ERROR 0.02
+
+void touchcal_add(touchcal_sums* sums, double u, double v, double x, double y)
+{
+	sums->uu += u * u;
+	sums->uv += u * v;
+	sums->vv += v * v;
+	sums->u += u;
+	sums->v += v;
+	sums->n += 1;
+	sums->ux += u * x;
+	sums->vx += v * x;
+	sums->x += x;
+	sums->uy += u * y;
+	sums->vy += v * y;
+	sums->y += y;
+}
+
+void touchcal_merge(touchcal_sums* sums, const touchcal_sums* more)
+{
+	sums->uu += more->uu;
+	sums->uv += more->uv;
+	sums->vv += more->vv;
+	sums->u += more->u;
+	sums->v += more->v;
+	sums->n += more->n;
+	sums->ux += more->ux;
+	sums->vx += more->vx;
+	sums->x += more->x;
+	sums->uy += more->uy;
+	sums->vy += more->vy;
+	sums->y += more->y;
+}
+
+static double det3(double a, double b, double c, double d, double e, double f, double g, double h, double i)
+{
+	return a * (e * i - f * h) - b * (d * i - f * g) + c * (d * h - e * g);
+}
+
+int touchcal_solve(const touchcal_sums* s, double m[6])
+{
+	/* [uu uv u; uv vv v; u v n] * [a b c] = [ux vx x], Cramer's rule */
+	double det = det3(s->uu, s->uv, s->u, s->uv, s->vv, s->v, s->u, s->v, s->n);
+	double scale = s->uu * s->vv * s->n;
+	if (s->n < 3 || fabs(det) <= 1e-12 * fabs(scale))
+		return 0;
+	const double rhs[2][3] = { { s->ux, s->vx, s->x }, { s->uy, s->vy, s->y } };
+	for (int axis = 0; axis < 2; axis++)
+	{
+		const double* r = rhs[axis];
+		m[axis * 3 + 0] = det3(r[0], s->uv, s->u, r[1], s->vv, s->v, r[2], s->v, s->n) / det;
+		m[axis * 3 + 1] = det3(s->uu, r[0], s->u, s->uv, r[1], s->v, s->u, r[2], s->n) / det;
+		m[axis * 3 + 2] = det3(s->uu, s->uv, r[0], s->uv, s->vv, r[1], s->u, s->v, r[2]) / det;
+	}
+	return 1;
+}
+
+void touchcal_compose(const double first[6], const double next[6], double out[6])
+{
+	double m[6];
+	m[0] = next[0] * first[0] + next[1] * first[3];
+	m[1] = next[0] * first[1] + next[1] * first[4];
+	m[2] = next[0] * first[2] + next[1] * first[5] + next[2];
+	m[3] = next[3] * first[0] + next[4] * first[3];
+	m[4] = next[3] * first[1] + next[4] * first[4];
+	m[5] = next[3] * first[2] + next[4] * first[5] + next[5];
+	memcpy(out, m, sizeof(m));
+}
+
+static void put_le64(unsigned char* p, int64_t value)
+{
+	for (int i = 0; i < 8; i++)
+		p[i] = (unsigned char)((uint64_t)value >> (8 * i));
+}
+
+static int64_t get_le64(const unsigned char* p)
+{
+	uint64_t value = 0;
+	for (int i = 7; i >= 0; i--)
+		value = (value << 8) | p[i];
+	return (int64_t)value;
+}
+
+void touchcal_encode(const double m[6], int64_t scaler, unsigned char* matrix)
+{
+	/* tslib order: xscale, xymix, xoffset, yxmix, yscale, yoffset, scaler */
+	for (int i = 0; i < 6; i++)
+		put_le64(matrix + 8 * i, llround(m[i] * scaler));
+	put_le64(matrix + 48, scaler);
+}
+
+int touchcal_decode(const unsigned char* matrix, double m[6], int64_t* scaler)
+{
+	*scaler = get_le64(matrix + 48);
+	if (*scaler <= 0)
+		return 0;
+	for (int i = 0; i < 6; i++)
+	{
+		m[i] = (double)get_le64(matrix + 8 * i) / *scaler;
+		if (!isfinite(m[i]))
+			return 0;
+	}
+	/* a panel's matrix scales by about 1 and doesn't fold the plane */
+	double det = m[0] * m[4] - m[1] * m[3];
+	return fabs(det) >= TOUCHCAL_MIN_DET && fabs(det) <= 1 / TOUCHCAL_MIN_DET;
+}
+
+typedef struct
+{
+	int count;               /* samples folded into the sums */
+	double mean_u, mean_v;   /* running mean of them */
+	double m2;               /* sum of squared distances from the mean */
+	touchcal_sums sums;      /* of this touch, added to the unit's when accepted */
+} target_samples;
+
+typedef struct
+{
+	int active;
+	int finished;
+	hid_device* handle;
+	double current[6];       /* matrix on the unit */
+	int64_t scaler;
+	int32_t x_min, x_max, y_min, y_max;
+	int target;
+	int down;
+	int settle;
+	int pending;             /* held back until TOUCHCAL_TAIL more arrive */
+	double pending_u[TOUCHCAL_TAIL], pending_v[TOUCHCAL_TAIL];
+	int rejected;
+	target_samples samples[TOUCHCAL_MAX_TARGETS];
+	touchcal_sums sums;      /* of the accepted targets */
+} touchcal_unit;
+
+typedef struct
+{
+	touch_reader* reader;
+	std::vector<touchcal_unit> units;
+	const double (*targets)[2];
+	int target_count;
+	int remaining;
+	int mode;                /* TOUCHCAL_PRINT, TOUCHCAL_SAVE or TOUCHCAL_WRITE */
+	const char* directory;   /* of the [key].bin files in TOUCHCAL_SAVE mode */
+} touchcal_state;
+
+static double target_x(const touchcal_unit* unit, double fraction)
+{
+	return unit->x_min + fraction * (unit->x_max - unit->x_min);
+}
+
+static double target_y(const touchcal_unit* unit, double fraction)
+{
+	return unit->y_min + fraction * (unit->y_max - unit->y_min);
+}
+
+static void prompt(const touchcal_state* state, size_t index)
+{
+	const touchcal_unit* unit = &state->units[index];
+	const double* t = state->targets[unit->target];
+	htt_printf("Device %zu : touch target %d of %d, %.0f%% from the left and %.0f%% from the top, and hold it\n",
+		index, unit->target + 1, state->target_count, t[0] * 100, t[1] * 100);
+	fflush(stdout);
+}
+
+static void finish_unit(touchcal_state* state, size_t index, int ok)
+{
+	touchcal_unit* unit = &state->units[index];
+	unit->finished = 1;
+	if (!ok)
+		g_failures++;
+	if (--state->remaining == 0)
+		touch_reader_stop(state->reader);
+}
+
+static void fit_unit(touchcal_state* state, size_t index)
+{
+	touchcal_unit* unit = &state->units[index];
+	double fit[6];
+	if (!touchcal_solve(&unit->sums, fit))
+	{
+		htt_printf("Device %zu : the touches don't span the screen, calibration failed\n", index);
+		finish_unit(state, index, 0);
+		return;
+	}
+
+	/* how far the fit lands from every target, from the mean touch of each */
+	double span = fmax(unit->x_max - unit->x_min, unit->y_max - unit->y_min);
+	double worst = 0;
+	int worst_target = 0;
+	for (int t = 0; t < state->target_count; t++)
+	{
+		const target_samples* s = &unit->samples[t];
+		double dx = fit[0] * s->mean_u + fit[1] * s->mean_v + fit[2] - target_x(unit, state->targets[t][0]);
+		double dy = fit[3] * s->mean_u + fit[4] * s->mean_v + fit[5] - target_y(unit, state->targets[t][1]);
+		double error = sqrt(dx * dx + dy * dy);
+		if (error > worst)
+		{
+			worst = error;
+			worst_target = t;
+		}
+	}
+	htt_printf("Device %zu : fit from %.0f samples, %d rejected, worst error %.1f units (%.2f%%) at target %d\n", index,
+		unit->sums.n, unit->rejected, worst, 100 * worst / span, worst_target + 1);
+	if (worst > TOUCHCAL_MAX_ERROR * span)
+	{
+		htt_printf("Device %zu : target %d is off by more than %.0f%%, calibration not written\n", index,
+			worst_target + 1, TOUCHCAL_MAX_ERROR * 100);
+		finish_unit(state, index, 0);
+		return;
+	}
+
+	htt_printf("Device %zu : fit in reported units x' = %.5f x %+.5f y %+.1f, y' = %.5f x %+.5f y %+.1f\n", index,
+		fit[0], fit[1], fit[2], fit[3], fit[4], fit[5]);
+	if (state->mode == TOUCHCAL_PRINT)
+	{
+		finish_unit(state, index, 1);
+		return;
+	}
+
+	/* the reports are already through the unit's matrix, the new one
+	 * replaces it so it has to include it */
+	double combined[6];
+	unsigned char matrix[CALMATRIX_SIZE], readback[80];
+	touchcal_compose(unit->current, fit, combined);
+	touchcal_encode(combined, unit->scaler, matrix);
+	if (state->mode == TOUCHCAL_SAVE)
+	{
+		char name[256], path[1024];
+		if (!calibration_file_name(index, name, sizeof(name)))
+		{
+			htt_printf("Device %zu : no serial number or USB port to name the file after.\n", index);
+			finish_unit(state, index, 0);
+			return;
+		}
+		snprintf(path, sizeof(path), "%s/%s", state->directory, name);
+		FILE* f = fopen(path, "wb");
+		int ok = f && fwrite(matrix, 1, CALMATRIX_SIZE, f) == CALMATRIX_SIZE;
+		if (f && fclose(f) != 0)
+			ok = 0;
+		if (ok)
+			htt_printf("Device %zu : calibration matrix saved to %s, load it with --restore-calibration\n", index, path);
+		else
+			htt_printf("Device %zu : error writing %s\n", index, path);
+		finish_unit(state, index, ok);
+		return;
+	}
+	if (!set_calmatrix(unit->handle, matrix, CALMATRIX_SIZE))
+	{
+		htt_printf("Device %zu : Error saving calibration matrix.\n", index);
+		finish_unit(state, index, 0);
+		return;
+	}
+	if (get_calmatrix(unit->handle, readback, sizeof(readback)) != CALMATRIX_SIZE ||
+		memcmp(readback, matrix, CALMATRIX_SIZE) != 0)
+	{
+		htt_printf("Device %zu : calibration matrix read back differs from what was written\n", index);
+		finish_unit(state, index, 0);
+		return;
+	}
+	htt_printf("Device %zu : calibration matrix written (x' = %.4f x %+.4f y %+.1f, y' = %.4f x %+.4f y %+.1f),"
+		" reconnect the USB cable to load it.\n", index, combined[0], combined[1], combined[2], combined[3],
+		combined[4], combined[5]);
+	finish_unit(state, index, 1);
+}
+
+static void commit_sample(const touchcal_state* state, touchcal_unit* unit, double u, double v)
+{
+	target_samples* s = &unit->samples[unit->target];
+	const double* t = state->targets[unit->target];
+	touchcal_add(&s->sums, u, v, target_x(unit, t[0]), target_y(unit, t[1]));
+	s->count++;
+	double du = u - s->mean_u, dv = v - s->mean_v;
+	s->mean_u += du / s->count;
+	s->mean_v += dv / s->count;
+	s->m2 += du * (u - s->mean_u) + dv * (v - s->mean_v);
+}
+
+/* Outliers are samples far from where the target has been touched so far:
+ * more than 4 standard deviations and more than 1% of the screen. */
+static int is_outlier(const touchcal_unit* unit, double u, double v)
+{
+	const target_samples* s = &unit->samples[unit->target];
+	if (s->count < TOUCHCAL_MIN_SAMPLES)
+		return 0;
+	double du = u - s->mean_u, dv = v - s->mean_v;
+	double distance2 = du * du + dv * dv;
+	double variance = s->m2 / (s->count - 1);
+	double floor = 0.01 * fmax(unit->x_max - unit->x_min, unit->y_max - unit->y_min);
+	return distance2 > 16 * variance && distance2 > floor * floor;
+}
+
+static void on_frame(size_t device, const touch_frame* frame, uint64_t read_ns, void* context)
+{
+	(void)read_ns;
+	touchcal_state* state = (touchcal_state*)context;
+	touchcal_unit* unit = &state->units[device];
+	if (!unit->active || unit->finished)
+		return;
+	const touch_contact* contact = NULL;
+	for (int i = 0; i < frame->count; i++)
+		if (frame->contacts[i].tip)
+			contact = &frame->contacts[i];
+
+	if (!contact)
+	{
+		if (!unit->down)
+			return;
+		/* lifted, what was held back is the finger rolling off */
+		unit->down = 0;
+		unit->pending = 0;
+		if (unit->samples[unit->target].count < TOUCHCAL_MIN_SAMPLES)
+		{
+			htt_printf("Device %zu : too short, ", device);
+			prompt(state, device);
+			return;
+		}
+		touchcal_merge(&unit->sums, &unit->samples[unit->target].sums);
+		if (++unit->target == state->target_count)
+		{
+			fit_unit(state, device);
+			return;
+		}
+		prompt(state, device);
+		return;
+	}
+
+	if (!unit->down)
+	{
+		unit->down = 1;
+		unit->settle = TOUCHCAL_SETTLE;
+		/* a new touch of the same target starts over, nothing of the
+		 * last one is in the fit yet */
+		memset(&unit->samples[unit->target], 0, sizeof(target_samples));
+	}
+	if (unit->settle)
+	{
+		unit->settle--;
+		return;
+	}
+	if (unit->samples[unit->target].count >= TOUCHCAL_SAMPLES)
+		return;
+	double u = contact->x, v = contact->y;
+	if (is_outlier(unit, u, v))
+	{
+		unit->rejected++;
+		return;
+	}
+	if (unit->pending == TOUCHCAL_TAIL)
+	{
+		commit_sample(state, unit, unit->pending_u[0], unit->pending_v[0]);
+		memmove(unit->pending_u, unit->pending_u + 1, sizeof(double) * (TOUCHCAL_TAIL - 1));
+		memmove(unit->pending_v, unit->pending_v + 1, sizeof(double) * (TOUCHCAL_TAIL - 1));
+		unit->pending--;
+	}
+	unit->pending_u[unit->pending] = u;
+	unit->pending_v[unit->pending] = v;
+	unit->pending++;
+	if (unit->samples[unit->target].count == TOUCHCAL_SAMPLES)
+		htt_printf("Device %zu : target %d done, lift\n", device, unit->target + 1);
+}
+
+void touch_calibrate(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	touchcal_state state;
+	const char* arg = argv[start_index + 1];
+	const char* comma = strchr(arg, ',');
+	state.mode = TOUCHCAL_PRINT;
+	state.directory = NULL;
+	if (comma && !strcmp(comma + 1, "write"))
+		state.mode = TOUCHCAL_WRITE;
+	else if (comma)
+	{
+		state.mode = TOUCHCAL_SAVE;
+		state.directory = comma + 1;
+	}
+	size_t length = comma ? (size_t)(comma - arg) : strlen(arg);
+	if (length == 1 && arg[0] == '5')
+	{
+		state.targets = targets5;
+		state.target_count = 5;
+	}
+	else if (length == 1 && arg[0] == '9')
+	{
+		state.targets = targets9;
+		state.target_count = 9;
+	}
+	else
+		length = 0;
+	if (length == 0 || (comma && !comma[1]))
+	{
+		htt_printf("Invalid argument : %s, expected 5|9[,directory|,write]\n", arg);
+		g_failures++;
+		return;
+	}
+	if (fanout_in_worker())
+	{
+		htt_printf("--touch-calibrate reads all units itself, it can't run per --device\n");
+		g_failures++;
+		return;
+	}
+
+	std::vector<size_t> indices;
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		if (!g_handles[i])
+			continue;
+		int driver = get_driver(g_handles[i]);
+		if (driver < 0)
+		{
+			htt_printf("Device %zu : Error retrieving driver type.\n", i);
+			g_failures++;
+		}
+		else if (driver == TOUCH_RESISTIVE)
+			indices.push_back(i);
+		else
+			htt_printf("Device %zu : skipped, %s driver.\n", i, TouchTypes[driver]);
+	}
+	/* the raw positions, neither filtered nor transformed */
+	touchfilter_config filter = { 0, 0, 0 };
+	transform_config transform = { 0, 0, 0, 0, { 1, 0, 0, 0, 1, 0 } };
+	state.reader = indices.empty() ? NULL : touch_reader_open(&indices[0], indices.size(), &filter, &transform);
+	if (!state.reader)
+	{
+		htt_printf("No resistive HTT touch input to calibrate\n");
+		g_failures++;
+		return;
+	}
+	state.units.resize(g_device_count);
+	memset(&state.units[0], 0, sizeof(touchcal_unit) * g_device_count);
+	state.remaining = 0;
+	for (size_t k = 0; k < indices.size(); k++)
+	{
+		size_t i = indices[k];
+		touchcal_unit* unit = &state.units[i];
+		const touch_layout* layout = touch_reader_layout(state.reader, i);
+		unsigned char matrix[80];
+		if (!layout)
+			continue;
+		if (get_calmatrix(g_handles[i], matrix, sizeof(matrix)) != CALMATRIX_SIZE)
+		{
+			htt_printf("Device %zu : Error retrieving calibration matrix.\n", i);
+			g_failures++;
+			continue;
+		}
+		/* the layout of the matrix is an assumption, a new one is only
+		 * written in it when the one on the unit reads as such */
+		if (state.mode != TOUCHCAL_PRINT && !touchcal_decode(matrix, unit->current, &unit->scaler))
+		{
+			htt_printf("Device %zu : calibration matrix doesn't read as tslib order, not calibrating\n", i);
+			g_failures++;
+			continue;
+		}
+		unit->handle = g_handles[i];
+		unit->x_min = layout->x_min;
+		unit->x_max = layout->x_max;
+		unit->y_min = layout->y_min;
+		unit->y_max = layout->y_max;
+		unit->active = 1;
+		state.remaining++;
+	}
+	if (!state.remaining)
+	{
+		touch_reader_close(state.reader);
+		return;
+	}
+	for (size_t i = 0; i < g_device_count; i++)
+		if (state.units[i].active)
+			prompt(&state, i);
+	if (touch_reader_run(state.reader, 0, on_frame, &state) < 0)
+		g_failures++;
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		if (state.units[i].active && !state.units[i].finished)
+		{
+			htt_printf("Device %zu : stopped at target %d, no calibration\n", i, state.units[i].target + 1);
+			g_failures++;
+		}
+	}
+	touch_reader_close(state.reader);
+}
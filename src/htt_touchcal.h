@@ -0,0 +1,61 @@
+#ifndef HTT_TOUCHCAL_H
+#define HTT_TOUCHCAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hidapi.h"
+
+/* Calibrating resistive panels from touches on the host (Linux only).
+ *
+ * The operator touches a set of targets on every panel, the touches are
+ * read from the input reports of all panels at once. Samples are folded
+ * into least squares sums of their touch as they arrive, the sums of the
+ * accepted touches give the affine fit from the reported to the target
+ * positions, which is printed. On request it is composed
+ * with the matrix on the unit and saved as a file for --restore-calibration,
+ * or written with set_calmatrix() and read back to verify it.
+ *
+ * The format of the 56 byte matrix isn't documented, it is taken to be
+ * seven little endian int64 in tslib order: x' = (a2 + a0 x + a1 y) / a6,
+ * y' = (a5 + a3 x + a4 y) / a6. Nothing is saved or written for a unit
+ * whose matrix doesn't read that way. */
+
+#define TOUCHCAL_SAMPLES 32      /* samples kept per target */
+#define TOUCHCAL_MIN_SAMPLES 8   /* fewer and the target has to be touched again */
+#define TOUCHCAL_SETTLE 3        /* samples skipped after touching down */
+#define TOUCHCAL_TAIL 3          /* samples dropped before lifting */
+#define TOUCHCAL_MIN_DET (1.0 / 64) /* |a0 a4 - a1 a3| / a6^2 of a plausible matrix, at most the inverse */
+
+#define TOUCHCAL_PRINT 0         /* print the fit only */
+#define TOUCHCAL_SAVE 1          /* save the new matrix to a directory */
+#define TOUCHCAL_WRITE 2         /* write it to the unit */
+
+/* Sums of the normal equations of x' = m0 u + m1 v + m2, y' = m3 u + m4 v + m5 */
+typedef struct
+{
+	double uu, uv, vv, u, v, n;
+	double ux, vx, x;
+	double uy, vy, y;
+} touchcal_sums;
+
+void touchcal_add(touchcal_sums* sums, double u, double v, double x, double y);
+/* Adds the samples of more to sums */
+void touchcal_merge(touchcal_sums* sums, const touchcal_sums* more);
+
+/* Least squares fit, 0 when the samples don't span a plane */
+int touchcal_solve(const touchcal_sums* sums, double m[6]);
+
+/* next applied after first */
+void touchcal_compose(const double first[6], const double next[6], double out[6]);
+
+void touchcal_encode(const double m[6], int64_t scaler, unsigned char* matrix);
+/* 0 when the matrix doesn't read as a tslib matrix: a6 not positive or a
+ * linear part scaling the area by less than TOUCHCAL_MIN_DET or more than
+ * its inverse */
+int touchcal_decode(const unsigned char* matrix, double m[6], int64_t* scaler);
+
+/* --touch-calibrate 5|9[,directory|,write], calibrates every resistive unit
+ * at once */
+void touch_calibrate(hid_device* device, char* argv[], int start_index);
+
+#endif
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "htt_util.h"
+#include "htt_touchfilter.h"
+
+#define NS_PER_MS 1000000ull
+
+touchfilter_config g_touch_filter = { 0, 0, 0 };
+
+void touchfilter_init(touchfilter* filter, const touchfilter_config* config)
+{
+	memset(filter, 0, sizeof(*filter));
+	filter->config = *config;
+}
+
+static touchfilter_track* find_track(touchfilter* filter, int32_t id)
+{
+	for (int i = 0; i < filter->track_count; i++)
+	{
+		if (filter->tracks[i].id == id)
+			return &filter->tracks[i];
+	}
+	return NULL;
+}
+
+static void remove_track(touchfilter* filter, touchfilter_track* track)
+{
+	*track = filter->tracks[--filter->track_count];
+}
+
+static int find_contact(const touch_frame* frame, int32_t id)
+{
+	for (int i = 0; i < frame->count; i++)
+	{
+		if (frame->contacts[i].id == id)
+			return i;
+	}
+	return -1;
+}
+
+/* Copies a frame without the contacts that lifted. */
+static void keep_down(touch_frame* to, const touch_frame* from)
+{
+	to->count = 0;
+	for (int i = 0; i < from->count; i++)
+	{
+		if (from->contacts[i].tip)
+			to->contacts[to->count++] = from->contacts[i];
+	}
+}
+
+static int emit(touchfilter* filter, const touch_frame* frame, uint64_t now_ns, touch_frame* out)
+{
+	*out = *frame;
+	keep_down(&filter->emitted, frame);
+	filter->last_emit_ns = now_ns;
+	filter->counters.out++;
+	return 1;
+}
+
+int touchfilter_push(touchfilter* filter, const touch_frame* in, uint64_t now_ns, touch_frame* out)
+{
+	const touchfilter_config* config = &filter->config;
+	uint64_t debounce_ns = config->debounce_ms * NS_PER_MS;
+	touch_frame visible = filter->current;
+	int changed = 0;
+	filter->counters.in++;
+
+	for (int i = 0; i < in->count; i++)
+	{
+		const touch_contact* contact = &in->contacts[i];
+		touchfilter_track* track = find_track(filter, contact->id);
+		if (contact->tip)
+		{
+			if (!track)
+			{
+				if (filter->track_count == TOUCH_MAX_CONTACTS)
+					continue;
+				track = &filter->tracks[filter->track_count++];
+				track->id = contact->id;
+				track->down_ns = now_ns;
+				track->confirmed = 0;
+			}
+			if (!track->confirmed && now_ns - track->down_ns >= debounce_ns)
+				track->confirmed = 1;
+			if (!track->confirmed)
+				continue;
+			int index = find_contact(&visible, contact->id);
+			if (index < 0)
+			{
+				visible.contacts[visible.count++] = *contact;
+				changed = 1;
+			}
+			else
+				visible.contacts[index] = *contact;
+		}
+		else if (track)
+		{
+			int index = find_contact(&visible, contact->id);
+			if (track->confirmed && index >= 0)
+			{
+				visible.contacts[index].tip = 0;
+				changed = 1;
+			}
+			else if (!track->confirmed)
+				filter->counters.debounced++;
+			remove_track(filter, track);
+		}
+	}
+	keep_down(&filter->current, &visible);
+
+	if (!changed)
+	{
+		if (!visible.count && !filter->emitted.count)
+		{
+			filter->counters.held++;
+			return 0;
+		}
+		int moved = 0;
+		for (int i = 0; i < visible.count && !moved; i++)
+		{
+			const touch_contact* contact = &visible.contacts[i];
+			int index = find_contact(&filter->emitted, contact->id);
+			if (index < 0)
+			{
+				changed = 1;
+				break;
+			}
+			int32_t dx = contact->x - filter->emitted.contacts[index].x;
+			int32_t dy = contact->y - filter->emitted.contacts[index].y;
+			moved = abs(dx) > config->deadband || abs(dy) > config->deadband;
+		}
+		if (!changed && !moved)
+		{
+			filter->counters.deadband++;
+			return 0;
+		}
+	}
+
+	if (changed)
+	{
+		/* contacts touching down or lifting don't wait for the window */
+		if (filter->has_pending)
+			filter->counters.coalesced++;
+		filter->has_pending = 0;
+		return emit(filter, &visible, now_ns, out);
+	}
+	uint64_t window_ns = config->window_ms * NS_PER_MS;
+	if (!window_ns || now_ns - filter->last_emit_ns >= window_ns)
+	{
+		if (filter->has_pending)
+			filter->counters.coalesced++;
+		filter->has_pending = 0;
+		return emit(filter, &visible, now_ns, out);
+	}
+	if (filter->has_pending)
+		filter->counters.coalesced++;
+	filter->pending = visible;
+	filter->has_pending = 1;
+	filter->pending_deadline = filter->last_emit_ns + window_ns;
+	return 0;
+}
+
+uint64_t touchfilter_deadline(const touchfilter* filter)
+{
+	return filter->has_pending ? filter->pending_deadline : UINT64_MAX;
+}
+
+int touchfilter_expire(touchfilter* filter, uint64_t now_ns, touch_frame* out)
+{
+	if (!filter->has_pending || now_ns < filter->pending_deadline)
+		return 0;
+	filter->has_pending = 0;
+	return emit(filter, &filter->pending, now_ns, out);
+}
+
+void touch_filter(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	touchfilter_config config;
+	char tail;
+	if (sscanf(argv[start_index + 1], "%d,%u,%u%c", &config.deadband, &config.window_ms, &config.debounce_ms, &tail) != 3 ||
+		config.deadband < 0)
+	{
+		htt_printf("Invalid touch filter : %s, expected deadband,window_ms,debounce_ms\n", argv[start_index + 1]);
+		g_failures++;
+		return;
+	}
+	g_touch_filter = config;
+	htt_printf("Touch filter : deadband %d, window %u ms, debounce %u ms\n", config.deadband, config.window_ms, config.debounce_ms);
+}
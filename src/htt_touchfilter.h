@@ -0,0 +1,76 @@
+#ifndef HTT_TOUCHFILTER_H
+#define HTT_TOUCHFILTER_H
+
+#include <stdint.h>
+#include "hidapi.h"
+#include "htt_touch.h"
+
+/* Cuts the stream of decoded touch reports down to the ones a consumer has
+ * to see.
+ *
+ * - deadband: reports where no contact moved more than this many logical
+ *   units from what was last passed on are dropped
+ * - window: movement within this many ms of the last frame passed on is
+ *   held back, the latest state goes out when the window ends
+ * - debounce: contacts that are released within this many ms of touching
+ *   down are dropped entirely, longer ones appear once that time is up
+ *
+ * A contact touching down or lifting always goes out right away. The state
+ * per unit has a fixed size, nothing allocates. */
+
+typedef struct
+{
+	int32_t deadband;
+	uint32_t window_ms;
+	uint32_t debounce_ms;
+} touchfilter_config;
+
+typedef struct
+{
+	uint64_t in;           /* touch reports seen */
+	uint64_t out;          /* frames passed on */
+	uint64_t deadband;     /* reports dropped as not moving */
+	uint64_t coalesced;    /* reports merged into a later frame */
+	uint64_t held;         /* reports with nothing but unconfirmed contacts */
+	uint64_t debounced;    /* contacts dropped as spurious */
+} touchfilter_counters;
+
+typedef struct
+{
+	int32_t id;
+	uint64_t down_ns;
+	uint8_t confirmed;
+} touchfilter_track;
+
+typedef struct
+{
+	touchfilter_config config;
+	touchfilter_counters counters;
+	touch_frame current;   /* confirmed contacts that are down */
+	touch_frame emitted;   /* what was passed on last */
+	touch_frame pending;   /* held back by the window */
+	int has_pending;
+	uint64_t pending_deadline;
+	uint64_t last_emit_ns;
+	int track_count;
+	touchfilter_track tracks[TOUCH_MAX_CONTACTS];
+} touchfilter;
+
+/* Set by --touch-filter, used by the modes that read touches. */
+extern touchfilter_config g_touch_filter;
+
+void touchfilter_init(touchfilter* filter, const touchfilter_config* config);
+
+/* Feeds one decoded report. Returns 1 when out holds a frame to pass on. */
+int touchfilter_push(touchfilter* filter, const touch_frame* in, uint64_t now_ns, touch_frame* out);
+
+/* When the held back frame is due, UINT64_MAX when there is none. */
+uint64_t touchfilter_deadline(const touchfilter* filter);
+
+/* Returns 1 with the held back frame in out once it is due. */
+int touchfilter_expire(touchfilter* filter, uint64_t now_ns, touch_frame* out);
+
+/* --touch-filter deadband,window_ms,debounce_ms */
+void touch_filter(hid_device* device, char* argv[], int start_index);
+
+#endif
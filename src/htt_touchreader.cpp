@@ -0,0 +1,273 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "htt_util.h"
+#include "htt_fanout.h"
+#include "htt_touchreader.h"
+
+#define READER_TICK_NS 1000000ull /* 1 ms, the filter window granularity */
+
+typedef struct
+{
+	touch_reader* reader;
+	size_t index;
+	int active;
+	touch_layout layout;
+	point_transform transform;
+	int transformed;
+	touchfilter filter;
+	timer_node timer;       /* fires when the filter holds a frame back */
+	uint64_t pending_read_ns;
+} reader_device;
+
+struct touch_reader
+{
+	htt_input* input;
+	reader_device* devices;
+	size_t count;
+	timer_wheel wheel;
+	touch_frame_handler handler;
+	void* context;
+	void (*wakeup)(void* context);
+	void* wakeup_context;
+	int stop;
+};
+
+touch_reader* touch_reader_open(const size_t* indices, size_t count, const touchfilter_config* filter,
+	const transform_config* transform)
+{
+	htt_input* input = count ? input_open(indices, count) : NULL;
+	if (!input)
+		return NULL;
+	touch_reader* reader = (touch_reader*)calloc(1, sizeof(touch_reader));
+	reader->devices = (reader_device*)calloc(g_device_count, sizeof(reader_device));
+	reader->input = input;
+	timerwheel_init(&reader->wheel, READER_TICK_NS, monotonic_ns());
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		reader_device* device = &reader->devices[i];
+		int fd = input_device_fd(input, i);
+		device->reader = reader;
+		device->index = i;
+		timer_init(&device->timer, NULL, device);
+		touchfilter_init(&device->filter, filter);
+		if (fd < 0)
+			continue;
+		if (!touch_layout_load(fd, &device->layout))
+		{
+			htt_printf("Device %zu : no touch report in its report descriptor\n", i);
+			continue;
+		}
+		device->transformed = transform_build(transform, &device->layout, &device->transform);
+		device->active = 1;
+		reader->count++;
+		if (g_verbose)
+			htt_printf("Device %zu : touch report %d, %d bytes, %d contacts, X %d-%d, Y %d-%d\n", i, device->layout.report_id,
+				device->layout.report_bytes, device->layout.slots, device->layout.x_min, device->layout.x_max,
+				device->layout.y_min, device->layout.y_max);
+	}
+	if (!reader->count)
+	{
+		touch_reader_close(reader);
+		return NULL;
+	}
+	return reader;
+}
+
+void touch_reader_close(touch_reader* reader)
+{
+	if (!reader)
+		return;
+	input_close(reader->input);
+	free(reader->devices);
+	free(reader);
+}
+
+size_t touch_reader_count(const touch_reader* reader)
+{
+	return reader->count;
+}
+
+const touch_layout* touch_reader_layout(const touch_reader* reader, size_t device)
+{
+	return device < g_device_count && reader->devices[device].active ? &reader->devices[device].layout : NULL;
+}
+
+const touchfilter_counters* touch_reader_counters(const touch_reader* reader, size_t device)
+{
+	return &reader->devices[device].filter.counters;
+}
+
+timer_wheel* touch_reader_wheel(touch_reader* reader)
+{
+	return &reader->wheel;
+}
+
+void touch_reader_stop(touch_reader* reader)
+{
+	reader->stop = 1;
+}
+
+void touch_reader_set_wakeup(touch_reader* reader, void (*wakeup)(void* context), void* context)
+{
+	reader->wakeup = wakeup;
+	reader->wakeup_context = context;
+}
+
+static void on_filter_timer(timer_node* timer, uint64_t now_ns)
+{
+	reader_device* device = (reader_device*)timer->context;
+	touch_reader* reader = device->reader;
+	touch_frame frame;
+	if (touchfilter_expire(&device->filter, now_ns, &frame))
+		reader->handler(device->index, &frame, device->pending_read_ns, reader->context);
+}
+
+static void on_report(size_t index, const unsigned char* data, int length, uint64_t timestamp_ns, void* context)
+{
+	touch_reader* reader = (touch_reader*)context;
+	reader_device* device = &reader->devices[index];
+	if (!device->active)
+		return;
+	touch_frame decoded;
+	touch_frame frame;
+	if (touch_decode(&device->layout, data, length, &decoded) < 0)
+		return;
+	if (device->transformed)
+		transform_frame(&device->transform, &decoded);
+	if (touchfilter_push(&device->filter, &decoded, timestamp_ns, &frame))
+	{
+		timerwheel_remove(&reader->wheel, &device->timer);
+		reader->handler(index, &frame, timestamp_ns, reader->context);
+		return;
+	}
+	uint64_t deadline = touchfilter_deadline(&device->filter);
+	if (deadline != UINT64_MAX)
+	{
+		device->pending_read_ns = timestamp_ns;
+		if (!timer_pending(&device->timer))
+			timerwheel_add(&reader->wheel, &device->timer, deadline);
+	}
+}
+
+static void on_timer(uint64_t now_ns, void* context)
+{
+	timerwheel_advance(&((touch_reader*)context)->wheel, now_ns);
+}
+
+static void on_stop(timer_node* timer, uint64_t now_ns)
+{
+	(void)now_ns;
+	touch_reader_stop((touch_reader*)timer->context);
+}
+
+static void on_removed(size_t index, void* context)
+{
+	touch_reader* reader = (touch_reader*)context;
+	htt_printf("Device %zu : input gone\n", index);
+	if (reader->devices[index].active)
+	{
+		reader->devices[index].active = 0;
+		reader->count--;
+	}
+	timerwheel_remove(&reader->wheel, &reader->devices[index].timer);
+}
+
+int touch_reader_run(touch_reader* reader, uint64_t duration_ns, touch_frame_handler handler, void* context)
+{
+	reader->handler = handler;
+	reader->context = context;
+	reader->stop = 0;
+	for (size_t i = 0; i < g_device_count; i++)
+		reader->devices[i].timer.callback = on_filter_timer;
+
+	timer_node stop_timer;
+	timer_init(&stop_timer, on_stop, reader);
+	if (duration_ns)
+		timerwheel_add(&reader->wheel, &stop_timer, monotonic_ns() + duration_ns);
+
+	input_callbacks callbacks = { on_report, on_timer, on_removed, NULL, reader };
+	input_catch_signals();
+	int result = 0;
+	while (!reader->stop && !g_input_stop && reader->count)
+	{
+		input_set_timer(reader->input, timerwheel_next_ns(&reader->wheel));
+		if (input_dispatch(reader->input, -1, &callbacks) < 0)
+		{
+			htt_printf("Input   : wait failed\n");
+			result = -1;
+			break;
+		}
+		if (reader->wakeup)
+			reader->wakeup(reader->wakeup_context);
+	}
+	timerwheel_remove(&reader->wheel, &stop_timer);
+	return result;
+}
+
+void touch_reader_print_counters(const touch_reader* reader)
+{
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		const touchfilter_counters* c = &reader->devices[i].filter.counters;
+		if (!reader->devices[i].layout.slots)
+			continue;
+		htt_printf("Device %zu : %llu reports, %llu passed on (%.1f%% of wakeups saved) : deadband %llu, coalesced %llu, held %llu, %llu contacts debounced\n",
+			i, (unsigned long long)c->in, (unsigned long long)c->out, c->in ? 100.0 * (c->in - c->out) / c->in : 0.0,
+			(unsigned long long)c->deadband, (unsigned long long)c->coalesced, (unsigned long long)c->held,
+			(unsigned long long)c->debounced);
+	}
+}
+
+static void print_frame(size_t device, const touch_frame* frame, uint64_t read_ns, void* context)
+{
+	(void)context;
+	char line[512];
+	int used = snprintf(line, sizeof(line), "%zu %.3f", device, read_ns / 1e6);
+	for (int i = 0; i < frame->count && used < (int)sizeof(line); i++)
+	{
+		const touch_contact* c = &frame->contacts[i];
+		if (c->tip)
+			used += snprintf(line + used, sizeof(line) - used, " %d:%d,%d,%d", c->id, c->x, c->y, c->pressure);
+		else
+			used += snprintf(line + used, sizeof(line) - used, " %d:up", c->id);
+	}
+	/* a consumer reading the pipe wakes up once per frame */
+	htt_printf("%s\n", line);
+	fflush(stdout);
+}
+
+void touch_monitor(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	char* end;
+	double seconds = strtod(argv[start_index + 1], &end);
+	if (*end || seconds < 0)
+	{
+		htt_printf("Invalid duration : %s\n", argv[start_index + 1]);
+		g_failures++;
+		return;
+	}
+	if (fanout_in_worker())
+	{
+		htt_printf("--touch-monitor reads all units itself, it can't run per --device\n");
+		g_failures++;
+		return;
+	}
+	std::vector<size_t> indices(g_device_count);
+	for (size_t i = 0; i < g_device_count; i++)
+		indices[i] = i;
+	touch_reader* reader = touch_reader_open(g_device_count ? &indices[0] : NULL, g_device_count, &g_touch_filter,
+		&g_touch_transform);
+	if (!reader)
+	{
+		htt_printf("No HTT touch input to read\n");
+		g_failures++;
+		return;
+	}
+	if (touch_reader_run(reader, (uint64_t)(seconds * 1e9), print_frame, NULL) < 0)
+		g_failures++;
+	touch_reader_print_counters(reader);
+	touch_reader_close(reader);
+}
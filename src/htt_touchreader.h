@@ -0,0 +1,52 @@
+#ifndef HTT_TOUCHREADER_H
+#define HTT_TOUCHREADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hidapi.h"
+#include "htt_input.h"
+#include "htt_timerwheel.h"
+#include "htt_touch.h"
+#include "htt_touchfilter.h"
+#include "htt_transform.h"
+
+/* Decoded, filtered touch frames of many units on one thread (Linux only).
+ *
+ * Opens the input of the units, loads their report layouts, transforms the
+ * points of every report and runs it through a touch filter, handing the
+ * frames that pass to a callback. The timer wheel of the loop is shared, modes can put their own
+ * timers on it. */
+
+typedef struct touch_reader touch_reader;
+
+/* read_ns is when the report that produced the frame was read */
+typedef void (*touch_frame_handler)(size_t device, const touch_frame* frame, uint64_t read_ns, void* context);
+
+/* Units without a touch report are reported and left out. NULL when none
+ * of them can be read. The layouts carry the ranges after the transform. */
+touch_reader* touch_reader_open(const size_t* indices, size_t count, const touchfilter_config* filter,
+	const transform_config* transform);
+void touch_reader_close(touch_reader* reader);
+
+size_t touch_reader_count(const touch_reader* reader);
+/* NULL when the device isn't read */
+const touch_layout* touch_reader_layout(const touch_reader* reader, size_t device);
+const touchfilter_counters* touch_reader_counters(const touch_reader* reader, size_t device);
+timer_wheel* touch_reader_wheel(touch_reader* reader);
+
+/* Runs until duration_ns passed (0 for no limit), touch_reader_stop() is
+ * called or SIGINT / SIGTERM. Returns 0, -1 on errors. */
+int touch_reader_run(touch_reader* reader, uint64_t duration_ns, touch_frame_handler handler, void* context);
+void touch_reader_stop(touch_reader* reader);
+
+/* Called each time the loop wakes up, signals other than SIGINT / SIGTERM
+ * included, so a mode can act on flags its signal handlers set. */
+void touch_reader_set_wakeup(touch_reader* reader, void (*wakeup)(void* context), void* context);
+
+/* wakeups saved by the filter per unit */
+void touch_reader_print_counters(const touch_reader* reader);
+
+/* --touch-monitor seconds, prints every frame that passes the filter */
+void touch_monitor(hid_device* device, char* argv[], int start_index);
+
+#endif
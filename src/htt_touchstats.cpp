@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "htt_util.h"
+#include "htt_fanout.h"
+#include "htt_histogram.h"
+#include "htt_input.h"
+#include "htt_touchstats.h"
+
+#define BURST_GAP_NS (TOUCHSTATS_BURST_GAP_MS * 1000000ull)
+
+typedef struct
+{
+	uint64_t reports;
+	uint64_t first_ns;
+	uint64_t last_ns;
+	uint64_t burst_start_ns;
+	uint64_t burst_reports;
+	uint64_t bursts;
+	uint64_t active_ns;         /* time spent inside bursts */
+	uint64_t longest_gap_ns;    /* longest interval inside a burst */
+	uint64_t longest_idle_ns;   /* longest time between bursts */
+	uint64_t wakeups;
+	uint64_t backlogged;        /* wakeups that found more than one report */
+	uint64_t saturated;         /* wakeups that found the kernel queue full */
+	int max_backlog;
+	htt_histogram intervals;
+	htt_histogram burst_sizes;
+} touch_device_stats;
+
+typedef struct
+{
+	std::vector<touch_device_stats> devices;
+	int done;
+} touch_stats_state;
+
+static void end_burst(touch_device_stats* stats)
+{
+	if (!stats->burst_reports)
+		return;
+	stats->bursts++;
+	stats->active_ns += stats->last_ns - stats->burst_start_ns;
+	histogram_add(&stats->burst_sizes, stats->burst_reports);
+	stats->burst_reports = 0;
+}
+
+static void on_report(size_t device, const unsigned char* data, int length, uint64_t timestamp_ns, void* context)
+{
+	(void)data;
+	(void)length;
+	touch_device_stats* stats = &((touch_stats_state*)context)->devices[device];
+	if (stats->reports)
+	{
+		uint64_t interval = timestamp_ns - stats->last_ns;
+		if (interval < BURST_GAP_NS)
+		{
+			histogram_add(&stats->intervals, interval);
+			if (interval > stats->longest_gap_ns)
+				stats->longest_gap_ns = interval;
+		}
+		else
+		{
+			end_burst(stats);
+			if (interval > stats->longest_idle_ns)
+				stats->longest_idle_ns = interval;
+		}
+	}
+	else
+		stats->first_ns = timestamp_ns;
+	if (!stats->burst_reports)
+		stats->burst_start_ns = timestamp_ns;
+	stats->burst_reports++;
+	stats->reports++;
+	stats->last_ns = timestamp_ns;
+}
+
+static void on_drained(size_t device, int count, void* context)
+{
+	touch_device_stats* stats = &((touch_stats_state*)context)->devices[device];
+	if (!count)
+		return;
+	stats->wakeups++;
+	if (count > 1)
+		stats->backlogged++;
+	if (count >= INPUT_KERNEL_QUEUE)
+		stats->saturated++;
+	if (count > stats->max_backlog)
+		stats->max_backlog = count;
+}
+
+static void on_timer(uint64_t now_ns, void* context)
+{
+	(void)now_ns;
+	((touch_stats_state*)context)->done = 1;
+}
+
+static void on_removed(size_t device, void* context)
+{
+	(void)context;
+	htt_printf("Device %zu : input gone, statistics stop here\n", device);
+}
+
+static void print_device(size_t index, touch_device_stats* stats, double seconds)
+{
+	end_burst(stats);
+	htt_printf("Device %zu : %llu reports in %.1f s, %llu bursts\n", index, (unsigned long long)stats->reports, seconds,
+		(unsigned long long)stats->bursts);
+	if (!stats->reports)
+		return;
+	double active = stats->active_ns / 1e9;
+	htt_printf("  rate        : %.1f reports/s overall, %.1f reports/s while touched\n", stats->reports / seconds,
+		active > 0 ? (stats->reports - stats->bursts) / active : 0.0);
+	histogram_print(&stats->intervals, "  interval   ", 1e6, "ms");
+	htt_printf("  longest gap : %.3f ms inside a burst, %.3f s between bursts\n", stats->longest_gap_ns / 1e6,
+		stats->longest_idle_ns / 1e9);
+	htt_printf("  burst size  : p50 %llu p90 %llu max %llu reports\n",
+		(unsigned long long)histogram_percentile(&stats->burst_sizes, 50),
+		(unsigned long long)histogram_percentile(&stats->burst_sizes, 90),
+		(unsigned long long)stats->burst_sizes.max);
+	htt_printf("  queue       : %llu wakeups, %llu found a backlog, at most %d waiting, %llu full (%d, reports dropped)\n",
+		(unsigned long long)stats->wakeups, (unsigned long long)stats->backlogged, stats->max_backlog,
+		(unsigned long long)stats->saturated, INPUT_KERNEL_QUEUE);
+}
+
+void touch_stats(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	char* end;
+	double seconds = strtod(argv[start_index + 1], &end);
+	if (*end || seconds < 0)
+	{
+		htt_printf("Invalid duration : %s\n", argv[start_index + 1]);
+		g_failures++;
+		return;
+	}
+	if (fanout_in_worker())
+	{
+		htt_printf("--touch-stats watches all units itself, it can't run per --device\n");
+		g_failures++;
+		return;
+	}
+	std::vector<size_t> indices(g_device_count);
+	for (size_t i = 0; i < g_device_count; i++)
+		indices[i] = i;
+	htt_input* input = g_device_count ? input_open(&indices[0], indices.size()) : NULL;
+	if (!input)
+	{
+		htt_printf("No HTT input to watch\n");
+		g_failures++;
+		return;
+	}
+
+	touch_stats_state state;
+	state.devices.resize(g_device_count);
+	memset(&state.devices[0], 0, sizeof(touch_device_stats) * g_device_count);
+	state.done = 0;
+	input_callbacks callbacks = { on_report, on_timer, on_removed, on_drained, &state };
+
+	uint64_t start = monotonic_ns();
+	if (seconds > 0)
+		input_set_timer(input, start + (uint64_t)(seconds * 1e9));
+	htt_printf("Collecting input reports of %zu units%s\n", input_device_count(input), seconds > 0 ? "" : ", Ctrl+C to stop");
+	fflush(stdout);
+	input_catch_signals();
+	while (!state.done && !g_input_stop && input_device_count(input))
+	{
+		if (input_dispatch(input, -1, &callbacks) < 0)
+		{
+			htt_printf("Input   : wait failed\n");
+			g_failures++;
+			break;
+		}
+	}
+	double elapsed = (monotonic_ns() - start) / 1e9;
+	input_close(input);
+
+	for (size_t i = 0; i < g_device_count; i++)
+		print_device(i, &state.devices[i], elapsed);
+}
@@ -0,0 +1,18 @@
+#ifndef HTT_TOUCHSTATS_H
+#define HTT_TOUCHSTATS_H
+
+#include "hidapi.h"
+
+/* Input report rate and jitter of every unit (Linux only).
+ *
+ * Reports are timestamped when they are read and analysed in a single pass
+ * into fixed size histograms, so it can run for hours. Reports less than
+ * TOUCHSTATS_BURST_GAP_MS apart belong to the same burst (one touch), the
+ * interval statistics only cover the intervals inside a burst. */
+
+#define TOUCHSTATS_BURST_GAP_MS 100
+
+/* --touch-stats seconds, 0 runs until Ctrl+C */
+void touch_stats(hid_device* device, char* argv[], int start_index);
+
+#endif
@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+#include "htt_util.h"
+#include "htt_input.h"
+#include "htt_transform.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#  include <immintrin.h>
+#  define TRANSFORM_X86 1
+#endif
+#if defined(__aarch64__)
+#  include <arm_neon.h>
+#  define TRANSFORM_NEON 1
+#endif
+
+transform_config g_touch_transform = { 0, 0, 0, 0, { 1, 0, 0, 0, 1, 0 } };
+
+static void transform_scalar(const point_transform* transform, const int32_t* x, const int32_t* y,
+	int32_t* out_x, int32_t* out_y, size_t count)
+{
+	const float* m = transform->m;
+	for (size_t i = 0; i < count; i++)
+	{
+		float fx = (float)x[i];
+		float fy = (float)y[i];
+		/* nearest, ties to even, the same as the vector conversions */
+		out_x[i] = (int32_t)lrintf(m[0] * fx + m[1] * fy + m[2]);
+		out_y[i] = (int32_t)lrintf(m[3] * fx + m[4] * fy + m[5]);
+	}
+}
+
+#ifdef TRANSFORM_X86
+static void transform_sse2(const point_transform* transform, const int32_t* x, const int32_t* y,
+	int32_t* out_x, int32_t* out_y, size_t count)
+{
+	const float* m = transform->m;
+	__m128 a = _mm_set1_ps(m[0]), b = _mm_set1_ps(m[1]), c = _mm_set1_ps(m[2]);
+	__m128 d = _mm_set1_ps(m[3]), e = _mm_set1_ps(m[4]), f = _mm_set1_ps(m[5]);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 fx = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(x + i)));
+		__m128 fy = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i*)(y + i)));
+		__m128 tx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, fx), _mm_mul_ps(b, fy)), c);
+		__m128 ty = _mm_add_ps(_mm_add_ps(_mm_mul_ps(d, fx), _mm_mul_ps(e, fy)), f);
+		_mm_storeu_si128((__m128i*)(out_x + i), _mm_cvtps_epi32(tx));
+		_mm_storeu_si128((__m128i*)(out_y + i), _mm_cvtps_epi32(ty));
+	}
+	transform_scalar(transform, x + i, y + i, out_x + i, out_y + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static void transform_avx2(const point_transform* transform, const int32_t* x, const int32_t* y,
+	int32_t* out_x, int32_t* out_y, size_t count)
+{
+	const float* m = transform->m;
+	__m256 a = _mm256_set1_ps(m[0]), b = _mm256_set1_ps(m[1]), c = _mm256_set1_ps(m[2]);
+	__m256 d = _mm256_set1_ps(m[3]), e = _mm256_set1_ps(m[4]), f = _mm256_set1_ps(m[5]);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 fx = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(x + i)));
+		__m256 fy = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i*)(y + i)));
+		__m256 tx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, fx), _mm256_mul_ps(b, fy)), c);
+		__m256 ty = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d, fx), _mm256_mul_ps(e, fy)), f);
+		_mm256_storeu_si256((__m256i*)(out_x + i), _mm256_cvtps_epi32(tx));
+		_mm256_storeu_si256((__m256i*)(out_y + i), _mm256_cvtps_epi32(ty));
+	}
+	transform_sse2(transform, x + i, y + i, out_x + i, out_y + i, count - i);
+}
+#endif
+
+#ifdef TRANSFORM_NEON
+static void transform_neon(const point_transform* transform, const int32_t* x, const int32_t* y,
+	int32_t* out_x, int32_t* out_y, size_t count)
+{
+	const float* m = transform->m;
+	float32x4_t a = vdupq_n_f32(m[0]), b = vdupq_n_f32(m[1]), c = vdupq_n_f32(m[2]);
+	float32x4_t d = vdupq_n_f32(m[3]), e = vdupq_n_f32(m[4]), f = vdupq_n_f32(m[5]);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		float32x4_t fx = vcvtq_f32_s32(vld1q_s32(x + i));
+		float32x4_t fy = vcvtq_f32_s32(vld1q_s32(y + i));
+		float32x4_t tx = vaddq_f32(vaddq_f32(vmulq_f32(a, fx), vmulq_f32(b, fy)), c);
+		float32x4_t ty = vaddq_f32(vaddq_f32(vmulq_f32(d, fx), vmulq_f32(e, fy)), f);
+		vst1q_s32(out_x + i, vcvtnq_s32_f32(tx));
+		vst1q_s32(out_y + i, vcvtnq_s32_f32(ty));
+	}
+	transform_scalar(transform, x + i, y + i, out_x + i, out_y + i, count - i);
+}
+#endif
+
+static size_t supported_kernels(const transform_kernel** kernels, size_t max)
+{
+#ifdef TRANSFORM_X86
+	static const transform_kernel avx2 = { "avx2", transform_avx2 };
+	static const transform_kernel sse2 = { "sse2", transform_sse2 };
+#endif
+#ifdef TRANSFORM_NEON
+	static const transform_kernel neon = { "neon", transform_neon };
+#endif
+	static const transform_kernel scalar = { "scalar", transform_scalar };
+	size_t count = 0;
+#ifdef TRANSFORM_X86
+	__builtin_cpu_init();
+	if (count < max && __builtin_cpu_supports("avx2"))
+		kernels[count++] = &avx2;
+	if (count < max && __builtin_cpu_supports("sse2"))
+		kernels[count++] = &sse2;
+#endif
+#ifdef TRANSFORM_NEON
+	/* part of every aarch64 CPU */
+	if (count < max)
+		kernels[count++] = &neon;
+#endif
+	if (count < max)
+		kernels[count++] = &scalar;
+	return count;
+}
+
+size_t transform_kernels(const transform_kernel** kernels, size_t max)
+{
+	return supported_kernels(kernels, max);
+}
+
+const transform_kernel* transform_best_kernel(void)
+{
+	static const transform_kernel* best = NULL;
+	if (!best)
+		supported_kernels(&best, 1);
+	return best;
+}
+
+void transform_identity(point_transform* transform)
+{
+	static const float identity[6] = { 1, 0, 0, 0, 1, 0 };
+	memcpy(transform->m, identity, sizeof(identity));
+}
+
+void transform_then(point_transform* transform, const point_transform* next)
+{
+	const float* t = transform->m;
+	const float* n = next->m;
+	float m[6];
+	m[0] = n[0] * t[0] + n[1] * t[3];
+	m[1] = n[0] * t[1] + n[1] * t[4];
+	m[2] = n[0] * t[2] + n[1] * t[5] + n[2];
+	m[3] = n[3] * t[0] + n[4] * t[3];
+	m[4] = n[3] * t[1] + n[4] * t[4];
+	m[5] = n[3] * t[2] + n[4] * t[5] + n[5];
+	memcpy(transform->m, m, sizeof(m));
+}
+
+int transform_build(const transform_config* config, touch_layout* layout, point_transform* transform)
+{
+	transform_identity(transform);
+	if (!config->rotation && !config->width && !config->has_affine)
+		return 0;
+	if (config->has_affine)
+		memcpy(transform->m, config->affine, sizeof(transform->m));
+	if (!config->rotation && !config->width)
+		return 1;
+
+	/* rotate within the touch range, the result starts at 0 */
+	float span_x = (float)(layout->x_max - layout->x_min);
+	float span_y = (float)(layout->y_max - layout->y_min);
+	float x0 = (float)layout->x_min, y0 = (float)layout->y_min;
+	point_transform rotate;
+	switch (config->rotation)
+	{
+	case 90:
+		rotate = { { 0, -1, span_y + y0, 1, 0, -x0 } };
+		break;
+	case 180:
+		rotate = { { -1, 0, span_x + x0, 0, -1, span_y + y0 } };
+		break;
+	case 270:
+		rotate = { { 0, 1, -y0, -1, 0, span_x + x0 } };
+		break;
+	default:
+		rotate = { { 1, 0, -x0, 0, 1, -y0 } };
+		break;
+	}
+	transform_then(transform, &rotate);
+	if (config->rotation == 90 || config->rotation == 270)
+	{
+		float swap = span_x;
+		span_x = span_y;
+		span_y = swap;
+	}
+
+	int32_t x_max = (int32_t)span_x, y_max = (int32_t)span_y;
+	if (config->width && span_x > 0 && span_y > 0)
+	{
+		point_transform scale = { { (config->width - 1) / span_x, 0, 0, 0, (config->height - 1) / span_y, 0 } };
+		transform_then(transform, &scale);
+		x_max = config->width - 1;
+		y_max = config->height - 1;
+	}
+	layout->x_min = 0;
+	layout->x_max = x_max;
+	layout->y_min = 0;
+	layout->y_max = y_max;
+	return 1;
+}
+
+void transform_points(const point_transform* transform, const int32_t* x, const int32_t* y,
+	int32_t* out_x, int32_t* out_y, size_t count)
+{
+	transform_best_kernel()->run(transform, x, y, out_x, out_y, count);
+}
+
+void transform_frame(const point_transform* transform, touch_frame* frame)
+{
+	int32_t x[TOUCH_MAX_CONTACTS], y[TOUCH_MAX_CONTACTS];
+	int count = frame->count;
+	for (int i = 0; i < count; i++)
+	{
+		x[i] = frame->contacts[i].x;
+		y[i] = frame->contacts[i].y;
+	}
+	transform_points(transform, x, y, x, y, count);
+	for (int i = 0; i < count; i++)
+	{
+		frame->contacts[i].x = x[i];
+		frame->contacts[i].y = y[i];
+	}
+}
+
+#define BENCH_POINTS 4096
+
+void transform_bench(double seconds)
+{
+	std::vector<int32_t> x(BENCH_POINTS), y(BENCH_POINTS), out_x(BENCH_POINTS), out_y(BENCH_POINTS);
+	unsigned int seed = 1;
+	for (size_t i = 0; i < BENCH_POINTS; i++)
+	{
+		x[i] = rand_r(&seed) % 4096;
+		y[i] = rand_r(&seed) % 4096;
+	}
+	/* 90 degrees, a calibration and 1920x1080, all folded into one matrix */
+	transform_config config = { 90, 1920, 1080, 1, { 1.01f, 0.002f, -12, -0.003f, 0.99f, 7 } };
+	touch_layout layout;
+	memset(&layout, 0, sizeof(layout));
+	layout.x_max = layout.y_max = 4095;
+	point_transform transform;
+	transform_build(&config, &layout, &transform);
+
+	const transform_kernel* kernels[4];
+	size_t count = transform_kernels(kernels, 4);
+	for (size_t k = 0; k < count && !g_input_stop; k++)
+	{
+		uint64_t points = 0;
+		uint64_t start = monotonic_ns();
+		uint64_t deadline = start + (uint64_t)(seconds * 1e9);
+		uint64_t now = start;
+		while (now < deadline && !g_input_stop)
+		{
+			kernels[k]->run(&transform, &x[0], &y[0], &out_x[0], &out_y[0], BENCH_POINTS);
+			points += BENCH_POINTS;
+			now = monotonic_ns();
+		}
+		double elapsed = (now - start) / 1e9;
+		htt_printf("Transform %-10s: %.1f M points/s, %.2f ns/point%s\n", kernels[k]->name, points / elapsed / 1e6,
+			elapsed * 1e9 / points, kernels[k] == transform_best_kernel() ? " (used)" : "");
+	}
+}
+
+void touch_transform(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	transform_config config = { 0, 0, 0, 0, { 1, 0, 0, 0, 1, 0 } };
+	const char* spec = argv[start_index + 1];
+	float* a = config.affine;
+	int used = 0;
+	int fields = sscanf(spec, "%d%n", &config.rotation, &used);
+	int valid = fields == 1 && config.rotation % 90 == 0 && config.rotation >= 0 && config.rotation < 360;
+	if (valid && spec[used] == ',')
+	{
+		int more = 0;
+		spec += used + 1;
+		if (sscanf(spec, "%dx%d%n", &config.width, &config.height, &more) == 2)
+			valid = config.width > 1 && config.height > 1;
+		else if (sscanf(spec, "0%n", &more) != 0 || more == 0)
+			valid = 0;
+		spec += more;
+		used = 0;
+		if (valid && *spec == ',')
+		{
+			valid = sscanf(spec + 1, "%f,%f,%f,%f,%f,%f%n", &a[0], &a[1], &a[2], &a[3], &a[4], &a[5], &used) == 6;
+			config.has_affine = valid;
+			spec += 1;
+		}
+	}
+	if (!valid || spec[used])
+	{
+		htt_printf("Invalid touch transform : %s, expected rotation[,WxH[,a,b,c,d,e,f]]\n", argv[start_index + 1]);
+		g_failures++;
+		return;
+	}
+	g_touch_transform = config;
+	htt_printf("Touch transform : rotation %d", config.rotation);
+	if (config.width)
+		htt_printf(", scaled to %dx%d", config.width, config.height);
+	if (config.has_affine)
+		htt_printf(", calibration %g %g %g / %g %g %g", a[0], a[1], a[2], a[3], a[4], a[5]);
+	htt_printf(", %s kernel\n", transform_best_kernel()->name);
+}
@@ -0,0 +1,74 @@
+#ifndef HTT_TRANSFORM_H
+#define HTT_TRANSFORM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hidapi.h"
+#include "htt_touch.h"
+
+/* Transforms decoded touch points on the host (Linux only).
+ *
+ * Rotation in 90 degree steps, an affine calibration and the scaling to the
+ * display resolution fold into one 2x3 matrix per unit, a batch of points
+ * is transformed by a single kernel call. The kernel is picked at run time
+ * from what the CPU has: AVX2, SSE2, NEON or plain C. None of it touches
+ * the unit, the rotation and calibration stored on it stay as they are. */
+
+typedef struct
+{
+	int rotation;        /* 0, 90, 180 or 270 degrees clockwise */
+	int width;           /* display resolution to scale to, 0 keeps touch units */
+	int height;
+	int has_affine;
+	float affine[6];     /* calibration in touch units: x' = a x + b y + c, y' = d x + e y + f */
+} transform_config;
+
+/* Set by --touch-transform, used by the modes that read touches. */
+extern transform_config g_touch_transform;
+
+/* x' = m[0] x + m[1] y + m[2], y' = m[3] x + m[4] y + m[5] */
+typedef struct
+{
+	float m[6];
+} point_transform;
+
+/* Transforms count points, out_x / out_y may be x / y. Results are rounded
+ * to the nearest integer. */
+typedef void (*transform_kernel_fn)(const point_transform* transform, const int32_t* x, const int32_t* y,
+	int32_t* out_x, int32_t* out_y, size_t count);
+
+typedef struct
+{
+	const char* name;
+	transform_kernel_fn run;
+} transform_kernel;
+
+/* Fastest kernel the CPU supports */
+const transform_kernel* transform_best_kernel(void);
+
+/* All kernels the CPU supports, fastest first. Returns the count. */
+size_t transform_kernels(const transform_kernel** kernels, size_t max);
+
+void transform_identity(point_transform* transform);
+
+/* Applies next after what transform already does */
+void transform_then(point_transform* transform, const point_transform* next);
+
+/* Folds config into a transform for a unit with the given layout and sets
+ * the ranges of the layout to the ones the points end up in. Returns 0 when
+ * config leaves the points alone. */
+int transform_build(const transform_config* config, touch_layout* layout, point_transform* transform);
+
+void transform_points(const point_transform* transform, const int32_t* x, const int32_t* y,
+	int32_t* out_x, int32_t* out_y, size_t count);
+
+/* Transforms the contacts of a frame in one batch */
+void transform_frame(const point_transform* transform, touch_frame* frame);
+
+/* Points per second of every supported kernel, part of --touch-bench */
+void transform_bench(double seconds);
+
+/* --touch-transform rotation[,WxH[,a,b,c,d,e,f]] */
+void touch_transform(hid_device* device, char* argv[], int start_index);
+
+#endif
@@ -0,0 +1,272 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/uinput.h>
+#include <vector>
+#include "htt_util.h"
+#include "htt_fanout.h"
+#include "htt_histogram.h"
+#include "htt_touchreader.h"
+#include "htt_uinput.h"
+
+/* per contact: slot, tracking id, x, y, pressure. Then touch, x, y and sync */
+#define EVENTS_PER_CONTACT 5
+#define MAX_EVENTS (TOUCH_MAX_CONTACTS * EVENTS_PER_CONTACT + 4)
+
+struct uinput_touch
+{
+	int fd;
+	int has_pressure;
+	int touching;
+	int32_t next_tracking_id;
+	int slots;
+	int contacts;                           /* slots in use */
+	struct input_event events[MAX_EVENTS];
+	int32_t slot_ids[1];                    /* contact ID in a slot, -1 when free */
+};
+
+static int abs_setup(int fd, int code, int32_t min, int32_t max)
+{
+	struct uinput_abs_setup abs;
+	memset(&abs, 0, sizeof(abs));
+	abs.code = code;
+	abs.absinfo.minimum = min;
+	abs.absinfo.maximum = max > min ? max : min + 1;
+	return ioctl(fd, UI_ABS_SETUP, &abs) < 0 || ioctl(fd, UI_SET_ABSBIT, code) < 0 ? -1 : 0;
+}
+
+uinput_touch* uinput_touch_create(const char* name, const touch_layout* layout)
+{
+	int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0)
+	{
+		htt_printf("/dev/uinput : %s\n", strerror(errno));
+		return NULL;
+	}
+	int slots = layout->slots > 0 ? layout->slots : 1;
+	uinput_touch* touch = (uinput_touch*)calloc(1, sizeof(uinput_touch) + sizeof(int32_t) * (slots - 1));
+	touch->fd = fd;
+	touch->has_pressure = layout->pressure_max > 0;
+	touch->slots = slots;
+	for (int i = 0; i < slots; i++)
+		touch->slot_ids[i] = -1;
+
+	int ok = ioctl(fd, UI_SET_EVBIT, EV_SYN) >= 0 &&
+		ioctl(fd, UI_SET_EVBIT, EV_KEY) >= 0 &&
+		ioctl(fd, UI_SET_KEYBIT, BTN_TOUCH) >= 0 &&
+		ioctl(fd, UI_SET_EVBIT, EV_ABS) >= 0 &&
+		ioctl(fd, UI_SET_PROPBIT, INPUT_PROP_DIRECT) >= 0 &&
+		abs_setup(fd, ABS_X, layout->x_min, layout->x_max) == 0 &&
+		abs_setup(fd, ABS_Y, layout->y_min, layout->y_max) == 0 &&
+		abs_setup(fd, ABS_MT_SLOT, 0, slots - 1) == 0 &&
+		abs_setup(fd, ABS_MT_TRACKING_ID, 0, 65535) == 0 &&
+		abs_setup(fd, ABS_MT_POSITION_X, layout->x_min, layout->x_max) == 0 &&
+		abs_setup(fd, ABS_MT_POSITION_Y, layout->y_min, layout->y_max) == 0 &&
+		(!touch->has_pressure || abs_setup(fd, ABS_MT_PRESSURE, 0, layout->pressure_max) == 0);
+	if (ok)
+	{
+		struct uinput_setup setup;
+		memset(&setup, 0, sizeof(setup));
+		setup.id.bustype = BUS_VIRTUAL;
+		setup.id.vendor = HTT_VENDOR_ID;
+		setup.id.product = HTT_PRODUCT_ID;
+		snprintf(setup.name, sizeof(setup.name), "%s", name);
+		ok = ioctl(fd, UI_DEV_SETUP, &setup) >= 0 && ioctl(fd, UI_DEV_CREATE) >= 0;
+	}
+	if (!ok)
+	{
+		htt_printf("/dev/uinput : creating %s failed, %s\n", name, strerror(errno));
+		close(fd);
+		free(touch);
+		return NULL;
+	}
+	return touch;
+}
+
+void uinput_touch_destroy(uinput_touch* touch)
+{
+	if (!touch)
+		return;
+	ioctl(touch->fd, UI_DEV_DESTROY);
+	close(touch->fd);
+	free(touch);
+}
+
+static inline void put(struct input_event* event, int type, int code, int32_t value)
+{
+	event->type = (uint16_t)type;
+	event->code = (uint16_t)code;
+	event->value = value;
+}
+
+/* Slot of a contact, a free one is taken when allocate is set and *taken
+ * tells it is new. -1 when there is none. */
+static int slot_of(uinput_touch* touch, int32_t id, int allocate, int* taken)
+{
+	int free_slot = -1;
+	*taken = 0;
+	for (int i = 0; i < touch->slots; i++)
+	{
+		if (touch->slot_ids[i] == id)
+			return i;
+		if (free_slot < 0 && touch->slot_ids[i] < 0)
+			free_slot = i;
+	}
+	if (!allocate || free_slot < 0)
+		return -1;
+	touch->slot_ids[free_slot] = id;
+	*taken = 1;
+	return free_slot;
+}
+
+int uinput_touch_send(uinput_touch* touch, const touch_frame* frame)
+{
+	struct input_event* event = touch->events;
+	int first = -1;
+	/* the kernel stamps the events itself, the time fields stay zero */
+	for (int i = 0; i < frame->count; i++)
+	{
+		const touch_contact* contact = &frame->contacts[i];
+		int taken;
+		int slot = slot_of(touch, contact->id, contact->tip, &taken);
+		if (slot < 0)
+			continue;
+		put(event++, EV_ABS, ABS_MT_SLOT, slot);
+		if (!contact->tip)
+		{
+			put(event++, EV_ABS, ABS_MT_TRACKING_ID, -1);
+			touch->slot_ids[slot] = -1;
+			touch->contacts--;
+			continue;
+		}
+		if (first < 0)
+			first = i;
+		/* a new tracking ID starts a new contact, only sent when touching down */
+		if (taken)
+		{
+			touch->contacts++;
+			put(event++, EV_ABS, ABS_MT_TRACKING_ID, touch->next_tracking_id);
+			touch->next_tracking_id = (touch->next_tracking_id + 1) & 0xffff;
+		}
+		put(event++, EV_ABS, ABS_MT_POSITION_X, contact->x);
+		put(event++, EV_ABS, ABS_MT_POSITION_Y, contact->y);
+		if (touch->has_pressure)
+			put(event++, EV_ABS, ABS_MT_PRESSURE, contact->pressure);
+	}
+
+	/* contacts of earlier frames may still be down, a device fed by several
+	 * units only gets the contacts of one in a frame */
+	int touching = touch->contacts > 0;
+	if (touching != touch->touching)
+	{
+		put(event++, EV_KEY, BTN_TOUCH, touching);
+		touch->touching = touching;
+	}
+	if (first >= 0)
+	{
+		put(event++, EV_ABS, ABS_X, frame->contacts[first].x);
+		put(event++, EV_ABS, ABS_Y, frame->contacts[first].y);
+	}
+	put(event++, EV_SYN, SYN_REPORT, 0);
+
+	size_t bytes = (char*)event - (char*)touch->events;
+	return write(touch->fd, touch->events, bytes) == (ssize_t)bytes;
+}
+
+typedef struct
+{
+	std::vector<uinput_touch*> devices;
+	htt_histogram latency;
+	uint64_t frames;
+	uint64_t failed;
+} bridge_state;
+
+static void on_frame(size_t device, const touch_frame* frame, uint64_t read_ns, void* context)
+{
+	bridge_state* state = (bridge_state*)context;
+	uinput_touch* touch = state->devices[device];
+	if (!touch)
+		return;
+	if (uinput_touch_send(touch, frame))
+	{
+		histogram_add(&state->latency, monotonic_ns() - read_ns);
+		state->frames++;
+	}
+	else
+		state->failed++;
+}
+
+void uinput_bridge(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	char* end;
+	double seconds = strtod(argv[start_index + 1], &end);
+	if (*end || seconds < 0)
+	{
+		htt_printf("Invalid duration : %s\n", argv[start_index + 1]);
+		g_failures++;
+		return;
+	}
+	if (fanout_in_worker())
+	{
+		htt_printf("--uinput-bridge reads all units itself, it can't run per --device\n");
+		g_failures++;
+		return;
+	}
+	std::vector<size_t> indices(g_device_count);
+	for (size_t i = 0; i < g_device_count; i++)
+		indices[i] = i;
+	touch_reader* reader = touch_reader_open(g_device_count ? &indices[0] : NULL, g_device_count, &g_touch_filter,
+		&g_touch_transform);
+	if (!reader)
+	{
+		htt_printf("No HTT touch input to read\n");
+		g_failures++;
+		return;
+	}
+
+	bridge_state* state = new bridge_state();
+	histogram_reset(&state->latency);
+	state->devices.resize(g_device_count, NULL);
+	size_t created = 0;
+	for (size_t i = 0; i < g_device_count; i++)
+	{
+		const touch_layout* layout = touch_reader_layout(reader, i);
+		if (!layout)
+			continue;
+		char name[80];
+		if (g_identities[i].serial[0])
+			snprintf(name, sizeof(name), "Matrix Orbital HTT %.60s", g_identities[i].serial);
+		else
+			snprintf(name, sizeof(name), "Matrix Orbital HTT %zu", i);
+		state->devices[i] = uinput_touch_create(name, layout);
+		if (state->devices[i])
+		{
+			htt_printf("Device %zu : bridged as \"%s\"\n", i, name);
+			created++;
+		}
+	}
+	if (created)
+	{
+		fflush(stdout);
+		if (touch_reader_run(reader, (uint64_t)(seconds * 1e9), on_frame, state) < 0)
+			g_failures++;
+		htt_printf("%llu frames written, %llu failed\n", (unsigned long long)state->frames, (unsigned long long)state->failed);
+		histogram_print(&state->latency, "Read to write", 1e3, "us");
+		histogram_print_bars(&state->latency, 1e3, "us");
+		if (g_verbose)
+			touch_reader_print_counters(reader);
+		if (state->failed)
+			g_failures++;
+	}
+	else
+		g_failures++;
+	for (size_t i = 0; i < g_device_count; i++)
+		uinput_touch_destroy(state->devices[i]);
+	delete state;
+	touch_reader_close(reader);
+}
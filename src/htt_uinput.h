@@ -0,0 +1,26 @@
+#ifndef HTT_UINPUT_H
+#define HTT_UINPUT_H
+
+#include <stdint.h>
+#include "hidapi.h"
+#include "htt_touch.h"
+
+/* Multitouch devices fed from HTT touch frames (Linux only).
+ *
+ * Every frame becomes one write() of all its slot events and a single
+ * SYN_REPORT, the events are built in a fixed buffer, nothing allocates. */
+
+typedef struct uinput_touch uinput_touch;
+
+/* Creates the device, axes ranges and slot count taken from the layout.
+ * NULL on errors. */
+uinput_touch* uinput_touch_create(const char* name, const touch_layout* layout);
+void uinput_touch_destroy(uinput_touch* touch);
+
+/* Returns 1 when the frame was written. */
+int uinput_touch_send(uinput_touch* touch, const touch_frame* frame);
+
+/* --uinput-bridge seconds, 0 runs until Ctrl+C */
+void uinput_bridge(hid_device* device, char* argv[], int start_index);
+
+#endif
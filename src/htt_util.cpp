@@ -5,6 +5,31 @@
 #include "hidapi.h"
 #include <stdint.h>
 #include <ctype.h>
+#include <stdarg.h>
+#include "htt_util.h"
+#include "htt_report.h"
+#include "htt_coalesce.h"
+#include "htt_script.h"
+#include "htt_hotplug.h"
+#include "htt_devindex.h"
+#include "htt_fanout.h"
+#include "htt_calibration.h"
+#include "htt_snapshot.h"
+#ifndef _WIN32
+#include "htt_autodim.h"
+#include "htt_scheduler.h"
+#include "htt_sequencer.h"
+#include "htt_touchstats.h"
+#include "htt_touchreader.h"
+#include "htt_uinput.h"
+#include "htt_transform.h"
+#include "htt_record.h"
+#include "htt_heatmap.h"
+#include "htt_touchcal.h"
+#include "htt_autotune.h"
+#include "htt_regions.h"
+#include "htt_wall.h"
+#endif
 
 /* The factory programming commands are not exposed in the 
  * public code drop of htt_util. */
@@ -12,11 +37,16 @@
 #  include "htt_util_factory.h"
 #endif
 
-size_t g_currentDevice = 0;
+thread_local size_t g_currentDevice = 0;
 size_t g_device_count = 0;
 int g_verbose = 0;
+thread_local int g_batch = 0;          /* set while running a --script, errors must not exit */
+thread_local int g_failures = 0;       /* number of commands that failed */
+thread_local int g_reboot_pending = 0; /* the last command made the current device reboot */
+int g_reboot_timeout = 15; /* seconds to wait for a rebooting unit to come back */
 
 hid_device **g_handles = NULL;
+htt_identity *g_identities = NULL;
 
 // Headers needed for sleeping.
 #ifdef _WIN32
@@ -26,95 +56,107 @@ hid_device **g_handles = NULL;
 	#define min(a,b) (((a)<(b))?(a):(b))
 #endif
 
-#define TOUCH_NONE		0
-#define TOUCH_RESISTIVE 1
-#define TOUCH_MXTxx     2       
-#define TOUCH_GT9xx     3       
-#define TOUCH_FT5xx     4
-#define TOUCH_ILI25xx   5
-
-#define REPORT_DRIVER_TYPE     4
-#define REPORT_CALMATRIX       6 
-#define REPORT_MXT_SENSITIVITY 7
-#define REPORT_SCREENROTATION  8
-#define REPORT_FWREV           9
-#define REPORT_BACKLIGHT       10
-#define REPORT_HAPTIC		   11
-#define REPORT_PIEZO		   12
-#define REPORT_MODULEID        13
-#define REPORT_TOUCHFEEDBACK   15	
-#define REPORT_TOUCHDIM		   16	
-#define REPORT_PCAPCALIBRATE   17	
-#define REPORT_BACKLIGHT_FADE  18
-#define REPORT_FACTORY_RESET   19
-#define REPORT_ALARM           20
-#define REPORT_TOUCH_THRESHOLD 26
-
 const char* TouchTypes[] = { "None", "Resistive", "MXTxx", "GT9xx", "FT5xx", "ILI25xx" };
 const char* Rotation[] = { "0", "90", "180", "270"};
 const char* Sensitivity[] = { "normal", "high", "extra" };
 const char* TouchFeedbackTypes[] = { "None" ,"Haptic", "Piezo", "Haptic and Piezo" ,"Invalid" };
 
-typedef void(*parm_handler)(hid_device* device, char* argv[], int start_index);
-typedef struct 
+static thread_local std::string* t_output = NULL;
+
+void htt_capture_output(std::string* buffer)
 {
-	const char* name;
-	const size_t parameter_count;
-	parm_handler handler;
-} cli_parm;
+	t_output = buffer;
+}
+
+int htt_printf(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	int res;
+	if (!t_output)
+	{
+		res = vprintf(format, args);
+	}
+	else
+	{
+		char buf[512];
+		va_list copy;
+		va_copy(copy, args);
+		res = vsnprintf(buf, sizeof(buf), format, args);
+		if (res >= (int)sizeof(buf))
+		{
+			size_t offset = t_output->size();
+			t_output->resize(offset + res + 1);
+			vsnprintf(&(*t_output)[offset], res + 1, format, copy);
+			t_output->resize(offset + res);
+		}
+		else if (res > 0)
+		{
+			t_output->append(buf, res);
+		}
+		va_end(copy);
+	}
+	va_end(args);
+	return res;
+}
 
 int checkhtt(hid_device *handle)
 {
 	if (!handle)
 	{
-		printf("No HTT detected\n");
-		exit(0);
+		htt_printf("No HTT detected\n");
+		g_failures++;
+		if (!g_batch)
+			exit(0);
 		return 0;
 	}
 	return 1;
 }
 
+/* Result string for a command, failures are counted so the runner can
+ * report them. */
+const char* result_string(int success)
+{
+	if (!success)
+	{
+		g_failures++;
+		return "Failed.";
+	}
+	return "Success!";
+}
+
 int get_driver(hid_device *handle)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_DRIVER_TYPE;
-	int res = hid_get_feature_report(handle, buf, 2);
-	if (res < 0) {
-		return 0;
+	DriverReport report;
+	if (report.read(handle) < 0) {
+		return -1;
 	}
-	return buf[1];
+	return report.get<0>();
 }
 
 int get_fwrev(hid_device *handle)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_FWREV;
-	int res = hid_get_feature_report(handle, buf, 5);
-	if (res < 0) {
+	FwrevReport report;
+	if (report.read(handle) < 0) {
 		return 0;
 	}
-	int*rev = (int*)&buf[1];
-	return *rev;
+	return (int)report.get<0>();
 }
 
 int get_rotation(hid_device *handle)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_SCREENROTATION;
-	int res = hid_get_feature_report(handle, buf, 2);
-	if (res < 0) {
+	RotationReport report;
+	if (report.read(handle) < 0) {
 		return -1;
 	}
-	return buf[1];
+	return report.get<0>();
 }
 
 int set_rotation(hid_device *handle, int rotation)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_SCREENROTATION;
-	buf[1] = rotation;
-	int res = hid_send_feature_report(handle, buf, 2);
-	if (res < 0) {
+	RotationReport report;
+	report.set<0>(rotation);
+	if (report.send(handle) < 0) {
 		return 0;
 	}
 	return 1;
@@ -122,12 +164,9 @@ int set_rotation(hid_device *handle, int rotation)
 
 int set_touch_threshold(hid_device* handle, uint16_t threshold)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_TOUCH_THRESHOLD;
-	buf[1] = (threshold >> 8) & 0xff;
-	buf[2] = threshold & 0xff;
-	int res = hid_send_feature_report(handle, buf, 3);
-	if (res < 0) {
+	ThresholdReport report;
+	report.set<0>(threshold);
+	if (report.send(handle) < 0) {
 		return 0;
 	}
 	return 1;
@@ -135,43 +174,38 @@ int set_touch_threshold(hid_device* handle, uint16_t threshold)
 
 int get_touch_threshold(hid_device* handle)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_TOUCH_THRESHOLD;
-	int res = hid_get_feature_report(handle, buf, 3);
-	if (res < 0) {
-		return 0;
+	ThresholdReport report;
+	if (report.read(handle) < 0) {
+		return -1;
 	}
-	return buf[2] << 8 | buf[1];
+	return report.get<0>();
 }
 
 
 int get_calmatrix(hid_device *handle, unsigned char*out_buffer, size_t buffersize)
 {
-	unsigned char buf[256];
+	CalmatrixReport report;
 	if (buffersize < 56)
 		return -1;
 
-	buf[0] = REPORT_CALMATRIX;
-	int res = hid_get_feature_report(handle, buf, 57);
+	int res = report.read(handle);
 	if (res < 0) {
 		return -1;
 	}
 	int len = min(res - 1, 56);
-	memcpy(out_buffer, &buf[1], len);
+	memcpy(out_buffer, report.data<0>(), len);
 	return len;
 }
 
 int set_calmatrix(hid_device *handle, unsigned char*matrix, size_t buffersize)
 {
-	unsigned char buf[256];
+	CalmatrixReport report;
 
 	if (buffersize != 56) /* Matrix needs to be 56 bytes*/
 		return 0;
 
-	buf[0] = REPORT_CALMATRIX;
-	memcpy(&buf[1], matrix, 56);
-	int res = hid_send_feature_report(handle, buf, 57);
-	if (res < 0) {
+	memcpy(report.data<0>(), matrix, 56);
+	if (report.send(handle) < 0) {
 		return 0;
 	}
 	return 1;
@@ -180,11 +214,9 @@ int set_calmatrix(hid_device *handle, unsigned char*matrix, size_t buffersize)
 
 int set_sensitivity(hid_device *handle, int sensitivity)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_MXT_SENSITIVITY;
-	buf[1] = sensitivity;
-	int res = hid_send_feature_report(handle, buf, 2);
-	if (res < 0) {
+	SensitivityReport report;
+	report.set<0>(sensitivity);
+	if (report.send(handle) < 0) {
 		return 0;
 	}
 	return 1;
@@ -192,45 +224,46 @@ int set_sensitivity(hid_device *handle, int sensitivity)
 
 int get_sensitivity(hid_device *handle)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_MXT_SENSITIVITY;
-	int res = hid_get_feature_report(handle, buf, 2);
-	if (res < 0) {
-		return 0;
+	SensitivityReport report;
+	if (report.read(handle) < 0) {
+		return -1;
 	}
-	return buf[1];
+	return report.get<0>();
 }
 
 int get_backlight(hid_device *handle)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_BACKLIGHT;
-	int res = hid_get_feature_report(handle, buf, 3);
-	if (res < 0) {
+	BacklightReport report;
+	if (report.read(handle) < 0) {
 		return -1;
 	}
-	return buf[1];
+	return report.get<0>();
 }
 
 int get_backlight_fade(hid_device *handle)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_BACKLIGHT_FADE;
-	int res = hid_get_feature_report(handle, buf, 4);
-	if (res < 0) {
+	FadeReport report;
+	if (report.read(handle) < 0) {
 		return -1;
 	}
-	return buf[2] << 8 | buf[1];
+	return report.get<0>();
+}
+
+size_t backlight_report(unsigned char* buf, uint8_t backlight, uint8_t save)
+{
+	BacklightReport report;
+	report.set<0>(backlight);
+	report.set<1>(save ? 1 : 0);
+	memcpy(buf, report.bytes(), report.size);
+	return report.size;
 }
 
 int set_backlight(hid_device *handle, uint8_t backlight, uint8_t save)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_BACKLIGHT;
-	buf[1] = backlight;
-	buf[2] = save ? 1 : 0;
-	int res = hid_send_feature_report(handle, buf, 3);
-	if (res < 0) {
+	BacklightReport report;
+	report.set<0>(backlight);
+	report.set<1>(save ? 1 : 0);
+	if (report.send(handle) < 0) {
 		return 0;
 	}
 	return 1;
@@ -238,27 +271,41 @@ int set_backlight(hid_device *handle, uint8_t backlight, uint8_t save)
 
 int set_fade(hid_device *handle, uint16_t fade_time, uint8_t save)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_BACKLIGHT_FADE;
-	buf[1] = (fade_time & 0xff00) >> 8;
-	buf[2] = (fade_time & 0xff);
-	buf[3] = save ? 1 : 0;
-	int res = hid_send_feature_report(handle, buf, 4);
-	if (res < 0) {
+	FadeReport report;
+	report.set<0>(fade_time);
+	report.set<1>(save ? 1 : 0);
+	if (report.send(handle) < 0) {
 		return 0;
 	}
 	return 1;
 }
 
+/* Volatile variants of set_backlight/set_fade, the report is parked in the
+ * coalescing queue of the current device and replaced by any newer value
+ * that arrives before the queue is flushed. */
+int queue_backlight(hid_device *handle, uint8_t backlight)
+{
+	BacklightReport report;
+	report.set<0>(backlight);
+	report.set<1>(0);
+	return coalesce_submit(g_currentDevice, handle, report.bytes(), report.size);
+}
+
+int queue_fade(hid_device *handle, uint16_t fade_time)
+{
+	FadeReport report;
+	report.set<0>(fade_time);
+	report.set<1>(0);
+	return coalesce_submit(g_currentDevice, handle, report.bytes(), report.size);
+}
+
 int get_moduleID(hid_device *handle)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_MODULEID;
-	int res = hid_get_feature_report(handle, buf, 3);
-	if (res < 0) {
+	ModuleIdReport report;
+	if (report.read(handle) < 0) {
 		return -1;
 	}
-	return buf[1];
+	return report.get<0>();
 }
 
 
@@ -272,11 +319,12 @@ void rotate_touch(hid_device* device, char* argv[], int start_index)
 			if (strcmp(argv[start_index + 1], Rotation[i]) == 0)
 			{
 				int success = set_rotation(device, i);
-				printf("Setting rotation to %s : %s\n", Rotation[i], success ? "Success!" : "Failed.");
+				htt_printf("Setting rotation to %s : %s\n", Rotation[i], result_string(success));
 				return;
 			}
 		}
-		printf("Invalid parameter for rotation : %s\n", argv[start_index + 1]);
+		htt_printf("Invalid parameter for rotation : %s\n", argv[start_index + 1]);
+		g_failures++;
 	}
 }
 
@@ -284,12 +332,17 @@ void sensitivty(hid_device* device, char* argv[], int start_index)
 {
 	if (checkhtt(device))
 	{
-		bool validDevice = false;
-		validDevice |= get_driver(device) == TOUCH_MXTxx;
-		validDevice |= get_driver(device) == TOUCH_GT9xx;
-		if (!validDevice)
+		int driver = get_driver(device);
+		if (driver < 0)
 		{
-			printf("Setting sensitivty not supported on %s driver", TouchTypes[get_driver(device)]);
+			htt_printf("Error retrieving driver type.\n");
+			g_failures++;
+			return;
+		}
+		if (driver != TOUCH_MXTxx && driver != TOUCH_GT9xx)
+		{
+			htt_printf("Setting sensitivty not supported on %s driver", TouchTypes[driver]);
+			g_failures++;
 			return;
 		}
 		for (int i = 0; i < 3; i++)
@@ -297,16 +350,17 @@ void sensitivty(hid_device* device, char* argv[], int start_index)
 			if (strcmp(argv[start_index + 1], Sensitivity[i]) == 0)
 			{
 				int success = set_sensitivity(device, i);
-				printf("Setting sensitivity to %s : %s\n", Sensitivity[i], success ? "Success!\n" : "Failed.\n");
+				htt_printf("Setting sensitivity to %s : %s\n\n", Sensitivity[i], result_string(success));
 				if (success)
 				{
-					printf("The sensitivity command reboots the unit, further commands will not executed.\n");
-					exit(0);
+					htt_printf("The sensitivity command reboots the unit, further commands wait for it to come back.\n");
+					g_reboot_pending = 1;
 				}
 				return;
 			}
 		}
-		printf("Invalid parameter for sensitivity : %s\n", argv[start_index + 1]);
+		htt_printf("Invalid parameter for sensitivity : %s\n", argv[start_index + 1]);
+		g_failures++;
 	}
 }
 
@@ -314,27 +368,50 @@ void savecalibration(hid_device* device, char* argv[], int start_index)
 {
 	if (checkhtt(device))
 	{
-		if (get_driver(device) != TOUCH_RESISTIVE)
+		int driver = get_driver(device);
+		if (driver < 0)
+		{
+			htt_printf("Error retrieving driver type.\n");
+			g_failures++;
+			return;
+		}
+		if (driver != TOUCH_RESISTIVE)
 		{
-			printf("Saving calibration matrix is not supported on %s driver", TouchTypes[get_driver(device)]);
+			htt_printf("Saving calibration matrix is not supported on %s driver", TouchTypes[driver]);
+			g_failures++;
 			return;
 		}
 		unsigned char buffer[80];
 		if (get_calmatrix(device, buffer, sizeof(buffer)) == 56) 
 		{
+			if (calarchive_is_archive(argv[start_index + 1]))
+			{
+				calibration_record record;
+				fill_record(g_currentDevice, device, driver, buffer, &record);
+				if (!record.serial[0] || !calibration_archive_update(argv[start_index + 1], &record, 1))
+				{
+					htt_printf("Error adding calibration matrix to %s\n", argv[start_index + 1]);
+					g_failures++;
+					return;
+				}
+				htt_printf("Calibration matrix of %s written to %s\n", record.serial, argv[start_index + 1]);
+				return;
+			}
 			FILE* f = fopen(argv[start_index + 1], "wb");
 			if (!f)
 			{
-				printf("error opening %s\n", argv[start_index + 1]);
+				htt_printf("error opening %s\n", argv[start_index + 1]);
+				g_failures++;
 				return;
 			}
 			fwrite(buffer, 1, 56, f);
 			fclose(f);
-			printf("Calibration matrix written to %s\n", argv[start_index + 1]);
+			htt_printf("Calibration matrix written to %s\n", argv[start_index + 1]);
 		}
 		else
 		{
-			printf("Error retrieving calibration matrix.");
+			htt_printf("Error retrieving calibration matrix.");
+			g_failures++;
 		}
 	}
 }
@@ -343,59 +420,69 @@ void loadcalibration(hid_device* device, char* argv[], int start_index)
 {
 	if (checkhtt(device))
 	{
-		if (get_driver(device) != TOUCH_RESISTIVE)
+		int driver = get_driver(device);
+		if (driver < 0)
 		{
-			printf("Saving calibration matrix is not supported on %s driver", TouchTypes[get_driver(device)]);
+			htt_printf("Error retrieving driver type.\n");
+			g_failures++;
 			return;
 		}
-		unsigned char buffer[80];
-		FILE* f = fopen(argv[start_index + 1], "rb");
-		if (!f)
+		if (driver != TOUCH_RESISTIVE)
 		{
-			printf("error opening %s\n", argv[start_index + 1]);
+			htt_printf("Saving calibration matrix is not supported on %s driver", TouchTypes[driver]);
+			g_failures++;
 			return;
 		}
-
-		fseek(f, 0, SEEK_END);    
-		int file_size = ftell(f); 
-		if (file_size != 56)
+		/* a raw 56 byte file or the entry for this unit in an archive */
+		unsigned char buffer[80];
+		if (!calibration_read(argv[start_index + 1], g_currentDevice, buffer))
 		{
-			fclose(f);
-			printf("File size mismatch, %s is %d bytes, expected 56.\n", argv[start_index + 1], file_size);
+			g_failures++;
+			return;
 		}
-		fseek(f, 0, SEEK_SET); // seek back to beginning of file
-		int size = fread(buffer, 1, 56, f);
-		fclose(f);
-		if (set_calmatrix(device, buffer, size))
+		if (set_calmatrix(device, buffer, 56))
 		{
-			printf("Calibration matrix written to unit\nPlease reconnect the USB cable to load the new settings.\n");
+			htt_printf("Calibration matrix written to unit\nPlease reconnect the USB cable to load the new settings.\n");
 		}
 		else
 		{
-			printf("Error saving calibration matrix.");
+			htt_printf("Error saving calibration matrix.");
+			g_failures++;
 		}
 	}
 }
 
+size_t haptic_report(unsigned char* buf, uint8_t duration)
+{
+	HapticReport report;
+	report.set<0>(duration);
+	memcpy(buf, report.bytes(), report.size);
+	return report.size;
+}
+
 int set_hapticduration(hid_device *handle, uint8_t duration)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_HAPTIC;
-	buf[1] = duration;
-	int res = hid_send_feature_report(handle, buf, 2);
-	if (res < 0) {
+	HapticReport report;
+	report.set<0>(duration);
+	if (report.send(handle) < 0) {
 		return 0;
 	}
 	return 1;
 }
 
+size_t piezo_report(unsigned char* buf, uint8_t duration)
+{
+	PiezoReport report;
+	report.set<0>(duration);
+	memcpy(buf, report.bytes(), report.size);
+	return report.size;
+}
+
 int set_piezoduration(hid_device *handle, uint8_t duration)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_PIEZO;
-	buf[1] = duration;
-	int res = hid_send_feature_report(handle, buf, 2);
-	if (res < 0) {
+	PiezoReport report;
+	report.set<0>(duration);
+	if (report.send(handle) < 0) {
 		return 0;
 	}
 	return 1;
@@ -403,11 +490,9 @@ int set_piezoduration(hid_device *handle, uint8_t duration)
 
 int set_touchfeedback(hid_device *handle, uint8_t setting)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_TOUCHFEEDBACK;
-	buf[1] = setting;
-	int res = hid_send_feature_report(handle, buf, 2);
-	if (res < 0) {
+	TouchFeedbackReport report;
+	report.set<0>(setting);
+	if (report.send(handle) < 0) {
 		return 0;
 	}
 	return 1;
@@ -415,27 +500,22 @@ int set_touchfeedback(hid_device *handle, uint8_t setting)
 
 int get_touchfeedback(hid_device *handle)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_TOUCHFEEDBACK;
-	int res = hid_get_feature_report(handle, buf, 2);
-	if (res < 0) {
-		return 0;
+	TouchFeedbackReport report;
+	if (report.read(handle) < 0) {
+		return -1;
 	}
-	return buf[1];
+	return report.get<0>();
 }
 
 int set_touchdim(hid_device *handle, int brightness[4], int timeout[4])
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_TOUCHDIM;
+	TouchDimReport report;
 	for (int i = 0; i < 4; i++)
 	{
-		buf[i + 1] = brightness[i] & 0xFF;
-		buf[(i * 2) + 5]= ((timeout[i] & 0xFF00) >> 8);
-		buf[(i * 2) + 6] = (timeout[i] & 0xFF);
+		report.set<0>(i, brightness[i] & 0xFF);
+		report.set<1>(i, timeout[i] & 0xFFFF);
 	}
-	int res = hid_send_feature_report(handle, buf, 13);
-	if (res < 0) {
+	if (report.send(handle) < 0) {
 		return 0;
 	}
 	return 1;
@@ -443,45 +523,49 @@ int set_touchdim(hid_device *handle, int brightness[4], int timeout[4])
 
 int factory_reset(hid_device *handle)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_FACTORY_RESET;
-	buf[1] = 0;
-	int res = hid_send_feature_report(handle, buf, 2);
-	if (res < 0) {
+	FactoryResetReport report;
+	report.set<0>(0);
+	if (report.send(handle) < 0) {
 		return 0;
 	}
 	return 1;
 }
 
+size_t alarm_report(unsigned char* buf, uint8_t alarm_type, uint16_t duration, uint8_t blink)
+{
+	AlarmReport report;
+	report.set<0>(alarm_type);
+	report.set<1>(duration);
+	report.set<2>(blink);
+	memcpy(buf, report.bytes(), report.size);
+	return report.size;
+}
+
 int do_alarm(hid_device *handle, uint8_t alarm_type, uint16_t duration, uint8_t blink)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_ALARM;
-	buf[1] = alarm_type;
-	buf[2] = ((duration & 0xFF00) >> 8);
-	buf[3] = (duration & 0xFF);
-	buf[4] = blink;
-	int res = hid_send_feature_report(handle, buf, 5);
-	if (res < 0) {
-		printf("Alarm fail\n");
+	AlarmReport report;
+	report.set<0>(alarm_type);
+	report.set<1>(duration);
+	report.set<2>(blink);
+	if (report.send(handle) < 0) {
+		htt_printf("Alarm fail\n");
+		g_failures++;
 		return 0;
 	}
-	printf("Alarm success\n");
+	htt_printf("Alarm success\n");
 	return 1;
 }
 
 int get_touchdim(hid_device *handle, int brightness[4], int timeout[4])
 {
-	unsigned char buf[256] = { 0 };
-	buf[0] = REPORT_TOUCHDIM;
-	int res = hid_get_feature_report(handle, buf, 13);
-	if (res < 0) {
+	TouchDimReport report;
+	if (report.read(handle) < 0) {
 		return 0;
 	}
 	for (int i = 0; i < 4; i++)
 	{
-		brightness[i] = buf[1 + i];
-		timeout[i] = buf[(i * 2) + 5] << 8 | buf[(i * 2) + 6];
+		brightness[i] = report.get<0>(i);
+		timeout[i] = report.get<1>(i);
 	}
 
 	return 1;
@@ -489,11 +573,9 @@ int get_touchdim(hid_device *handle, int brightness[4], int timeout[4])
 
 int capcalibrate(hid_device* handle)
 {
-	unsigned char buf[256];
-	buf[0] = REPORT_PCAPCALIBRATE;	
-	buf[1] = 0;
-	int res = hid_send_feature_report(handle, buf, 2);
-	if (res < 0) {
+	CapCalibrateReport report;
+	report.set<0>(0);
+	if (report.send(handle) < 0) {
 		return 0;
 	}
 	return 1;
@@ -501,150 +583,304 @@ int capcalibrate(hid_device* handle)
 
 void help(hid_device* device, char* argv[], int start_index)
 {
-	printf("Usage: htt_util [options]\n\n");
-	printf("options:\n");
-	printf(" --help\n");
-	printf("    Show help (this message).\n\n");
-	printf(" --device [id]\n");
-	printf("    Selects the target for the following commands in setups where multiple HTTs\n");
-	printf("    are connected. (0 = default)\n\n");
-	printf(" --loadcalibration [filename]\n");
-	printf("    Load the calibration data from a file, only available on resistive\n");
-	printf("    touch screens.\n\n");
-	printf(" --rotatetouch [degrees]\n");
-	printf("    Sets and saves the rotation for the touch panel (visual output will not\n");
-	printf("    change orientation.) Normally the host OS should take care of screen\n");
-	printf("    rotation, if the host OS does not support this, this options offers\n");
-	printf("    the option to apply the rotation on the device\n");
-	printf("    degrees can be [0, 90, 180, 270]. \n");
-	printf("    \n");
-	printf(" --savecalibration [filename]\n");
-	printf("    Save the calibration data to a file, only available on resistive touch\n");
-	printf("    screens.\n\n");
-	printf(" --scan\n");
-	printf("    Scan for HTT modules and display their settings.\n\n");
-	printf(" --sensitivity [level]\n");
-	printf("    Sets the sensitivity of the touch panel.\n");
-	printf("    This setting is only available on mxt and 7\" gt9xx driver based modules.\n");
-	printf("    Attempting set this option to anything besides 'normal' on any other product\n");
-	printf("    will lead to undefined behavior and is not recommended.\n\n");
-	printf("    level for mxt can be [normal,high,extra]\n");
-	printf("    level for 7\" GT9xx can be [normal,high]\n\n\n");
-	printf(" --threshold [level]\n");
-	printf("    Sets the sensitivity of the touch panel for resistive models.\n");
-	printf("===Following commands are for PCB Rev 1.5 or higher only====\n\n"); 
-	printf(" --backlight [setting]\n");
-	printf("    set backlight brightness [0-255]\n\n");
-	printf(" --backlightfade [time in ms]\n");
-	printf("    set and save the response time to a backlight brightness change\n\n");
-	printf(" --backlightset [setting]\n");
-	printf("    set and save backlight brightness [0-255]\n\n");
-	printf(" --haptic [duration]\n");
-	printf("	enable haptic feedback for [duration]\n");
-	printf("    [duration] duration for haptic feedback (in 100ms increments)\n");
-	printf("    for 1 second - use 10 \n\n");
-	printf(" --piezo [duration]\n");
-	printf("	sound the piezo at 440hz for [duration]\n");
-	printf("    [duration] duration for piezo (in 100ms increments)\n");
-	printf("    for 1 second - use 10\n\n");
-	printf(" --alarm [type] [duration] [flash]\n");
-	printf("    The alarm will continue until either one of the folowwing conditions occurs:\n");
-	printf("	     - The duration of the alarm is reached.\n");
-	printf("	     - The screen is touched (touch capable models only).\n");
-	printf("	     - The alarm is canceled by selecting alarm type 0.\n");
-	printf("    type 0-17 alarm type [0 = off]\n");
-	printf("    duration duration for the alarm (in 100ms increments, for 1 second - use 10), use -1 for no timeout, the alarm will continue until touch or cancelation.\n\n");
-	printf("    flash - flashes per second, max = 10, off = 0\n\n");
-	printf(" --touchfeedback\n");
-	printf("    set touch feedback: [0 none, 1 haptic, 2 piezo, 3 haptic and piezo].\n\n");
-	printf(" --touchdim [time1] [brightness1] [time2] [brightness2] [time3] [brightness3] [time4] [brightness4]\n");
-	printf("    dim the display after [time] seconds of inactivity.\n");
-	printf("    [time1]       [0-600] time in seconds since last touch\n");
-	printf("    [brightness1] [0-255] brightness of the display 0 = Off, 255 is full brightness\n");
-	printf("    [time2]       [0-600] time in seconds since [time1]\n");
-	printf("    [brightness2] [0-255] brightness of the display 0 = Off, 255 is full brightness\n");
-	printf("    [time3]       [0-600] time in seconds since [time3]\n");
-	printf("    [brightness3] [0-255] brightness of the display 0 = Off, 255 is full brightness\n");
-	printf("    [time4]       [0-600] time in seconds since [time4]\n");
-	printf("    [brightness4] [0-255] brightness of the display 0 = Off, 255 is full brightness\n");
-	printf("    to disable feature: --touchdim 0 0 0 0 0 0 0 0\n");
-	printf("    Note: while time is specified in seconds, for convenience time can be postfixed with the letter 'm' for specify minutes ie 5m would automatically convert to 300 seconds.");
-	printf(" --capcalibrate \n");
-	printf("    PCAP calibrate\n\n");
-	printf(" --factorydefaults\n");
-	printf("    reset the unit to factory defaults\n");
+	htt_printf("Usage: htt_util [options]\n\n");
+	htt_printf("options:\n");
+	htt_printf(" --help\n");
+	htt_printf("    Show help (this message).\n\n");
+	htt_printf(" --script [filename|-]\n");
+	htt_printf("    Run the commands in a file (or stdin for -), one command line per line.\n");
+	htt_printf("    Devices are opened once for the whole script and the result of every\n");
+	htt_printf("    line is reported. Empty lines and lines starting with # are skipped.\n\n");
+	htt_printf(" --device all, --device [id],[id],[first]-[last]\n");
+	htt_printf("    Runs the following commands (up to the next --device) on all or on the\n");
+	htt_printf("    listed units at the same time. Output is shown per unit in index order.\n\n");
+	htt_printf(" --jobs [count]\n");
+	htt_printf("    Maximum number of units --device all works on at the same time. (32 = default)\n\n");
+	htt_printf(" --reboottimeout [seconds]\n");
+	htt_printf("    Time to wait for a unit to come back after a command that reboots it\n");
+	htt_printf("    (--sensitivity, --factorydefaults), the remaining commands continue\n");
+	htt_printf("    once the unit is back. (15 = default)\n\n");
+	htt_printf(" --device [id]\n");
+	htt_printf("    Selects the target for the following commands in setups where multiple HTTs\n");
+	htt_printf("    are connected. (0 = default)\n");
+	htt_printf("    Instead of an index a unit can be selected by serial:[serial number],\n");
+	htt_printf("    path:[hidraw node] or port:[usb port] (as shown by --scan).\n\n");
+	htt_printf(" --loadcalibration [filename]\n");
+	htt_printf("    Load the calibration data from a file, only available on resistive\n");
+	htt_printf("    touch screens.\n\n");
+	htt_printf(" --backup-calibration [directory]\n");
+	htt_printf("    Save the calibration data of every resistive unit to [directory], the\n");
+	htt_printf("    files are named after the serial number of the unit.\n\n");
+	htt_printf(" --restore-calibration [directory]\n");
+	htt_printf("    Load the calibration data saved by --backup-calibration into every\n");
+	htt_printf("    resistive unit. Units that already have that calibration are skipped.\n");
+	htt_printf("    A [directory] ending in .htca is a single calibration archive instead.\n\n");
+	htt_printf(" --import-calibration [archive.htca] [serial.bin]\n");
+	htt_printf("    Add a raw calibration file to an archive, the serial number is taken\n");
+	htt_printf("    from the file name.\n\n");
+	htt_printf(" --rotatetouch [degrees]\n");
+	htt_printf("    Sets and saves the rotation for the touch panel (visual output will not\n");
+	htt_printf("    change orientation.) Normally the host OS should take care of screen\n");
+	htt_printf("    rotation, if the host OS does not support this, this options offers\n");
+	htt_printf("    the option to apply the rotation on the device\n");
+	htt_printf("    degrees can be [0, 90, 180, 270]. \n");
+	htt_printf("    \n");
+	htt_printf(" --savecalibration [filename]\n");
+	htt_printf("    Save the calibration data to a file, only available on resistive touch\n");
+	htt_printf("    screens.\n\n");
+	htt_printf(" --scan\n");
+	htt_printf("    Scan for HTT modules and display their settings.\n\n");
+	htt_printf(" --snapshot [filename]\n");
+	htt_printf("    Save every setting of every unit to a file.\n\n");
+	htt_printf(" --restore [filename]\n");
+	htt_printf("    Write the settings of a snapshot back to the units it lists, only the\n");
+	htt_printf("    settings that differ are written.\n\n");
+	htt_printf(" --check [profile|snapshot]\n");
+	htt_printf("    Compare the units with a snapshot or a profile holding only some of the\n");
+	htt_printf("    settings. Only those settings are read, differences are listed and the\n");
+	htt_printf("    exit code is 1 when anything drifted.\n\n");
+	htt_printf(" --sensitivity [level]\n");
+	htt_printf("    Sets the sensitivity of the touch panel.\n");
+	htt_printf("    This setting is only available on mxt and 7\" gt9xx driver based modules.\n");
+	htt_printf("    Attempting set this option to anything besides 'normal' on any other product\n");
+	htt_printf("    will lead to undefined behavior and is not recommended.\n\n");
+	htt_printf("    level for mxt can be [normal,high,extra]\n");
+	htt_printf("    level for 7\" GT9xx can be [normal,high]\n\n\n");
+	htt_printf(" --threshold [level]\n");
+	htt_printf("    Sets the sensitivity of the touch panel for resistive models.\n");
+	htt_printf("===Following commands are for PCB Rev 1.5 or higher only====\n\n"); 
+	htt_printf(" --backlight [setting]\n");
+	htt_printf("    set backlight brightness [0-255]\n");
+	htt_printf("    volatile settings are queued and only the last value is sent\n\n");
+	htt_printf(" --backlightfade [time in ms]\n");
+	htt_printf("    set and save the response time to a backlight brightness change\n\n");
+	htt_printf(" --backlightset [setting]\n");
+	htt_printf("    set and save backlight brightness [0-255]\n\n");
+#ifndef _WIN32
+	htt_printf(" --autodim [policyfile]\n");
+	htt_printf("    Stay resident and dim every unit in stages while it is not touched, full\n");
+	htt_printf("    brightness comes back on the first touch. The policy file holds one\n");
+	htt_printf("    [HH:MM] section per daypart. Runs until Ctrl+C. (Linux only)\n\n");
+	htt_printf(" --schedule [file]\n");
+	htt_printf("    Stay resident and fire the backlight, fade, alarm and feedback actions of\n");
+	htt_printf("    a schedule file at their times of day. Runs until Ctrl+C. (Linux only)\n\n");
+#endif
+	htt_printf(" --haptic [duration]\n");
+	htt_printf("	enable haptic feedback for [duration]\n");
+	htt_printf("    [duration] duration for haptic feedback (in 100ms increments)\n");
+	htt_printf("    for 1 second - use 10 \n\n");
+	htt_printf(" --piezo [duration]\n");
+	htt_printf("	sound the piezo at 440hz for [duration]\n");
+	htt_printf("    [duration] duration for piezo (in 100ms increments)\n");
+	htt_printf("    for 1 second - use 10\n\n");
+	htt_printf(" --alarm [type] [duration] [flash]\n");
+	htt_printf("    The alarm will continue until either one of the folowwing conditions occurs:\n");
+	htt_printf("	     - The duration of the alarm is reached.\n");
+	htt_printf("	     - The screen is touched (touch capable models only).\n");
+	htt_printf("	     - The alarm is canceled by selecting alarm type 0.\n");
+	htt_printf("    type 0-17 alarm type [0 = off]\n");
+	htt_printf("    duration duration for the alarm (in 100ms increments, for 1 second - use 10), use -1 for no timeout, the alarm will continue until touch or cancelation.\n\n");
+	htt_printf("    flash - flashes per second, max = 10, off = 0\n\n");
+#ifndef _WIN32
+	htt_printf(" --pattern [steps]\n");
+	htt_printf("    Play a pattern such as \"haptic 1, wait 150, haptic 1, wait 150, haptic 4\".\n");
+	htt_printf("    Steps: haptic N, piezo N, alarm type duration flash, backlight level,\n");
+	htt_printf("    wait ms and repeat N. The timing error of every step is shown. (Linux only)\n\n");
+	htt_printf(" --touch-stats [seconds]\n");
+	htt_printf("    Measure the input report rate of every unit: intervals, longest gaps,\n");
+	htt_printf("    burst sizes and reader backlog. 0 runs until Ctrl+C. (Linux only)\n\n");
+	htt_printf(" --touch-filter [deadband,window_ms,debounce_ms]\n");
+	htt_printf("    Filter the touches read by the following commands: drop reports that\n");
+	htt_printf("    moved no more than deadband, pass movement on at most once per window\n");
+	htt_printf("    and drop contacts shorter than debounce. (Linux only)\n\n");
+	htt_printf(" --touch-transform [rotation[,WxH[,a,b,c,d,e,f]]]\n");
+	htt_printf("    Transform the touches read by the following commands on the host: rotate\n");
+	htt_printf("    by 0/90/180/270 degrees, scale to WxH (0 keeps touch units) and apply an\n");
+	htt_printf("    affine calibration x' = ax+by+c, y' = dx+ey+f first. (Linux only)\n\n");
+	htt_printf(" --touch-monitor [seconds]\n");
+	htt_printf("    Print the decoded touches of every unit, one line per frame that passes\n");
+	htt_printf("    the touch filter. 0 runs until Ctrl+C. (Linux only)\n\n");
+	htt_printf(" --uinput-bridge [seconds]\n");
+	htt_printf("    Pass the touches of every unit on through a uinput multitouch device,\n");
+	htt_printf("    for hosts where no kernel driver binds. 0 runs until Ctrl+C. (Linux only)\n\n");
+	htt_printf(" --wall [layoutfile]\n");
+	htt_printf("    Merge the touches of the units placed in the layout file into one uinput\n");
+	htt_printf("    multitouch device spanning the video wall, until Ctrl+C. (Linux only)\n\n");
+	htt_printf(" --heatmap [WxH,seconds,csv|pgm[,prefix]]\n");
+	htt_printf("    Count the touches of every unit in a grid of WxH cells until Ctrl+C and\n");
+	htt_printf("    write it to prefix-[serial].csv or .pgm every interval and on SIGUSR1.\n");
+	htt_printf("    (Linux only)\n\n");
+	htt_printf(" --touch-regions [mapfile]\n");
+	htt_printf("    Send haptic or piezo feedback only for touches on the regions of the map\n");
+	htt_printf("    until Ctrl+C, with the touch to command latency. (Linux only)\n\n");
+	htt_printf(" --record [file]\n");
+	htt_printf("    Log the input reports of every unit to file.0000, file.0001, ... until\n");
+	htt_printf("    Ctrl+C, delta encoded, with timestamps and serial numbers. (Linux only)\n\n");
+	htt_printf(" --replay [file]\n");
+	htt_printf("    Print the reports of a log made by --record, decoded into touches. (Linux only)\n\n");
+	htt_printf(" --touch-calibrate [5|9[,directory|,write]]\n");
+	htt_printf("    Calibrate every resistive unit from touches of 5 or 9 targets, fit on the\n");
+	htt_printf("    host and printed, saved to a directory or written to the unit. (Linux only)\n\n");
+	htt_printf(" --autotune-threshold [seconds[,low-high]]\n");
+	htt_printf("    Binary search the lowest touch threshold of every unit that gives no\n");
+	htt_printf("    false touches while the panels are left untouched for seconds per step.\n");
+	htt_printf("    Ctrl+C restores the old thresholds. (Linux only)\n\n");
+	htt_printf(" --touch-bench [seconds]\n");
+	htt_printf("    Measure how fast touch reports are decoded, for a 10 finger reference\n");
+	htt_printf("    layout and the touch report of every unit, and how fast points are\n");
+	htt_printf("    transformed by every kernel the CPU supports, on one core. (Linux only)\n\n");
+#endif
+	htt_printf(" --touchfeedback\n");
+	htt_printf("    set touch feedback: [0 none, 1 haptic, 2 piezo, 3 haptic and piezo].\n\n");
+	htt_printf(" --touchdim [time1] [brightness1] [time2] [brightness2] [time3] [brightness3] [time4] [brightness4]\n");
+	htt_printf("    dim the display after [time] seconds of inactivity.\n");
+	htt_printf("    [time1]       [0-600] time in seconds since last touch\n");
+	htt_printf("    [brightness1] [0-255] brightness of the display 0 = Off, 255 is full brightness\n");
+	htt_printf("    [time2]       [0-600] time in seconds since [time1]\n");
+	htt_printf("    [brightness2] [0-255] brightness of the display 0 = Off, 255 is full brightness\n");
+	htt_printf("    [time3]       [0-600] time in seconds since [time3]\n");
+	htt_printf("    [brightness3] [0-255] brightness of the display 0 = Off, 255 is full brightness\n");
+	htt_printf("    [time4]       [0-600] time in seconds since [time4]\n");
+	htt_printf("    [brightness4] [0-255] brightness of the display 0 = Off, 255 is full brightness\n");
+	htt_printf("    to disable feature: --touchdim 0 0 0 0 0 0 0 0\n");
+	htt_printf("    Note: while time is specified in seconds, for convenience time can be postfixed with the letter 'm' for specify minutes ie 5m would automatically convert to 300 seconds.");
+	htt_printf(" --capcalibrate \n");
+	htt_printf("    PCAP calibrate\n\n");
+	htt_printf(" --factorydefaults\n");
+	htt_printf("    reset the unit to factory defaults\n");
 #if defined(HTT_UTIL_WITH_FACTORY_COMMANDS)
-	printf(" --brownout [level]\n");
-	printf("    sets the brownout reset level\n");
-	printf("    0 = Disabled\n");
-	printf("    1 = 2.06v\n");
-	printf("    2 = 2.35v\n");
-	printf("    3 = 2.63v\n");
+	htt_printf(" --brownout [level]\n");
+	htt_printf("    sets the brownout reset level\n");
+	htt_printf("    0 = Disabled\n");
+	htt_printf("    1 = 2.06v\n");
+	htt_printf("    2 = 2.35v\n");
+	htt_printf("    3 = 2.63v\n");
 #endif
 
 }
 
+/* Sizes the feature reports are built with, compared against what the
+   report descriptor declares in a verbose scan. */
+static const struct
+{
+	uint8_t id;
+	size_t size;
+	const char* name;
+} report_layouts[] =
+{
+	{ DriverReport::id, DriverReport::size, "driver" },
+	{ CalmatrixReport::id, CalmatrixReport::size, "calmatrix" },
+	{ SensitivityReport::id, SensitivityReport::size, "sensitivity" },
+	{ RotationReport::id, RotationReport::size, "rotation" },
+	{ FwrevReport::id, FwrevReport::size, "fwrev" },
+	{ BacklightReport::id, BacklightReport::size, "backlight" },
+	{ HapticReport::id, HapticReport::size, "haptic" },
+	{ PiezoReport::id, PiezoReport::size, "piezo" },
+	{ ModuleIdReport::id, ModuleIdReport::size, "moduleid" },
+	{ TouchFeedbackReport::id, TouchFeedbackReport::size, "touchfeedback" },
+	{ TouchDimReport::id, TouchDimReport::size, "touchdim" },
+	{ CapCalibrateReport::id, CapCalibrateReport::size, "capcalibrate" },
+	{ FadeReport::id, FadeReport::size, "fade" },
+	{ FactoryResetReport::id, FactoryResetReport::size, "factoryreset" },
+	{ AlarmReport::id, AlarmReport::size, "alarm" },
+	{ ThresholdReport::id, ThresholdReport::size, "threshold" },
+};
+
+static void check_report_layouts(hid_device *handle)
+{
+	hid_report_info info;
+	int mismatches = 0;
+
+	if (hid_get_report_info(handle, REPORT_FWREV, &info) < 0 &&
+		hid_get_report_info(handle, REPORT_DRIVER_TYPE, &info) < 0)
+	{
+		htt_printf("- Report Layouts    : descriptor not available\n");
+		return;
+	}
+	for (size_t i = 0; i < sizeof(report_layouts) / sizeof(report_layouts[0]); i++)
+	{
+		size_t declared = 0;
+		if (hid_get_report_info(handle, report_layouts[i].id, &info) == 0)
+			declared = info.size[HID_REPORT_FEATURE];
+		if (declared == report_layouts[i].size)
+			continue;
+		if (!mismatches++)
+			htt_printf("- Report Layouts    :\n");
+		if (declared)
+			htt_printf("\t%s (%d) is %d bytes, the device declares %d\n", report_layouts[i].name,
+				report_layouts[i].id, (int)report_layouts[i].size, (int)declared);
+		else
+			htt_printf("\t%s (%d) is not declared by the device\n", report_layouts[i].name, report_layouts[i].id);
+	}
+	if (!mismatches)
+		htt_printf("- Report Layouts    : match the descriptor\n");
+}
+
 void scan_internal(hid_device *handle, int index)
 {
 	if (checkhtt(handle))
 	{
 		int driver = get_driver(handle);
 		int fwrev = get_fwrev(handle);
-		printf("HTT Detected.\n");
-		printf("- Device            : %d\n", index);
-		printf("- Firmware Rev      : %d\n", fwrev);
-		printf("- Driver Type       : %s (%d)\n", TouchTypes[driver], driver);
-		printf("- Screen Rotation   : %s degrees\n", Rotation[get_rotation(handle)]);
-		printf("- Default Backlight : %d \n", get_backlight(handle));
+		htt_printf("HTT Detected.\n");
+		htt_printf("- Device            : %d\n", index);
+		if (g_identities[index].serial[0])
+			htt_printf("- Serial Number     : %s\n", g_identities[index].serial);
+		if (g_identities[index].port[0])
+			htt_printf("- USB Port          : %s\n", g_identities[index].port);
+		htt_printf("- Firmware Rev      : %d\n", fwrev);
+		htt_printf("- Driver Type       : %s (%d)\n", driver < 0 ? "Invalid" : TouchTypes[driver], driver);
+		htt_printf("- Screen Rotation   : %s degrees\n", Rotation[get_rotation(handle)]);
+		htt_printf("- Default Backlight : %d \n", get_backlight(handle));
 		int feedback = get_touchfeedback(handle);
-		if (feedback > 3) {
+		if (feedback < 0 || feedback > 3) {
 			feedback = 4;
 		}
-		printf("- Touch feedback    : %d (%s) \n", feedback, TouchFeedbackTypes[feedback]);
+		htt_printf("- Touch feedback    : %d (%s) \n", feedback, TouchFeedbackTypes[feedback]);
 		if (fwrev > 11762)
 		{
-			printf("- Backlight fade    : %d \n", get_backlight_fade(handle));
+			htt_printf("- Backlight fade    : %d \n", get_backlight_fade(handle));
 			int brightness[4] = { 0 };
 			int timeout[4] = { 0 } ;
 			if (get_touchdim(handle, brightness, timeout))
 			{
 				if (timeout[0]) {
-					printf("- Backlight dimming \n");
+					htt_printf("- Backlight dimming \n");
 					for (int i = 0; i < 4; i++)
 					{
 						if (!timeout[i])
 							break;
-						printf("\tAfter %d seconds set backlight to %d\n", timeout[i], brightness[i]);
+						htt_printf("\tAfter %d seconds set backlight to %d\n", timeout[i], brightness[i]);
 					}
 				}
 				else {
-					printf("- Backlight dimming : Disabled\n");
+					htt_printf("- Backlight dimming : Disabled\n");
 				}
 			}
 		}
 		if (driver == TOUCH_MXTxx || driver == TOUCH_GT9xx)
 		{
 			int sens = get_sensitivity(handle);
-			printf("- Touch Sensitivity : %d (%s).\n", sens, Sensitivity[sens]);
+			htt_printf("- Touch Sensitivity : %d (%s).\n", sens, sens < 0 || sens > 2 ? "Invalid" : Sensitivity[sens]);
 		}
 		if (fwrev > 14684)
 		{
 			int threshold = get_touch_threshold(handle);
-			printf("- Touch Threshold   : %d\n", threshold);
+			htt_printf("- Touch Threshold   : %d\n", threshold);
 		}
 		if (g_verbose && fwrev > 10656)
 		{
-			printf("- Module ID         : %d\n", get_moduleID(handle));
+			htt_printf("- Module ID         : %d\n", get_moduleID(handle));
 #ifdef HTT_UTIL_WITH_FACTORY_COMMANDS
 			uint16_t customID = get_customID(handle);
-			printf("- Custom ID         : %4x\n", customID);
+			htt_printf("- Custom ID         : %4x\n", customID);
 #endif
 		}
 		if (g_verbose && fwrev > 12635)
 		{
 #ifdef HTT_UTIL_WITH_FACTORY_COMMANDS
 			uint32_t PCB_Rev = get_pcbRevision(handle);
-			printf("- PCB Revision      : %d.%d.%d\n", 
+			htt_printf("- PCB Revision      : %d.%d.%d\n", 
 				(PCB_Rev >> 16) & 0xff, 
 				(PCB_Rev >> 8) & 0xff, 
 				(PCB_Rev >> 0) & 0xff
@@ -655,7 +891,7 @@ void scan_internal(hid_device *handle, int index)
 		{
 #ifdef HTT_UTIL_WITH_FACTORY_COMMANDS
 			uint32_t period = get_BacklightPeriod(handle);
-			printf("- Backlight Period  : %d (%d Hz)\n", 
+			htt_printf("- Backlight Period  : %d (%d Hz)\n", 
 				period, (int) (48e6 / period)
 			);
 #endif
@@ -680,9 +916,13 @@ void scan_internal(hid_device *handle, int index)
 				brown_str = "2.63v";
 				break;
 			}
-			printf("- Brownout Reset    : %d (%s)\n", brownout, brown_str);
+			htt_printf("- Brownout Reset    : %d (%s)\n", brownout, brown_str);
 #endif
 		}
+		if (g_verbose)
+		{
+			check_report_layouts(handle);
+		}
 
 
 #if defined(HTT_UTIL_WITH_FACTORY_COMMANDS)
@@ -690,7 +930,7 @@ void scan_internal(hid_device *handle, int index)
 		{
 			dump911(handle);
 		}
-		printf("\n");
+		htt_printf("\n");
 #endif
 	}
 }
@@ -706,7 +946,7 @@ void scan(hid_device *handle, char* argv[], int start_index)
 	}
 	else
 	{
-		printf("No HTT detected\n");
+		htt_printf("No HTT detected\n");
 	}
 }
 
@@ -725,8 +965,14 @@ void do_brightness(hid_device* device, char* argv[], int start_index, int save)
 			brightness = 255;
 		if (brightness < 0)
 			brightness = 0;
+		if (!save)
+		{
+			int queued = queue_backlight(device, brightness);
+			htt_printf("Setting brightness to %d : %s\n", brightness, queued ? "Queued." : "Failed.");
+			return;
+		}
 		int success = set_backlight(device, brightness, save);
-		printf("Setting brightness to %d : %s\n", brightness, success ? "Success!" : "Failed.");
+		htt_printf("Setting brightness to %d : %s\n", brightness, result_string(success));
 		return;
 	}
 }
@@ -741,7 +987,7 @@ void do_touch_threshold(hid_device* device, char* argv[], int start_index)
 		if (threshold < 0)
 			threshold = 0;
 		int success = set_touch_threshold(device, threshold);
-		printf("Setting touch threshold to %d : %s\n", threshold, success ? "Success!" : "Failed.");
+		htt_printf("Setting touch threshold to %d : %s\n", threshold, result_string(success));
 		return;
 	}
 }
@@ -755,8 +1001,14 @@ void do_fade(hid_device* device, char* argv[], int start_index, int save)
 			fade = 0xffff;
 		if (fade < 0)
 			fade = 0;
+		if (!save)
+		{
+			int queued = queue_fade(device, fade);
+			htt_printf("Setting fade to %d : %s\n", fade, queued ? "Queued." : "Failed.");
+			return;
+		}
 		int success = set_fade(device, fade,save);
-		printf("Setting fade to %d : %s\n", fade, success ? "Success!" : "Failed.");
+		htt_printf("Setting fade to %d : %s\n", fade, result_string(success));
 		return;
 	}
 }
@@ -783,15 +1035,36 @@ void brightnessset(hid_device* device, char* argv[], int start_index)
 
 void select_device(hid_device* device, char* argv[], int start_index)
 {
-	size_t devid = atoi(argv[start_index + 1]);
+	const char* selector = argv[start_index + 1];
+	if (strchr(selector, ':'))
+	{
+		size_t index;
+		int res = device_index_lookup(selector, &index);
+		if (res > 0)
+		{
+			g_currentDevice = index;
+			htt_printf("Device %zu (%s) selected.\n", index, selector);
+		}
+		else
+		{
+			htt_printf(res < 0 ? "Invalid device selector : %s\n" : "No HTT matches : %s\n", selector);
+			/* don't let the following commands hit whatever was selected before */
+			g_currentDevice = g_device_count;
+			g_failures++;
+		}
+		return;
+	}
+
+	size_t devid = atoi(selector);
 	if (devid < g_device_count)
 	{
 		g_currentDevice = devid;
-		printf("Device %d selected.\n",devid);
+		htt_printf("Device %d selected.\n",devid);
 	}
 	else
 	{
-		printf("Invalid device ID : %d\n",devid);
+		htt_printf("Invalid device ID : %d\n",devid);
+		g_failures++;
 	}
 }
 
@@ -805,7 +1078,7 @@ void hapticduration(hid_device* device, char* argv[], int start_index)
 		if (duration < 0)
 			duration = 0;
 		int success = set_hapticduration(device, duration);
-		printf("Setting haptic duration to %d : %s\n", duration, success ? "Success!" : "Failed.");
+		htt_printf("Setting haptic duration to %d : %s\n", duration, result_string(success));
 		return;
 	}
 }
@@ -820,7 +1093,7 @@ void piezoduration(hid_device* device, char* argv[], int start_index)
 		if (duration < 0)
 			duration = 0;
 		int success = set_piezoduration(device, duration);
-		printf("Setting piezo duration to %d : %s\n", duration, success ? "Success!" : "Failed.");
+		htt_printf("Setting piezo duration to %d : %s\n", duration, result_string(success));
 		return;
 	}
 }
@@ -835,7 +1108,7 @@ void touchfeedback(hid_device* device, char* argv[], int start_index)
 		if (setting < 0)
 			setting = 0;
 		int success = set_touchfeedback(device, setting);
-		printf("Setting touch feedback to %d : %s\n", setting, success ? "Success!" : "Failed.");
+		htt_printf("Setting touch feedback to %d : %s\n", setting, result_string(success));
 		return;
 	}
 }
@@ -879,7 +1152,8 @@ void touchdim(hid_device* device, char* argv[], int start_index)
 		{
 			if (!parse_time(argv[start_index + 1 + (i * 2)], &time[i]))
 			{
-				printf("Error parsing time value \"%s\"\n", argv[start_index + 1 + (i * 2)]);
+				htt_printf("Error parsing time value \"%s\"\n", argv[start_index + 1 + (i * 2)]);
+				g_failures++;
 				return;
 			}
 			brightness[i] = atoi(argv[start_index + 2 + (i * 2)]);
@@ -893,7 +1167,7 @@ void touchdim(hid_device* device, char* argv[], int start_index)
 				time[i] = 0xffff;
 		}
 		int success = set_touchdim(device, brightness, time);
-		printf("Setting touch dimming properties : %s\n", success ? "Success!" : "Failed.");
+		htt_printf("Setting touch dimming properties : %s\n", result_string(success));
 		return;
 	}
 }
@@ -903,7 +1177,7 @@ void pcapcalibrate(hid_device* device, char* argv[], int start_index)
 	if (checkhtt(device))
 	{
 		int success = capcalibrate(device);
-		printf("Calibrate: %s\n", success ? "Success!" : "Failed.");
+		htt_printf("Calibrate: %s\n", result_string(success));
 		return;
 	}
 }
@@ -915,7 +1189,7 @@ void alarm(hid_device* device, char* argv[], int start_index)
 		int type = atoi(argv[start_index + 1]);
 		int duration = atoi(argv[start_index + 2]);
 		int blink = atoi(argv[start_index + 3]);
-		printf("alarm type = %d duration = %d blink=%d", type, duration,blink);
+		htt_printf("alarm type = %d duration = %d blink=%d", type, duration,blink);
 		do_alarm(device, type, duration,blink);
 	}
 }
@@ -925,16 +1199,56 @@ void factorydefaults(hid_device* device, char* argv[], int start_index)
 	if (checkhtt(device))
 	{
 		int success = factory_reset(device);
-		printf("Factory Defaults: %s\n", success ? "Success!" : "Failed.");
+		htt_printf("Factory Defaults: %s\n", result_string(success));
 		if (success)
 		{
-			printf("The Factory Defaults command reboots the unit, further commands are not executed.\n");
-			exit(0);
+			htt_printf("The Factory Defaults command reboots the unit, further commands wait for it to come back.\n");
+			g_reboot_pending = 1;
 		}
 		return;
 	}
 }
 
+void reboottimeout(hid_device* device, char* argv[], int start_index)
+{
+	int timeout = atoi(argv[start_index + 1]);
+	if (timeout < 1)
+	{
+		htt_printf("Invalid reboot timeout : %s\n", argv[start_index + 1]);
+		g_failures++;
+		return;
+	}
+	g_reboot_timeout = timeout;
+}
+
+/* Barrier after a command that reboots the unit, waits for the same unit to
+ * show up again and swaps its new handle in. Returns 1 when the remaining
+ * commands can be run. */
+int reboot_barrier(size_t index, hotplug_monitor* monitor)
+{
+	htt_printf("Waiting for device %zu to reboot...\n", index);
+	fflush(stdout);
+	htt_identity old_id = g_identities[index];
+	int elapsed = hotplug_wait(monitor, &g_identities[index], g_reboot_timeout * 1000);
+	device_index_update(index, &old_id, &g_identities[index]);
+	hid_close(g_handles[index]);
+	g_handles[index] = NULL;
+	if (elapsed < 0)
+	{
+		htt_printf("Device %zu did not come back within %d seconds.\n", index, g_reboot_timeout);
+		g_failures++;
+		return 0;
+	}
+	g_handles[index] = hid_open_path(g_identities[index].path);
+	if (!g_handles[index])
+	{
+		htt_printf("Error opening device %zu after reboot.\n", index);
+		g_failures++;
+		return 0;
+	}
+	htt_printf("Device %zu rebooted in %d ms.\n", index, elapsed);
+	return 1;
+}
 
 cli_parm handlers[] =
 {
@@ -952,11 +1266,14 @@ cli_parm handlers[] =
 	{ "--brownout", 2, brownout},
 	#endif
 	{ "--rotatetouch", 2, rotate_touch },
-	{ "--sensitivity", 2, sensitivty },
+	{ "--sensitivity", 2, sensitivty, CLI_REBOOTS },
 	{ "--savecalibration", 2, savecalibration },
 	{ "--loadcalibration", 2, loadcalibration },
-	{ "--backlight", 2,	brightness },
-	{ "--backlightfade", 2,	fade },
+	{ "--backup-calibration", 2, backup_calibration },
+	{ "--restore-calibration", 2, restore_calibration },
+	{ "--import-calibration", 3, import_calibration },
+	{ "--backlight", 2,	brightness, CLI_COALESCE },
+	{ "--backlightfade", 2,	fade, CLI_COALESCE },
 	{ "--backlightset",	2, brightnessset },
 	{ "--backlightfadeset",	2, fadeset},
 	{ "--device", 2, select_device },
@@ -966,15 +1283,111 @@ cli_parm handlers[] =
 	{ "--touchdim", 9, touchdim},
     { "--threshold", 2, do_touch_threshold},
 	{ "--capcalibrate", 1, pcapcalibrate},
-	{ "--factorydefaults", 1, factorydefaults},
-	{ "--alarm", 4, alarm}
+	{ "--factorydefaults", 1, factorydefaults, CLI_REBOOTS },
+	{ "--alarm", 4, alarm},
+	{ "--script", 2, script},
+	{ "--reboottimeout", 2, reboottimeout},
+	{ "--jobs", 2, jobs},
+	{ "--snapshot", 2, snapshot},
+	{ "--restore", 2, restore},
+	{ "--check", 2, check},
+#ifndef _WIN32
+	{ "--autodim", 2, autodim},
+	{ "--schedule", 2, schedule},
+	{ "--pattern", 2, pattern},
+	{ "--touch-stats", 2, touch_stats},
+	{ "--touch-filter", 2, touch_filter},
+	{ "--touch-transform", 2, touch_transform},
+	{ "--touch-monitor", 2, touch_monitor},
+	{ "--uinput-bridge", 2, uinput_bridge},
+	{ "--touch-bench", 2, touch_bench},
+	{ "--record", 2, record},
+	{ "--heatmap", 2, heatmap_monitor},
+	{ "--replay", 2, replay},
+	{ "--touch-calibrate", 2, touch_calibrate},
+	{ "--autotune-threshold", 2, autotune_threshold},
+	{ "--touch-regions", 2, touch_regions},
+	{ "--wall", 2, wall},
+#endif
 };
 
+/* Runs the options in argv[start..argc) the same way they are run from the
+ * command line. Returns the number of commands that failed. */
+int run_commands(int argc, char* argv[], size_t start)
+{
+	int failures = g_failures;
+	for (size_t i = start; i < (size_t)argc;)
+	{
+		bool work_done = false;
+		hotplug_monitor* monitor = NULL;
+		if (strcmp(argv[i], "--device") == 0 && i + 1 < (size_t)argc && fanout_is_selection(argv[i + 1]))
+		{
+			/* Everything up to the next --device runs on all selected units */
+			size_t end = i + 2;
+			while (end < (size_t)argc && strcmp(argv[end], "--device") != 0)
+				end++;
+			coalesce_flush_all();
+			fanout_commands(argv[i + 1], argv, i + 2, end);
+			i = end;
+			continue;
+		}
+		size_t table_size = sizeof(handlers) / sizeof(cli_parm);
+		for (size_t j = 0; j < table_size; j++)
+		{
+			if (strcmp(handlers[j].name, argv[i]) == 0)
+			{
+				if (i + handlers[j].parameter_count <= (size_t)argc)
+				{
+					hid_device *dev = g_currentDevice < g_device_count ? g_handles[g_currentDevice] : NULL;
+					/* Anything that is not a volatile setting is a barrier for
+					 * the coalescing queue, it must see the updates before it. */
+					if (!(handlers[j].flags & CLI_COALESCE))
+					{
+						/* a worker only owns the queue of its own unit */
+						if (fanout_in_worker())
+							coalesce_flush(g_currentDevice);
+						else
+							coalesce_flush_all();
+					}
+					if (handlers[j].flags & CLI_REBOOTS)
+						monitor = hotplug_arm();
+					handlers[j].handler(dev, argv, i);
+					i += handlers[j].parameter_count;
+					work_done = true;
+					break;
+				}
+				else
+				{
+					htt_printf("missing parameter(s) for option : %s\n", argv[i]);
+					break;
+				}
+			}
+		}
+		if (!work_done)
+		{
+			htt_printf("Unknown parameter %s\n", argv[i]);
+			g_failures++;
+			break;
+		}
+		if (g_reboot_pending)
+		{
+			g_reboot_pending = 0;
+			if (!reboot_barrier(g_currentDevice, monitor))
+				break;
+		}
+		else
+		{
+			hotplug_disarm(monitor);
+		}
+	}
+	return g_failures - failures;
+}
+
 int main(int argc, char* argv[])
 {
 	if (hid_init())
 	{
-		printf("Error initializing USB\n");
+		htt_printf("Error initializing USB\n");
 		return -1;
 	}
 
@@ -989,15 +1402,25 @@ int main(int argc, char* argv[])
 
 	/* allocate ram for them */
 	g_handles = (hid_device**)malloc(sizeof(void*)* g_device_count);
+	g_identities = (htt_identity*)malloc(sizeof(htt_identity) * g_device_count);
 	
 	/* store handles for all devices*/
 	iterator = device;
 	int curdevice = 0;
 	while (iterator)
 	{
-		g_handles[curdevice++] = hid_open_path(iterator->path);
+		hotplug_identity(iterator, &g_identities[curdevice]);
+		g_handles[curdevice] = hid_open_path(iterator->path);
+		/* a reboot keeps both, every --check / --restore pass reuses them */
+		g_identities[curdevice].driver = g_handles[curdevice] ? get_driver(g_handles[curdevice]) : -1;
+		g_identities[curdevice].fwrev = g_handles[curdevice] ? get_fwrev(g_handles[curdevice]) : 0;
+		curdevice++;
 		iterator = iterator->next;
 	}
+	hid_free_enumeration(device);
+	device_index_build(g_identities, g_device_count);
+
+	coalesce_init(g_device_count);
 
 	if (argc == 1)
 	{
@@ -1005,41 +1428,19 @@ int main(int argc, char* argv[])
 	}
 	else
 	{
-		for (size_t i = 1; i < (size_t)argc;)
-		{
-			bool work_done = false;
-			size_t table_size = sizeof(handlers) / sizeof(cli_parm);
-			for (size_t j = 0; j < table_size; j++)
-			{
-				if (strcmp(handlers[j].name, argv[i]) == 0)
-				{
-					if (i + handlers[j].parameter_count <= (size_t)argc)
-					{
-						hid_device *dev = g_currentDevice < g_device_count ? g_handles[g_currentDevice] : NULL;
-						handlers[j].handler(dev, argv, i);
-						i += handlers[j].parameter_count;
-						work_done = true;
-						break;
-					}
-					else
-					{
-						printf("missing parameter(s) for option : %s\n", argv[i]);
-						break;
-					}
-				}
-			}
-			if (!work_done)
-			{
-				printf("Unknown parameter %s\n", argv[i]);
-				break;
-			}
-		}
+		run_commands(argc, argv, 1);
 	}
+	coalesce_flush_all();
+	if (g_verbose)
+		coalesce_print_stats();
+	coalesce_free();
 	for (size_t i = 0; i < g_device_count; i++)
 	{
 		hid_close(g_handles[i]);
 	}
 	free(g_handles);
+	free(g_identities);
+	device_index_free();
 	hid_exit();
-	return 0;
+	return g_failures ? 1 : 0;
 }
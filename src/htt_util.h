@@ -0,0 +1,116 @@
+#ifndef HTT_UTIL_H
+#define HTT_UTIL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "hidapi.h"
+#include "htt_hotplug.h"
+
+#define HTT_VENDOR_ID  0x1b3d
+#define HTT_PRODUCT_ID 0x14c9
+
+#define TOUCH_NONE		0
+#define TOUCH_RESISTIVE 1
+#define TOUCH_MXTxx     2       
+#define TOUCH_GT9xx     3       
+#define TOUCH_FT5xx     4
+#define TOUCH_ILI25xx   5
+
+#define REPORT_DRIVER_TYPE     4
+#define REPORT_CALMATRIX       6 
+#define REPORT_MXT_SENSITIVITY 7
+#define REPORT_SCREENROTATION  8
+#define REPORT_FWREV           9
+#define REPORT_BACKLIGHT       10
+#define REPORT_HAPTIC		   11
+#define REPORT_PIEZO		   12
+#define REPORT_MODULEID        13
+#define REPORT_TOUCHFEEDBACK   15	
+#define REPORT_TOUCHDIM		   16	
+#define REPORT_PCAPCALIBRATE   17	
+#define REPORT_BACKLIGHT_FADE  18
+#define REPORT_FACTORY_RESET   19
+#define REPORT_ALARM           20
+#define REPORT_TOUCH_THRESHOLD 26
+
+extern const char* TouchTypes[];
+extern const char* Rotation[];
+extern const char* Sensitivity[];
+extern const char* TouchFeedbackTypes[];
+
+/* g_currentDevice and the per command state are per thread, --device all
+ * runs the commands for every unit on its own thread. */
+extern thread_local size_t g_currentDevice;
+extern size_t g_device_count;
+extern int g_verbose;
+extern thread_local int g_batch;
+extern thread_local int g_failures;
+extern thread_local int g_reboot_pending;
+extern int g_reboot_timeout;
+extern hid_device **g_handles;
+extern htt_identity *g_identities;
+
+/* cli_parm flags */
+#define CLI_COALESCE 1 /* handler only queues volatile reports, no need to flush before it */
+#define CLI_REBOOTS  2 /* handler may reboot the unit, see g_reboot_pending */
+
+typedef void(*parm_handler)(hid_device* device, char* argv[], int start_index);
+typedef struct 
+{
+	const char* name;
+	const size_t parameter_count;
+	parm_handler handler;
+	const int flags;
+} cli_parm;
+
+/* printf() that goes to the capture buffer of the calling thread when set */
+#ifdef __GNUC__
+int htt_printf(const char* format, ...) __attribute__((format(printf, 1, 2)));
+#else
+int htt_printf(const char* format, ...);
+#endif
+void htt_capture_output(std::string* buffer);
+
+int checkhtt(hid_device *handle);
+const char* result_string(int success);
+int run_commands(int argc, char* argv[], size_t start);
+/* Waits for a unit rebooted by the last command, see g_reboot_pending */
+int reboot_barrier(size_t index, hotplug_monitor* monitor);
+
+int get_driver(hid_device *handle);
+int get_fwrev(hid_device *handle);
+int get_rotation(hid_device *handle);
+int set_rotation(hid_device *handle, int rotation);
+int set_touch_threshold(hid_device* handle, uint16_t threshold);
+int get_touch_threshold(hid_device* handle);
+int get_calmatrix(hid_device *handle, unsigned char*out_buffer, size_t buffersize);
+int set_calmatrix(hid_device *handle, unsigned char*matrix, size_t buffersize);
+int set_sensitivity(hid_device *handle, int sensitivity);
+int get_sensitivity(hid_device *handle);
+int get_backlight(hid_device *handle);
+int get_backlight_fade(hid_device *handle);
+
+/* Serialize a feature report into buf, returning its length. The setters
+ * send exactly these, the pattern sequencer prepares them ahead of time. */
+size_t backlight_report(unsigned char* buf, uint8_t backlight, uint8_t save);
+size_t haptic_report(unsigned char* buf, uint8_t duration);
+size_t piezo_report(unsigned char* buf, uint8_t duration);
+size_t alarm_report(unsigned char* buf, uint8_t alarm_type, uint16_t duration, uint8_t blink);
+
+int set_backlight(hid_device *handle, uint8_t backlight, uint8_t save);
+int set_fade(hid_device *handle, uint16_t fade_time, uint8_t save);
+int queue_backlight(hid_device *handle, uint8_t backlight);
+int queue_fade(hid_device *handle, uint16_t fade_time);
+int get_moduleID(hid_device *handle);
+int set_hapticduration(hid_device *handle, uint8_t duration);
+int set_piezoduration(hid_device *handle, uint8_t duration);
+int set_touchfeedback(hid_device *handle, uint8_t setting);
+int get_touchfeedback(hid_device *handle);
+int set_touchdim(hid_device *handle, int brightness[4], int timeout[4]);
+int get_touchdim(hid_device *handle, int brightness[4], int timeout[4]);
+int factory_reset(hid_device *handle);
+int do_alarm(hid_device *handle, uint8_t alarm_type, uint16_t duration, uint8_t blink);
+int capcalibrate(hid_device* handle);
+
+#endif
@@ -0,0 +1,298 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <vector>
+#include "htt_util.h"
+#include "htt_fanout.h"
+#include "htt_histogram.h"
+#include "htt_touchreader.h"
+#include "htt_uinput.h"
+#include "htt_wall.h"
+
+void wall_panel_build(wall_panel* panel, const touch_layout* layout)
+{
+	/* rotate and scale within the panel, then move it into place */
+	transform_config config = { panel->rotation, panel->width, panel->height, 0, { 1, 0, 0, 0, 1, 0 } };
+	touch_layout scaled = *layout;
+	transform_build(&config, &scaled, &panel->transform);
+	point_transform place = { { 1, 0, (float)(panel->x + panel->bezel_left), 0, 1,
+		(float)(panel->y + panel->bezel_top) } };
+	transform_then(&panel->transform, &place);
+}
+
+static char* trim(char* s)
+{
+	while (isspace((unsigned char)*s))
+		s++;
+	size_t len = strlen(s);
+	while (len && isspace((unsigned char)s[len - 1]))
+		s[--len] = 0;
+	return s;
+}
+
+static int parse_pair(const char* value, char separator, int32_t* a, int32_t* b)
+{
+	int used = 0;
+	char format[16];
+	snprintf(format, sizeof(format), "%%d%c%%d%%n", separator);
+	return sscanf(value, format, a, b, &used) == 2 && !value[used];
+}
+
+static int load_layout(const char* path, std::vector<wall_panel>& panels, int32_t* wall_width, int32_t* wall_height)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+	{
+		htt_printf("error opening %s\n", path);
+		return 0;
+	}
+	char buffer[512];
+	int line = 0;
+	int ok = 1;
+	wall_panel* panel = NULL;
+	while (ok && fgets(buffer, sizeof(buffer), f))
+	{
+		line++;
+		char* s = trim(buffer);
+		if (!*s || *s == '#')
+			continue;
+		if (*s == '[')
+		{
+			size_t len = strlen(s);
+			size_t index;
+			int valid = s[len - 1] == ']';
+			s[len - 1] = 0;
+			if (!valid || g_device_count == 0 || fanout_parse_selection(s + 1, &index, 1) != 1 ||
+				panels.size() >= WALL_MAX_PANELS)
+			{
+				htt_printf("%s:%d : expected [selector] of one unit, at most %d panels\n", path, line,
+					WALL_MAX_PANELS);
+				ok = 0;
+				break;
+			}
+			for (size_t i = 0; i < panels.size(); i++)
+				if (panels[i].device == index)
+				{
+					htt_printf("%s:%d : device %zu placed twice\n", path, line, index);
+					ok = 0;
+				}
+			wall_panel placed;
+			memset(&placed, 0, sizeof(placed));
+			placed.device = index;
+			placed.width = -1;
+			panels.push_back(placed);
+			panel = &panels.back();
+			continue;
+		}
+		char* eq = strchr(s, '=');
+		if (!eq)
+		{
+			htt_printf("%s:%d : expected [selector] or name=value\n", path, line);
+			ok = 0;
+			break;
+		}
+		*eq = 0;
+		char* name = trim(s);
+		char* value = trim(eq + 1);
+		if (!panel && strcmp(name, "wall") == 0)
+			ok = parse_pair(value, 'x', wall_width, wall_height) && *wall_width > 0 && *wall_height > 0;
+		else if (panel && strcmp(name, "position") == 0)
+			ok = parse_pair(value, ',', &panel->x, &panel->y);
+		else if (panel && strcmp(name, "bezel") == 0)
+			ok = parse_pair(value, ',', &panel->bezel_left, &panel->bezel_top);
+		else if (panel && strcmp(name, "size") == 0)
+			ok = parse_pair(value, 'x', &panel->width, &panel->height) && panel->width > 1 && panel->height > 1;
+		else if (panel && strcmp(name, "rotation") == 0)
+		{
+			char* end;
+			panel->rotation = (int)strtol(value, &end, 10);
+			ok = !*end && (panel->rotation == 0 || panel->rotation == 90 || panel->rotation == 180 ||
+				panel->rotation == 270);
+		}
+		else
+		{
+			htt_printf("%s:%d : unknown setting %s\n", path, line, name);
+			ok = 0;
+			break;
+		}
+		if (!ok)
+			htt_printf("%s:%d : invalid %s\n", path, line, name);
+	}
+	fclose(f);
+	for (size_t i = 0; ok && i < panels.size(); i++)
+	{
+		if (panels[i].width < 0)
+		{
+			htt_printf("%s : device %zu has no size\n", path, panels[i].device);
+			ok = 0;
+		}
+	}
+	if (ok && panels.empty())
+	{
+		htt_printf("%s : no panels\n", path);
+		ok = 0;
+	}
+	return ok;
+}
+
+typedef struct
+{
+	std::vector<wall_panel> panels;
+	std::vector<int> panel_of;       /* by device index, -1 when not on the wall */
+	touch_reader* reader;
+	uinput_touch* touch;
+	htt_histogram latency;
+	uint64_t frames;
+	uint64_t failed;
+} wall_state;
+
+static void track(wall_panel* panel, const touch_contact* contact)
+{
+	for (int i = 0; i < panel->down_count; i++)
+	{
+		if (panel->down[i] != contact->id)
+			continue;
+		if (!contact->tip)
+			panel->down[i] = panel->down[--panel->down_count];
+		return;
+	}
+	if (contact->tip && panel->down_count < TOUCH_MAX_CONTACTS)
+		panel->down[panel->down_count++] = contact->id;
+}
+
+static void on_frame(size_t device, const touch_frame* frame, uint64_t read_ns, void* context)
+{
+	wall_state* state = (wall_state*)context;
+	int index = state->panel_of[device];
+	if (index < 0)
+		return;
+	wall_panel* panel = &state->panels[index];
+	touch_frame merged = *frame;
+	transform_frame(&panel->transform, &merged);
+	for (int i = 0; i < merged.count; i++)
+	{
+		track(panel, &frame->contacts[i]);
+		/* unique over the wall: the panel in the high bits */
+		merged.contacts[i].id = (int32_t)(((uint32_t)index << 16) | (frame->contacts[i].id & 0xffff));
+	}
+	if (uinput_touch_send(state->touch, &merged))
+	{
+		histogram_add(&state->latency, monotonic_ns() - read_ns);
+		state->frames++;
+	}
+	else
+		state->failed++;
+}
+
+/* A unit gone with fingers down would leave them on the wall for good */
+static void on_wakeup(void* context)
+{
+	wall_state* state = (wall_state*)context;
+	for (size_t k = 0; k < state->panels.size(); k++)
+	{
+		wall_panel* panel = &state->panels[k];
+		if (!panel->live || touch_reader_layout(state->reader, panel->device))
+			continue;
+		panel->live = 0;
+		touch_frame lift;
+		lift.count = panel->down_count;
+		for (int i = 0; i < panel->down_count; i++)
+		{
+			memset(&lift.contacts[i], 0, sizeof(touch_contact));
+			lift.contacts[i].id = (int32_t)(((uint32_t)k << 16) | (panel->down[i] & 0xffff));
+		}
+		panel->down_count = 0;
+		if (lift.count && !uinput_touch_send(state->touch, &lift))
+			state->failed++;
+	}
+}
+
+void wall(hid_device* device, char* argv[], int start_index)
+{
+	(void)device;
+	const char* path = argv[start_index + 1];
+	if (fanout_in_worker())
+	{
+		htt_printf("--wall reads all units itself, it can't run per --device\n");
+		g_failures++;
+		return;
+	}
+	wall_state* state = new wall_state();
+	int32_t wall_width = 0, wall_height = 0;
+	if (!load_layout(path, state->panels, &wall_width, &wall_height))
+	{
+		g_failures++;
+		delete state;
+		return;
+	}
+	std::vector<size_t> indices;
+	for (size_t k = 0; k < state->panels.size(); k++)
+		indices.push_back(state->panels[k].device);
+	/* raw touch units, every panel gets its own transform */
+	transform_config identity = { 0, 0, 0, 0, { 1, 0, 0, 0, 1, 0 } };
+	state->reader = touch_reader_open(&indices[0], indices.size(), &g_touch_filter, &identity);
+	if (!state->reader)
+	{
+		htt_printf("%s : no HTT touch input to read\n", path);
+		g_failures++;
+		delete state;
+		return;
+	}
+
+	/* the device spans the wall, with slots for every contact of every panel */
+	touch_layout merged;
+	memset(&merged, 0, sizeof(merged));
+	state->panel_of.assign(g_device_count, -1);
+	int32_t right = 0, bottom = 0;
+	size_t live = 0;
+	for (size_t k = 0; k < state->panels.size(); k++)
+	{
+		wall_panel* panel = &state->panels[k];
+		const touch_layout* layout = touch_reader_layout(state->reader, panel->device);
+		if (panel->x + panel->bezel_left + panel->width > right)
+			right = panel->x + panel->bezel_left + panel->width;
+		if (panel->y + panel->bezel_top + panel->height > bottom)
+			bottom = panel->y + panel->bezel_top + panel->height;
+		if (!layout)
+		{
+			htt_printf("Device %zu : not on the wall, no touch input\n", panel->device);
+			g_failures++;
+			continue;
+		}
+		wall_panel_build(panel, layout);
+		panel->live = 1;
+		state->panel_of[panel->device] = (int)k;
+		merged.slots += layout->slots > 0 ? layout->slots : 1;
+		if (layout->pressure_max > merged.pressure_max)
+			merged.pressure_max = layout->pressure_max;
+		htt_printf("Device %zu : %dx%d at %d,%d, rotated %d\n", panel->device, panel->width, panel->height,
+			panel->x + panel->bezel_left, panel->y + panel->bezel_top, panel->rotation);
+		live++;
+	}
+	merged.x_max = (wall_width ? wall_width : right) - 1;
+	merged.y_max = (wall_height ? wall_height : bottom) - 1;
+
+	state->touch = live ? uinput_touch_create("Matrix Orbital HTT wall", &merged) : NULL;
+	if (state->touch)
+	{
+		histogram_reset(&state->latency);
+		touch_reader_set_wakeup(state->reader, on_wakeup, state);
+		htt_printf("Wall : %d x %d with %zu panels and %d slots as \"Matrix Orbital HTT wall\", Ctrl+C to stop\n",
+			merged.x_max + 1, merged.y_max + 1, live, merged.slots);
+		fflush(stdout);
+		if (touch_reader_run(state->reader, 0, on_frame, state) < 0)
+			g_failures++;
+		htt_printf("%llu frames written, %llu failed\n", (unsigned long long)state->frames,
+			(unsigned long long)state->failed);
+		histogram_print(&state->latency, "Read to write", 1e3, "us");
+		histogram_print_bars(&state->latency, 1e3, "us");
+		if (state->failed)
+			g_failures++;
+		uinput_touch_destroy(state->touch);
+	}
+	else
+		g_failures++;
+	touch_reader_close(state->reader);
+	delete state;
+}
@@ -0,0 +1,51 @@
+#ifndef HTT_WALL_H
+#define HTT_WALL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hidapi.h"
+#include "htt_transform.h"
+
+/* Video walls: the panels of several units as one touch surface (Linux only).
+ *
+ * A layout file places every unit on the wall. The touches of all units are
+ * read on one thread, each unit's points are rotated, scaled and moved into
+ * wall coordinates by a single transform and written to one uinput
+ * multitouch device with slots for the contacts of every panel. Contact IDs
+ * are made unique across panels, so a finger crossing a bezel lifts on one
+ * panel and touches down on the next.
+ *
+ * Layout file, a [selector] section per unit (see --device), sizes and
+ * positions in wall units, usually pixels of the combined display:
+ *
+ *   wall = 3840x2160         # optional, else the bounding box of the panels
+ *
+ *   [serial:A1B2C3]
+ *   position = 0,0           # top left corner of the panel, bezel included
+ *   bezel = 20,20            # active area from that corner, default 0,0
+ *   size = 1880x1040         # active area
+ *   rotation = 0             # 0, 90, 180 or 270 degrees clockwise */
+
+#define WALL_MAX_PANELS 16
+
+typedef struct
+{
+	size_t device;
+	int32_t x, y;
+	int32_t bezel_left, bezel_top;
+	int32_t width, height;       /* active area on the wall, after rotating */
+	int rotation;
+	point_transform transform;   /* touch units to wall */
+	int live;
+	int down_count;              /* contacts touching, lifted should the unit go away */
+	int32_t down[TOUCH_MAX_CONTACTS];
+} wall_panel;
+
+/* Folds rotation, scaling to the active area and the position into the
+ * transform of a panel read with the given layout. */
+void wall_panel_build(wall_panel* panel, const touch_layout* layout);
+
+/* --wall layoutfile, runs until Ctrl+C */
+void wall(hid_device* device, char* argv[], int start_index);
+
+#endif